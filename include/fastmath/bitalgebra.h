@@ -0,0 +1,929 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#ifndef FASTMATH_BITALGEBRA_H
+#define FASTMATH_BITALGEBRA_H
+
+#include "bitmatrix.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* Boolean matrix algebra over the Bitvector and BitMatrix types.
+ *
+ * The product C = A * B uses the Boolean semiring, so that C(i,j) is
+ * set if A(i,k) and B(k,j) are both set for any k, and the transitive
+ * closure adds (i,j) whenever there is a path from i to j. Both are
+ * provided in two versions:
+ *
+ *  _v1: the row-OR loops, C[i] |= B[k] for each k in A[i], built on
+ *       FastBitset::setUnion()
+ *  _v2: the Method of Four Russians, which precomputes the unions of
+ *       every subset of eight rows, so that one table lookup replaces
+ *       up to eight row unions. The tables cover a narrow band of
+ *       columns at a time so they stay in cache.
+ *
+ * The transpose is provided in the same way: _v1 reads and sets one bit
+ * at a time, while _v2 transposes 64 x 64 tiles of bits in registers.
+ * The interval abundance of a causal set counts |F[i] & P[j]| for every
+ * related pair: _v1 counts one pair at a time, while _v2 counts tiles of
+ * 64 x 64 pairs, reusing each band of a row for the whole tile. The same
+ * tiles give intersectionCounts() and intersectionHistogram() for any
+ * pairs of rows.
+ *
+ * The functions without a suffix use the fastest version. All versions
+ * are parallelized with OpenMP over the rows of the result.
+ *
+ * Matrices are not resized: the product must be n x m for an n x k
+ * matrix A and a k x m matrix B, the transitive closure requires a
+ * square matrix, and the transpose of an n x m matrix must be m x n.
+ * As with the FastBitset, dimensions are not checked. */
+
+namespace fastmath {
+
+//------------------//
+// Matrix Accessors //
+//------------------//
+
+// These let the algorithms below use either matrix type
+
+inline uint64_t getNumRows(const Bitvector &m) { return m.size(); }
+inline uint64_t getNumRows(const BitMatrix &m) { return m.getNumRows(); }
+
+inline uint64_t getNumBlocks(const Bitvector &m) {
+    return m.size() ? m[0].getNumBlocks() : 0;
+}
+inline uint64_t getNumBlocks(const BitMatrix &m) { return m.getNumBlocks(); }
+
+inline BlockType *getRowAddress(Bitvector &m, uint64_t i) {
+    return (BlockType *)m[i].getAddress();
+}
+inline const BlockType *getRowAddress(const Bitvector &m, uint64_t i) {
+    return (const BlockType *)m[i].getAddress();
+}
+inline BlockType *getRowAddress(BitMatrix &m, uint64_t i) {
+    return m.getRowAddress(i);
+}
+inline const BlockType *getRowAddress(const BitMatrix &m, uint64_t i) {
+    return m.getRowAddress(i);
+}
+
+//-----------------------//
+// Four Russians Kernels //
+//-----------------------//
+
+// Each block of a row of A selects up to 64 rows of B, which are split
+// into eight groups of eight rows with one table of 256 unions each
+static const unsigned int m4r_tables = sizeof(BlockType);
+static const unsigned int m4r_entries = 256;
+
+// Number of blocks in each column band
+// A band of every table uses 8 * 256 * 8 blocks, or 128 KB
+static const uint64_t m4r_width = 8;
+
+inline BlockType *createM4RTables() {
+    BlockType *tables = NULL;
+    try {
+        if (posix_memalign((void **)&tables, BitMatrix::cache_line,
+                           sizeof(BlockType) * m4r_tables * m4r_entries *
+                               m4r_width))
+            throw std::bad_alloc();
+    } catch (std::bad_alloc &) {
+        fprintf(stderr, "Memory allocation failure in %s on line %d!\n",
+                __FILE__, __LINE__);
+        fflush(stderr);
+        tables = NULL;
+    }
+    return tables;
+}
+
+// Fill the tables using the 'nrows' rows starting at 'rows[0]'
+// Entry x of table t is the union of rows 8t + b for each bit b set in
+// x, restricted to the 'width' blocks starting at block 'band'
+// Rows past 'nrows' are treated as empty
+// This must be called by every thread in a parallel region
+inline void buildM4RTables(BlockType *tables, const BlockType *const *rows,
+                           uint64_t nrows, uint64_t band, uint64_t width) {
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (unsigned int t = 0; t < m4r_tables; t++) {
+        BlockType *table = tables + t * m4r_entries * m4r_width;
+        memset(table, 0, sizeof(BlockType) * m4r_width);
+        for (unsigned int x = 1; x < m4r_entries; x++) {
+            // Each entry adds one row to an entry which is already built
+            const BlockType *prev = table + (x & (x - 1)) * m4r_width;
+            BlockType *entry = table + x * m4r_width;
+            uint64_t r = (t << 3) + __builtin_ctz(x);
+            for (uint64_t w = 0; w < m4r_width; w++)
+                entry[w] = prev[w];
+            if (r < nrows)
+                for (uint64_t w = 0; w < width; w++)
+                    entry[w] |= rows[r][band + w];
+        }
+    }
+}
+
+// Union of the table entries selected by 'key' into 'row', restricted
+// to the 'width' blocks starting at block 'band'
+// A full band is a single 512-bit vector, or two 256-bit vectors, so the
+// SIMD versions use the instruction set given by 'level'
+inline void applyM4RTables(const BlockType *tables, BlockType key,
+                           BlockType *row, uint64_t band, uint64_t width,
+                           const SimdLevel level) {
+    const BlockType *entry[m4r_tables];
+    for (unsigned int t = 0; t < m4r_tables; t++, key >>= 8)
+        entry[t] = tables + ((t << 8) | (key & 0xff)) * m4r_width;
+    BlockType *dst = row + band;
+
+    if (width == m4r_width && level >= SIMD_AVX512) {
+        asm volatile("vmovdqu64 (%1), %%zmm0		\n\t"
+                     "vporq (%2), %%zmm0, %%zmm0	\n\t"
+                     "vporq (%3), %%zmm0, %%zmm0	\n\t"
+                     "vporq (%4), %%zmm0, %%zmm0	\n\t"
+                     "vporq (%5), %%zmm0, %%zmm0	\n\t"
+                     "vporq (%6), %%zmm0, %%zmm0	\n\t"
+                     "vporq (%7), %%zmm0, %%zmm0	\n\t"
+                     "vporq (%8), %%zmm0, %%zmm0	\n\t"
+                     "vporq (%0), %%zmm0, %%zmm0	\n\t"
+                     "vmovdqu64 %%zmm0, (%0)		\n\t"
+                     "vzeroupper			\n\t"
+                     :
+                     : "r"(dst), "r"(entry[0]), "r"(entry[1]), "r"(entry[2]),
+                       "r"(entry[3]), "r"(entry[4]), "r"(entry[5]),
+                       "r"(entry[6]), "r"(entry[7])
+                     : "%xmm0", "memory");
+    } else if (width == m4r_width && level >= SIMD_AVX2) {
+        asm volatile("vmovdqu (%1), %%ymm0		\n\t"
+                     "vmovdqu 32(%1), %%ymm1		\n\t"
+                     "vpor (%2), %%ymm0, %%ymm0		\n\t"
+                     "vpor 32(%2), %%ymm1, %%ymm1	\n\t"
+                     "vpor (%3), %%ymm0, %%ymm0		\n\t"
+                     "vpor 32(%3), %%ymm1, %%ymm1	\n\t"
+                     "vpor (%4), %%ymm0, %%ymm0		\n\t"
+                     "vpor 32(%4), %%ymm1, %%ymm1	\n\t"
+                     "vpor (%5), %%ymm0, %%ymm0		\n\t"
+                     "vpor 32(%5), %%ymm1, %%ymm1	\n\t"
+                     "vpor (%6), %%ymm0, %%ymm0		\n\t"
+                     "vpor 32(%6), %%ymm1, %%ymm1	\n\t"
+                     "vpor (%7), %%ymm0, %%ymm0		\n\t"
+                     "vpor 32(%7), %%ymm1, %%ymm1	\n\t"
+                     "vpor (%8), %%ymm0, %%ymm0		\n\t"
+                     "vpor 32(%8), %%ymm1, %%ymm1	\n\t"
+                     "vpor (%0), %%ymm0, %%ymm0		\n\t"
+                     "vpor 32(%0), %%ymm1, %%ymm1	\n\t"
+                     "vmovdqu %%ymm0, (%0)		\n\t"
+                     "vmovdqu %%ymm1, 32(%0)		\n\t"
+                     "vzeroupper			\n\t"
+                     :
+                     : "r"(dst), "r"(entry[0]), "r"(entry[1]), "r"(entry[2]),
+                       "r"(entry[3]), "r"(entry[4]), "r"(entry[5]),
+                       "r"(entry[6]), "r"(entry[7])
+                     : "%xmm0", "%xmm1", "memory");
+    } else {
+        BlockType acc[m4r_width];
+        for (uint64_t w = 0; w < m4r_width; w++)
+            acc[w] = 0;
+        for (unsigned int t = 0; t < m4r_tables; t++)
+            for (uint64_t w = 0; w < m4r_width; w++)
+                acc[w] |= entry[t][w];
+        for (uint64_t w = 0; w < width; w++)
+            dst[w] |= acc[w];
+    }
+}
+
+//-------------------//
+// Transpose Kernels //
+//-------------------//
+
+// The tile is transposed in six rounds: round j exchanges the j x j
+// sub-blocks above and below the diagonal of each 2j x 2j block, using
+// the mask of the bits which move
+const BlockType transpose_masks[] = {
+    0x00000000ffffffffllu, 0x0000ffff0000ffffllu, 0x00ff00ff00ff00ffllu,
+    0x0f0f0f0f0f0f0f0fllu, 0x3333333333333333llu, 0x5555555555555555llu};
+
+// Transpose the 64 x 64 tile of bits 'tile', where bit c of tile[r] is
+// the element (r, c), in place
+inline void transposeTile_v1(BlockType *tile) {
+    for (unsigned int round = 0, j = 32; j; round++, j >>= 1) {
+        BlockType m = transpose_masks[round];
+        for (unsigned int k = 0; k < 64; k = (k + j + 1) & ~j) {
+            BlockType t = ((tile[k] >> j) ^ tile[k + j]) & m;
+            tile[k] ^= t << j;
+            tile[k + j] ^= t;
+        }
+    }
+}
+
+// The tile is held in eight registers of eight rows each. The first
+// three rounds pair whole registers, and the last three pair lanes of
+// the same register, which are exchanged with a permutation; the mask
+// k1 selects the lanes which receive the lower half of each pair.
+#define TRANSPOSE_REGISTERS(x, y, j, m)                                        \
+    "vpsrlq $" #j ", %%zmm" #x ", %%zmm9		\n\t"                          \
+    "vpxorq %%zmm" #y ", %%zmm9, %%zmm9		\n\t"                          \
+    "vpandq %%zmm" #m ", %%zmm9, %%zmm9		\n\t"                          \
+    "vpxorq %%zmm9, %%zmm" #y ", %%zmm" #y "		\n\t"                  \
+    "vpsllq $" #j ", %%zmm9, %%zmm9		\n\t"                              \
+    "vpxorq %%zmm9, %%zmm" #x ", %%zmm" #x "		\n\t"
+
+#define TRANSPOSE_LANES(x, j, m, permute)                                      \
+    permute(x)                                                                 \
+    "vpsrlq $" #j ", %%zmm" #x ", %%zmm9		\n\t"                          \
+    "vpxorq %%zmm10, %%zmm9, %%zmm9		\n\t"                              \
+    "vpandq %%zmm" #m ", %%zmm9, %%zmm9		\n\t"                          \
+    "vpsllq $" #j ", %%zmm9, %%zmm9		\n\t"                              \
+    "vpsrlq $" #j ", %%zmm10, %%zmm10		\n\t"                          \
+    "vpxorq %%zmm" #x ", %%zmm10, %%zmm10		\n\t"                      \
+    "vpandq %%zmm" #m ", %%zmm10, %%zmm10		\n\t"                      \
+    "vmovdqa64 %%zmm10, %%zmm9%{%%k1%}		\n\t"                          \
+    "vpxorq %%zmm9, %%zmm" #x ", %%zmm" #x "		\n\t"
+
+#define TRANSPOSE_ALL_LANES(j, m, permute)                                     \
+    TRANSPOSE_LANES(0, j, m, permute)                                          \
+    TRANSPOSE_LANES(1, j, m, permute)                                          \
+    TRANSPOSE_LANES(2, j, m, permute)                                          \
+    TRANSPOSE_LANES(3, j, m, permute)                                          \
+    TRANSPOSE_LANES(4, j, m, permute)                                          \
+    TRANSPOSE_LANES(5, j, m, permute)                                          \
+    TRANSPOSE_LANES(6, j, m, permute)                                          \
+    TRANSPOSE_LANES(7, j, m, permute)
+
+// Exchange the halves, quarters and eighths of a register
+#define SWAP_HALVES(x)                                                         \
+    "vshufi64x2 $0x4e, %%zmm" #x ", %%zmm" #x ", %%zmm10	\n\t"
+#define SWAP_QUARTERS(x)                                                       \
+    "vshufi64x2 $0xb1, %%zmm" #x ", %%zmm" #x ", %%zmm10	\n\t"
+#define SWAP_EIGHTHS(x) "vpshufd $0x4e, %%zmm" #x ", %%zmm10		\n\t"
+
+inline void transposeTile_avx512(BlockType *tile) {
+    asm volatile(
+        "vmovdqu64 (%0), %%zmm0			\n\t"
+        "vmovdqu64 64(%0), %%zmm1			\n\t"
+        "vmovdqu64 128(%0), %%zmm2		\n\t"
+        "vmovdqu64 192(%0), %%zmm3		\n\t"
+        "vmovdqu64 256(%0), %%zmm4		\n\t"
+        "vmovdqu64 320(%0), %%zmm5		\n\t"
+        "vmovdqu64 384(%0), %%zmm6		\n\t"
+        "vmovdqu64 448(%0), %%zmm7		\n\t"
+        "vpbroadcastq (%1), %%zmm11		\n\t"
+        "vpbroadcastq 8(%1), %%zmm12		\n\t"
+        "vpbroadcastq 16(%1), %%zmm13		\n\t"
+        "vpbroadcastq 24(%1), %%zmm14		\n\t"
+        "vpbroadcastq 32(%1), %%zmm15		\n\t"
+        "vpbroadcastq 40(%1), %%zmm8		\n\t"
+
+        TRANSPOSE_REGISTERS(0, 4, 32, 11)
+        TRANSPOSE_REGISTERS(1, 5, 32, 11)
+        TRANSPOSE_REGISTERS(2, 6, 32, 11)
+        TRANSPOSE_REGISTERS(3, 7, 32, 11)
+        TRANSPOSE_REGISTERS(0, 2, 16, 12)
+        TRANSPOSE_REGISTERS(1, 3, 16, 12)
+        TRANSPOSE_REGISTERS(4, 6, 16, 12)
+        TRANSPOSE_REGISTERS(5, 7, 16, 12)
+        TRANSPOSE_REGISTERS(0, 1, 8, 13)
+        TRANSPOSE_REGISTERS(2, 3, 8, 13)
+        TRANSPOSE_REGISTERS(4, 5, 8, 13)
+        TRANSPOSE_REGISTERS(6, 7, 8, 13)
+
+        "movl $0xf0, %%eax			\n\t"
+        "kmovw %%eax, %%k1			\n\t"
+        TRANSPOSE_ALL_LANES(4, 14, SWAP_HALVES)
+        "movl $0xcc, %%eax			\n\t"
+        "kmovw %%eax, %%k1			\n\t"
+        TRANSPOSE_ALL_LANES(2, 15, SWAP_QUARTERS)
+        "movl $0xaa, %%eax			\n\t"
+        "kmovw %%eax, %%k1			\n\t"
+        TRANSPOSE_ALL_LANES(1, 8, SWAP_EIGHTHS)
+
+        "vmovdqu64 %%zmm0, (%0)			\n\t"
+        "vmovdqu64 %%zmm1, 64(%0)			\n\t"
+        "vmovdqu64 %%zmm2, 128(%0)		\n\t"
+        "vmovdqu64 %%zmm3, 192(%0)		\n\t"
+        "vmovdqu64 %%zmm4, 256(%0)		\n\t"
+        "vmovdqu64 %%zmm5, 320(%0)		\n\t"
+        "vmovdqu64 %%zmm6, 384(%0)		\n\t"
+        "vmovdqu64 %%zmm7, 448(%0)		\n\t"
+        "vzeroupper				\n\t"
+        :
+        : "r"(tile), "r"(transpose_masks)
+        : "%eax", "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5",
+          "%xmm6", "%xmm7", "%xmm8", "%xmm9", "%xmm10", "%xmm11", "%xmm12",
+          "%xmm13", "%xmm14", "%xmm15", "memory" FASTBITSET_K1_CLOBBER);
+}
+
+#undef TRANSPOSE_REGISTERS
+#undef TRANSPOSE_LANES
+#undef TRANSPOSE_ALL_LANES
+#undef SWAP_HALVES
+#undef SWAP_QUARTERS
+#undef SWAP_EIGHTHS
+
+// This uses the instruction set given by 'level'
+inline void transposeTile(BlockType *tile, const SimdLevel level) {
+    if (level >= SIMD_AVX512)
+        transposeTile_avx512(tile);
+    else
+        transposeTile_v1(tile);
+}
+
+//----------------------------//
+// Intersection Count Kernels //
+//----------------------------//
+
+// The all-pairs counts work on tiles of 64 rows of A and 64 rows of B,
+// so the pairs of a tile to be counted fit in one block per row of A,
+// and on bands of 256 blocks, so a band of a tile of B (128 KB) stays in
+// the L2 cache while it is used by every row of A
+static const uint64_t ic_rows = 64;
+static const uint64_t ic_width = 256;
+
+// Add |a0 & b0|, |a0 & b1|, |a1 & b0| and |a1 & b1| over the blocks k0
+// through k1 - 1 to cnt[0] through cnt[3]
+// Each block of the four rows is loaded once for all four pairs
+inline void countIntersections_v1(const BlockType *a0, const BlockType *a1,
+                                  const BlockType *b0, const BlockType *b1,
+                                  uint64_t k0, uint64_t k1, uint64_t *cnt) {
+    for (uint64_t k = k0; k < k1; k++) {
+        cnt[0] += popcount(a0[k] & b0[k]);
+        cnt[1] += popcount(a0[k] & b1[k]);
+        cnt[2] += popcount(a1[k] & b0[k]);
+        cnt[3] += popcount(a1[k] & b1[k]);
+    }
+}
+
+// The same counts with vectors of type V, where P counts the bits in
+// each lane of a vector, followed by countIntersections_v1() for the
+// blocks past the last whole vector
+// This is compiled for each instruction set below, in the same way as
+// the vector kernels of FastBitset. The lanes are only summed when a
+// vector was counted, since the last band of a row may be shorter.
+template <class V, class P>
+__attribute__((always_inline)) inline void
+countIntersectionBlocks(const BlockType *a0, const BlockType *a1,
+                        const BlockType *b0, const BlockType *b1, uint64_t k0,
+                        uint64_t k1, uint64_t *cnt) {
+    const uint64_t w = sizeof(V) / sizeof(BlockType);
+    uint64_t k = k0;
+    if (k + w <= k1) {
+        V acc[4];
+        memset(acc, 0, sizeof(acc));
+        for (; k + w <= k1; k += w) {
+            V x0, x1, y0, y1;
+            memcpy(&x0, a0 + k, sizeof(V));
+            memcpy(&x1, a1 + k, sizeof(V));
+            memcpy(&y0, b0 + k, sizeof(V));
+            memcpy(&y1, b1 + k, sizeof(V));
+            P::add(x0 & y0, acc[0]);
+            P::add(x0 & y1, acc[1]);
+            P::add(x1 & y0, acc[2]);
+            P::add(x1 & y1, acc[3]);
+        }
+
+        BlockType lanes[4 * w];
+        memcpy(lanes, acc, sizeof(acc));
+        for (uint64_t p = 0; p < 4; p++)
+            for (uint64_t l = 0; l < w; l++)
+                cnt[p] += lanes[p * w + l];
+    }
+    countIntersections_v1(a0, a1, b0, b1, k, k1, cnt);
+}
+
+#if FBALIGN == 512
+// Eight blocks at a time with vpopcntq
+// This requires the avx512_vpopcntdq extension
+__attribute__((target("avx512f,avx512bw,avx512vpopcntdq,popcnt"))) inline void
+countIntersections_avx512(const BlockType *a0, const BlockType *a1,
+                          const BlockType *b0, const BlockType *b1,
+                          uint64_t k0, uint64_t k1, uint64_t *cnt) {
+    countIntersectionBlocks<BlockVector512, PopcountVpopcnt>(a0, a1, b0, b1,
+                                                             k0, k1, cnt);
+}
+#endif
+
+// This uses the instruction set given by 'level'
+inline void countIntersections(const BlockType *a0, const BlockType *a1,
+                               const BlockType *b0, const BlockType *b1,
+                               uint64_t k0, uint64_t k1, uint64_t *cnt,
+                               const SimdLevel level) {
+    // The level is only this high when FBALIGN is 512
+    if (level >= SIMD_AVX512_VPOPCNT) {
+#if FBALIGN == 512
+        countIntersections_avx512(a0, a1, b0, b1, k0, k1, cnt);
+        return;
+#endif
+    }
+    countIntersections_v1(a0, a1, b0, b1, k0, k1, cnt);
+}
+
+// The 'count' bits starting at bit 'p' of a row of 'nb' blocks, where
+// 'count' is at most 64
+inline BlockType readBits(const BlockType *row, uint64_t nb, uint64_t p,
+                          uint64_t count) {
+    uint64_t k = p >> BLOCK_SHIFT;
+    unsigned int r = static_cast<unsigned int>(p - (k << BLOCK_SHIFT));
+    BlockType x = row[k] >> r;
+    if (r && k + 1 < nb)
+        x |= row[k + 1] << (FastBitset::bits_per_block - r);
+    return x & mask_table[count & (FastBitset::bits_per_block - 1)];
+}
+
+// Add |a[i] & b[j]| over the blocks k0 through k1 - 1 to
+// cnt[i * ic_rows + j] for each of the 'arows' rows 'a' and 'brows' rows
+// 'b', where keys[i] selects the rows of 'b' paired with a[i]
+// Pairs are counted two by two, and any two by two block of pairs with
+// no keys set is skipped
+// The keys and counts must have room for 64 rows; the unused keys must
+// be zero, and the counts past 'arows' and 'brows' are left undefined
+inline void countIntersectionTile(const BlockType *const *a, uint64_t arows,
+                                  const BlockType *const *b, uint64_t brows,
+                                  const BlockType *keys, uint64_t k0,
+                                  uint64_t k1, uint64_t *cnt,
+                                  const SimdLevel level) {
+    for (uint64_t band = k0; band < k1; band += ic_width) {
+        uint64_t end = std::min(band + ic_width, k1);
+        for (uint64_t i = 0; i < arows; i += 2) {
+            const BlockType *a1 = a[std::min(i + 1, arows - 1)];
+            BlockType key = keys[i] | keys[i + 1];
+            for (uint64_t j = 0; j < brows; j += 2) {
+                if (!(key >> j & 3))
+                    continue;
+                uint64_t c[4] = {0, 0, 0, 0};
+                countIntersections(a[i], a1, b[j],
+                                   b[std::min(j + 1, brows - 1)], band, end,
+                                   c, level);
+                cnt[i * ic_rows + j] += c[0];
+                cnt[i * ic_rows + j + 1] += c[1];
+                cnt[(i + 1) * ic_rows + j] += c[2];
+                cnt[(i + 1) * ic_rows + j + 1] += c[3];
+            }
+        }
+    }
+}
+
+//------------------------//
+// Boolean Matrix Product //
+//------------------------//
+
+// The row-OR loops
+template <class Matrix>
+void booleanProduct_v1(const Matrix &A, const Matrix &B, Matrix &C) {
+    uint64_t n = getNumRows(A);
+    uint64_t k = getNumRows(B);
+    uint64_t nb = getNumBlocks(A);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+    for (uint64_t i = 0; i < n; i++) {
+        const BlockType *a = getRowAddress(A, i);
+        C[i].reset();
+        for (uint64_t j = 0; j < nb; j++) {
+            for (BlockType key = a[j]; key; key &= key - 1) {
+                uint64_t r = (j << BLOCK_SHIFT) + __builtin_ctzl(key);
+                if (r < k)
+                    C[i].setUnion(B[r]);
+            }
+        }
+    }
+}
+
+// The Method of Four Russians
+// Block j of each row of A is copied into 'keys' once for all the bands,
+// since reading it from each row in turn touches a new cache line
+template <class Matrix>
+void booleanProduct_v2(const Matrix &A, const Matrix &B, Matrix &C) {
+    uint64_t n = getNumRows(A);
+    uint64_t k = getNumRows(B);
+    uint64_t nb = getNumBlocks(C);
+    uint64_t nkb = (k + FastBitset::bits_per_block - 1) >> BLOCK_SHIFT;
+
+    std::vector<const BlockType *> a(n), b(k);
+    std::vector<BlockType *> c(n);
+    std::vector<BlockType> keys(n);
+    for (uint64_t i = 0; i < n; i++) {
+        a[i] = getRowAddress(A, i);
+        c[i] = getRowAddress(C, i);
+        memset(c[i], 0, sizeof(BlockType) * nb);
+    }
+    for (uint64_t i = 0; i < k; i++)
+        b[i] = getRowAddress(B, i);
+
+    BlockType *tables = createM4RTables();
+    if (tables == NULL)
+        return;
+    SimdLevel level = getSimdLevel();
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    for (uint64_t j = 0; j < nkb; j++) {
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for (uint64_t i = 0; i < n; i++)
+            keys[i] = a[i][j];
+
+        // Rows 64j through 64j + 63 of B
+        uint64_t r = j << BLOCK_SHIFT;
+        for (uint64_t band = 0; band < nb; band += m4r_width) {
+            uint64_t width = std::min(m4r_width, nb - band);
+            buildM4RTables(tables, &b[r], k - r, band, width);
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+            for (uint64_t i = 0; i < n; i++)
+                if (keys[i])
+                    applyM4RTables(tables, keys[i], c[i], band, width,
+                                   level);
+        }
+    }
+
+    free(tables);
+}
+
+// This uses the fastest version
+template <class Matrix>
+void booleanProduct(const Matrix &A, const Matrix &B, Matrix &C) {
+    booleanProduct_v2(A, B, C);
+}
+
+//--------------------//
+// Transitive Closure //
+//--------------------//
+
+// Warshall's algorithm, using a row union for each pivot
+template <class Matrix> void transitiveClosure_v1(Matrix &A) {
+    uint64_t n = getNumRows(A);
+
+    for (uint64_t k = 0; k < n; k++) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+        for (uint64_t i = 0; i < n; i++)
+            if (i != k && A[i].read(k))
+                A[i].setUnion(A[k]);
+    }
+}
+
+// Blocked Warshall with the Method of Four Russians
+// Pivots are taken 64 at a time: the pivot rows are first closed among
+// themselves, after which each row takes the union of the pivot rows it
+// reaches with table lookups
+// Rows which reach no pivots in a block are skipped, so a DAG whose
+// vertices are in topological order does roughly half the work
+template <class Matrix> void transitiveClosure_v2(Matrix &A) {
+    uint64_t n = getNumRows(A);
+    uint64_t nb = getNumBlocks(A);
+
+    std::vector<BlockType *> a(n);
+    std::vector<BlockType> keys(n);
+    for (uint64_t i = 0; i < n; i++)
+        a[i] = getRowAddress(A, i);
+
+    BlockType *tables = createM4RTables();
+    if (tables == NULL)
+        return;
+    SimdLevel level = getSimdLevel();
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    for (uint64_t j = 0; j < nb; j++) {
+        uint64_t r = j << BLOCK_SHIFT;
+        if (r >= n)
+            break;
+        uint64_t npivots = std::min((uint64_t)FastBitset::bits_per_block,
+                                    n - r);
+
+        // Close the pivot rows among themselves
+#ifdef _OPENMP
+#pragma omp single
+#endif
+        for (uint64_t p = 0; p < npivots; p++)
+            for (uint64_t q = 0; q < npivots; q++)
+                if (q != p && (a[r + q][j] >> p & 1))
+                    for (uint64_t w = 0; w < nb; w++)
+                        a[r + q][w] |= a[r + p][w];
+
+        // The keys are read before any row is updated
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for (uint64_t i = 0; i < n; i++)
+            keys[i] = a[i][j];
+
+        for (uint64_t band = 0; band < nb; band += m4r_width) {
+            uint64_t width = std::min(m4r_width, nb - band);
+            buildM4RTables(tables, &a[r], npivots, band, width);
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+            for (uint64_t i = 0; i < n; i++)
+                if (keys[i])
+                    applyM4RTables(tables, keys[i], a[i], band, width,
+                                   level);
+        }
+    }
+
+    free(tables);
+}
+
+// This uses the fastest version
+template <class Matrix> void transitiveClosure(Matrix &A) {
+    transitiveClosure_v2(A);
+}
+
+//-----------//
+// Transpose //
+//-----------//
+
+// Read and set one bit at a time
+template <class Matrix> void transpose_v1(const Matrix &A, Matrix &B) {
+    uint64_t n = getNumRows(A);
+    uint64_t m = getNumRows(B);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (uint64_t j = 0; j < m; j++) {
+        B[j].reset();
+        for (uint64_t i = 0; i < n; i++)
+            if (A[i].read(j))
+                B[j].set(i);
+    }
+}
+
+// Transpose 64 x 64 tiles of bits
+// Tile (I, J) of A holds block J of rows 64I through 64I + 63, and
+// becomes block I of rows 64J through 64J + 63 of B
+template <class Matrix> void transpose_v2(const Matrix &A, Matrix &B) {
+    uint64_t n = getNumRows(A);
+    uint64_t m = getNumRows(B);
+    uint64_t nb = getNumBlocks(B);
+    uint64_t ni = (n + FastBitset::bits_per_block - 1) >> BLOCK_SHIFT;
+    uint64_t nj = (m + FastBitset::bits_per_block - 1) >> BLOCK_SHIFT;
+
+    std::vector<const BlockType *> a(n);
+    std::vector<BlockType *> b(m);
+    for (uint64_t i = 0; i < n; i++)
+        a[i] = getRowAddress(A, i);
+    for (uint64_t j = 0; j < m; j++)
+        b[j] = getRowAddress(B, j);
+    SimdLevel level = getSimdLevel();
+
+    // Each thread writes a different band of rows of B
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (uint64_t J = 0; J < nj; J++) {
+        BlockType tile[FastBitset::bits_per_block];
+        uint64_t r = J << BLOCK_SHIFT;
+        uint64_t nrows = std::min((uint64_t)FastBitset::bits_per_block,
+                                  m - r);
+        for (uint64_t c = 0; c < nrows; c++)
+            memset(b[r + c], 0, sizeof(BlockType) * nb);
+
+        for (uint64_t I = 0; I < ni; I++) {
+            uint64_t s = I << BLOCK_SHIFT;
+            uint64_t ncols = std::min((uint64_t)FastBitset::bits_per_block,
+                                      n - s);
+            for (uint64_t c = 0; c < ncols; c++)
+                tile[c] = a[s + c][J];
+            for (uint64_t c = ncols; c < FastBitset::bits_per_block; c++)
+                tile[c] = 0;
+
+            transposeTile(tile, level);
+
+            for (uint64_t c = 0; c < nrows; c++)
+                b[r + c][I] = tile[c];
+        }
+    }
+}
+
+// This uses the fastest version
+template <class Matrix> void transpose(const Matrix &A, Matrix &B) {
+    transpose_v2(A, B);
+}
+
+//---------------------//
+// Intersection Counts //
+//---------------------//
+
+// The engine for the counts below: the pairs of rows i0 <= i < i1 of A
+// and j0 <= j < j1 of B are split into 64 x 64 tiles, which are counted
+// in parallel, so each band of a row is loaded once for many pairs
+// If 'R' is not NULL, only pairs (i, j) with R(i, j) set are counted, and
+// tiles without any are skipped
+// If 'ordered' is set, only pairs with i < j are counted, and each row i
+// of A and row j of B must have no bits outside of columns i through j,
+// so only the blocks between the rows of a tile are read
+// The counts are written to C if it is not NULL, and added to the
+// histogram if it is not NULL
+template <class Matrix>
+void countIntersectionTiles(const Matrix &A, uint64_t i0, uint64_t i1,
+                            const Matrix &B, uint64_t j0, uint64_t j1,
+                            const Matrix *R, const bool ordered, uint64_t *C,
+                            uint64_t *histogram, uint64_t nbins) {
+    if (i1 <= i0 || j1 <= j0 || (histogram != NULL && !nbins))
+        return;
+
+    uint64_t nb = getNumBlocks(A);
+    uint64_t rnb = R != NULL ? getNumBlocks(*R) : 0;
+    uint64_t ni = (i1 - i0 + ic_rows - 1) / ic_rows;
+    uint64_t nj = (j1 - j0 + ic_rows - 1) / ic_rows;
+    uint64_t ldc = j1 - j0;
+
+    std::vector<const BlockType *> a(i1 - i0), b(j1 - j0), r;
+    for (uint64_t i = i0; i < i1; i++)
+        a[i - i0] = getRowAddress(A, i);
+    for (uint64_t j = j0; j < j1; j++)
+        b[j - j0] = getRowAddress(B, j);
+    if (R != NULL) {
+        r.resize(i1 - i0);
+        for (uint64_t i = i0; i < i1; i++)
+            r[i - i0] = getRowAddress(*R, i);
+    }
+    SimdLevel level = getSimdLevel();
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        std::vector<uint64_t> cnt(ic_rows * ic_rows);
+        std::vector<uint64_t> local(histogram != NULL ? nbins : 0);
+        BlockType keys[ic_rows];
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 1)
+#endif
+        for (uint64_t t = 0; t < ni * nj; t++) {
+            // Tile rows s through s + arows - 1 of A, relative to i0, and
+            // rows u through u + brows - 1 of B, relative to j0
+            uint64_t s = (t / nj) * ic_rows;
+            uint64_t u = (t % nj) * ic_rows;
+            uint64_t arows = std::min(ic_rows, i1 - i0 - s);
+            uint64_t brows = std::min(ic_rows, j1 - j0 - u);
+            uint64_t k0 = 0, k1 = nb;
+            if (ordered) {
+                if (j0 + u + brows <= i0 + s + 1)
+                    continue;
+                k0 = (i0 + s) >> BLOCK_SHIFT;
+                k1 = std::min(nb, ((j0 + u + brows - 1) >> BLOCK_SHIFT) + 1);
+            }
+
+            BlockType any = 0;
+            for (uint64_t i = 0; i < ic_rows; i++) {
+                if (i >= arows) {
+                    keys[i] = 0;
+                    continue;
+                }
+                if (R != NULL)
+                    keys[i] = readBits(r[s + i], rnb, j0 + u, brows);
+                else
+                    keys[i] = mask_table[brows & (ic_rows - 1)];
+                if (ordered && i0 + s + i + 1 > j0 + u) {
+                    // The first column of B paired with this row
+                    uint64_t first = i0 + s + i + 1 - (j0 + u);
+                    keys[i] &= first < ic_rows ? ~(BlockType)0 << first : 0;
+                }
+                any |= keys[i];
+            }
+            if (!any)
+                continue;
+
+            std::fill(cnt.begin(), cnt.end(), 0);
+            countIntersectionTile(&a[s], arows, &b[u], brows, keys, k0, k1,
+                                  &cnt[0], level);
+
+            for (uint64_t i = 0; i < arows; i++) {
+                for (BlockType key = keys[i]; key; key &= key - 1) {
+                    uint64_t j = __builtin_ctzl(key);
+                    uint64_t c = cnt[i * ic_rows + j];
+                    if (C != NULL)
+                        C[(s + i) * ldc + u + j] = c;
+                    if (histogram != NULL)
+                        local[std::min(c, nbins - 1)]++;
+                }
+            }
+        }
+
+        if (histogram != NULL) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+            for (uint64_t k = 0; k < nbins; k++)
+                histogram[k] += local[k];
+        }
+    }
+}
+
+// Write |A[i] & B[j]| to C[(i - i0) * (j1 - j0) + j - j0] for each row
+// i0 <= i < i1 of A and j0 <= j < j1 of B
+// This is the matrix of partial_vecprod() over whole rows, for every pair
+template <class Matrix>
+void intersectionCounts(const Matrix &A, uint64_t i0, uint64_t i1,
+                        const Matrix &B, uint64_t j0, uint64_t j1,
+                        uint64_t *C) {
+    countIntersectionTiles(A, i0, i1, B, j0, j1, (const Matrix *)NULL, false,
+                           C, (uint64_t *)NULL, 0);
+}
+
+// Add the number of pairs with |A[i] & B[j]| = k to histogram[k], for the
+// same pairs as above, where pairs with at least nbins - 1 in common are
+// added to the last bin
+// If 'R' is not NULL, only the pairs with R(i, j) set are counted
+template <class Matrix>
+void intersectionHistogram(const Matrix &A, uint64_t i0, uint64_t i1,
+                           const Matrix &B, uint64_t j0, uint64_t j1,
+                           uint64_t *histogram, uint64_t nbins,
+                           const Matrix *R = NULL) {
+    countIntersectionTiles(A, i0, i1, B, j0, j1, R, false, (uint64_t *)NULL,
+                           histogram, nbins);
+}
+
+// Interval abundance of a causal set whose elements are in topological
+// order, so that i < j whenever i precedes j
+// Row i of F is the future of element i, and row j of P is the past of
+// element j, which is the transpose of F (see transpose())
+// For each related pair i < j with i0 <= i < i1, the interval between
+// them has |F[i] & P[j]| elements; the number of intervals with k
+// elements is added to histogram[k], and intervals with at least
+// nbins - 1 elements are added to the last bin
+// Ranges of i let the work be divided among processes
+
+// Count each related pair separately, as with partial_vecprod()
+template <class Matrix>
+void intervalAbundance_v1(const Matrix &F, const Matrix &P, uint64_t i0,
+                          uint64_t i1, uint64_t *histogram, uint64_t nbins) {
+    uint64_t n = getNumRows(F);
+    if (!nbins)
+        return;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        std::vector<uint64_t> local(nbins);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 64)
+#endif
+        for (uint64_t i = i0; i < i1; i++) {
+            const BlockType *f = getRowAddress(F, i);
+            for (uint64_t j = i + 1; j < n; j++) {
+                if (!(f[j >> BLOCK_SHIFT] >> (j & 63) & 1))
+                    continue;
+                const BlockType *p = getRowAddress(P, j);
+                uint64_t c = 0;
+                for (uint64_t k = i >> BLOCK_SHIFT; k <= j >> BLOCK_SHIFT; k++)
+                    c += popcount(f[k] & p[k]);
+                local[std::min(c, nbins - 1)]++;
+            }
+        }
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+        for (uint64_t k = 0; k < nbins; k++)
+            histogram[k] += local[k];
+    }
+}
+
+// Count tiles of 64 x 64 pairs, skipping tiles without related pairs and
+// the tiles below the diagonal
+template <class Matrix>
+void intervalAbundance_v2(const Matrix &F, const Matrix &P, uint64_t i0,
+                          uint64_t i1, uint64_t *histogram, uint64_t nbins) {
+    countIntersectionTiles(F, i0, i1, P, 0, getNumRows(P), &F, true,
+                           (uint64_t *)NULL, histogram, nbins);
+}
+
+// This uses the fastest version
+template <class Matrix>
+void intervalAbundance(const Matrix &F, const Matrix &P, uint64_t i0,
+                       uint64_t i1, uint64_t *histogram, uint64_t nbins) {
+    intervalAbundance_v2(F, P, i0, i1, histogram, nbins);
+}
+
+} // namespace fastmath
+
+#endif
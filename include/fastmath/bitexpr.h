@@ -0,0 +1,441 @@
+/* Copyright 2014-2022 Will Cunningham
+ *
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#ifndef FASTMATH_BITEXPR_H
+#define FASTMATH_BITEXPR_H
+
+#include "fastbitset.h"
+
+/* Expression templates for FastBitset algebra.
+ *
+ * The operators &, |, ^, - (difference) and ~ (complement) applied to
+ * FastBitsets build a lazy expression instead of a new bitset, e.g.
+ *
+ *      FastBitset r = (a & b) | (c - d);
+ *      uint64_t k = (a ^ b).count_bits();
+ *
+ * Nothing is computed until the expression is assigned to a bitset,
+ * combined into one with &=, |=, ^= or -=, or reduced with count_bits()
+ * or any(). The whole expression is then evaluated in a single pass,
+ * reading one vector of blocks from each operand and writing one vector
+ * of the result, so no temporary bitsets are created and each operand
+ * is streamed through memory only once. The result may be one of the
+ * operands, since each vector is read before it is written.
+ *
+ * Instruction Sets:
+ * The tree is evaluated with the GCC vector types of the FastBitset
+ * kernels, in functions compiled for AVX-512 and AVX2 and chosen at
+ * runtime by getSimdLevel(), so the whole expression is inlined into a
+ * single loop.
+ *
+ * All operands must have the same size, which is not checked. An
+ * expression refers to its operands, so it must not outlive them. */
+
+namespace fastmath {
+
+//------------------//
+// Expression Nodes //
+//------------------//
+
+// Base of every expression, which provides the reductions
+// Each expression 'E' has the same size as its operands, and provides
+//   size(), getNumBlocks(): the size of the operands
+//   load(i, v): the blocks [i, i + sizeof(v) / sizeof(BlockType)) of the
+//               result, as a block or a vector of blocks
+template <class E> class BitExpression {
+  public:
+    inline const E &self() const { return static_cast<const E &>(*this); }
+
+    // Returns the number of set bits in the result
+    inline uint64_t count_bits() const;
+
+    // Returns true if any bit in the result is set
+    inline bool any() const;
+};
+
+// A FastBitset used as an operand
+class BitTerminal : public BitExpression<BitTerminal> {
+  public:
+    explicit BitTerminal(const FastBitset &fb)
+        : bits((const BlockType *)fb.getAddress()), n(fb.size()),
+          nb(fb.getNumBlocks()) {}
+
+    inline uint64_t size() const { return n; }
+    inline uint64_t getNumBlocks() const { return nb; }
+
+    template <class V> inline void load(uint64_t i, V &v) const {
+        memcpy(&v, bits + i, sizeof(V));
+    }
+
+  private:
+    const BlockType *bits;
+    uint64_t n;
+    uint64_t nb;
+};
+
+// The operations applied to each block or vector of blocks
+struct BitAnd {
+    template <class V>
+    static inline void apply(const V &a, const V &b, V &v) {
+        v = a & b;
+    }
+};
+
+struct BitOr {
+    template <class V>
+    static inline void apply(const V &a, const V &b, V &v) {
+        v = a | b;
+    }
+};
+
+struct BitXor {
+    template <class V>
+    static inline void apply(const V &a, const V &b, V &v) {
+        v = a ^ b;
+    }
+};
+
+struct BitDifference {
+    template <class V>
+    static inline void apply(const V &a, const V &b, V &v) {
+        v = a & ~b;
+    }
+};
+
+template <class L, class R, class Op>
+class BitBinary : public BitExpression<BitBinary<L, R, Op> > {
+  public:
+    BitBinary(const L &_left, const R &_right)
+        : left(_left), right(_right) {}
+
+    inline uint64_t size() const { return left.size(); }
+    inline uint64_t getNumBlocks() const { return left.getNumBlocks(); }
+
+    template <class V> inline void load(uint64_t i, V &v) const {
+        V a, b;
+        left.load(i, a);
+        right.load(i, b);
+        Op::apply(a, b, v);
+    }
+
+  private:
+    L left;
+    R right;
+};
+
+// The padding of a complement is set, so it is masked by each sink
+template <class E> class BitNot : public BitExpression<BitNot<E> > {
+  public:
+    explicit BitNot(const E &_expr) : expr(_expr) {}
+
+    inline uint64_t size() const { return expr.size(); }
+    inline uint64_t getNumBlocks() const { return expr.getNumBlocks(); }
+
+    template <class V> inline void load(uint64_t i, V &v) const {
+        V a;
+        expr.load(i, a);
+        v = ~a;
+    }
+
+  private:
+    E expr;
+};
+
+//-----------//
+// Operators //
+//-----------//
+
+#define FASTMATH_BIT_OPERATOR(op, Op)                                          \
+    inline BitBinary<BitTerminal, BitTerminal, Op> operator op(                \
+        const FastBitset &a, const FastBitset &b) {                            \
+        return BitBinary<BitTerminal, BitTerminal, Op>(BitTerminal(a),         \
+                                                       BitTerminal(b));        \
+    }                                                                          \
+    template <class R>                                                         \
+    inline BitBinary<BitTerminal, R, Op> operator op(                          \
+        const FastBitset &a, const BitExpression<R> &b) {                      \
+        return BitBinary<BitTerminal, R, Op>(BitTerminal(a), b.self());        \
+    }                                                                          \
+    template <class L>                                                         \
+    inline BitBinary<L, BitTerminal, Op> operator op(                          \
+        const BitExpression<L> &a, const FastBitset &b) {                      \
+        return BitBinary<L, BitTerminal, Op>(a.self(), BitTerminal(b));        \
+    }                                                                          \
+    template <class L, class R>                                                \
+    inline BitBinary<L, R, Op> operator op(const BitExpression<L> &a,          \
+                                           const BitExpression<R> &b) {        \
+        return BitBinary<L, R, Op>(a.self(), b.self());                        \
+    }
+
+FASTMATH_BIT_OPERATOR(&, BitAnd)
+FASTMATH_BIT_OPERATOR(|, BitOr)
+FASTMATH_BIT_OPERATOR(^, BitXor)
+FASTMATH_BIT_OPERATOR(-, BitDifference)
+
+#undef FASTMATH_BIT_OPERATOR
+
+inline BitNot<BitTerminal> operator~(const FastBitset &a) {
+    return BitNot<BitTerminal>(BitTerminal(a));
+}
+
+template <class E> inline BitNot<E> operator~(const BitExpression<E> &a) {
+    return BitNot<E>(a.self());
+}
+
+//---------//
+// Kernels //
+//---------//
+
+// Each kernel handles the blocks [0, m) with vectors of type V, where 'm'
+// is a multiple of the vector length, and the blocks [m, nb) are handled
+// one at a time by the caller so that the padding may be masked
+
+template <class V, class E>
+inline void evaluate_blocks(const E &e, BlockType *dst, uint64_t m) {
+    const uint64_t w = sizeof(V) / sizeof(BlockType);
+    for (uint64_t i = 0; i < m; i += w) {
+        V v;
+        e.load(i, v);
+        memcpy(dst + i, &v, sizeof(V));
+    }
+}
+
+template <class V, class E>
+inline uint64_t count_blocks(const E &e, uint64_t m) {
+    const uint64_t w = sizeof(V) / sizeof(BlockType);
+    uint64_t num_set = 0;
+    for (uint64_t i = 0; i < m; i += w) {
+        V v;
+        e.load(i, v);
+        BlockType b[sizeof(V) / sizeof(BlockType)];
+        memcpy(b, &v, sizeof(V));
+        for (uint64_t k = 0; k < w; k++)
+            num_set += popcount(b[k]);
+    }
+    return num_set;
+}
+
+template <class V, class E> inline bool any_blocks(const E &e, uint64_t m) {
+    const uint64_t w = sizeof(V) / sizeof(BlockType);
+    for (uint64_t i = 0; i < m; i += w) {
+        V v;
+        e.load(i, v);
+        BlockType b[sizeof(V) / sizeof(BlockType)];
+        memcpy(b, &v, sizeof(V));
+        BlockType any_set = 0;
+        for (uint64_t k = 0; k < w; k++)
+            any_set |= b[k];
+        if (any_set)
+            return true;
+    }
+    return false;
+}
+
+// The same kernels compiled for each instruction set
+// The expression is inlined into these, so it uses the same instructions
+
+#if FBALIGN == 512
+template <class E>
+__attribute__((target("avx512f,popcnt"))) void
+evaluate_avx512(const E &e, BlockType *dst, uint64_t m) {
+    evaluate_blocks<BlockVector512>(e, dst, m);
+}
+
+template <class E>
+__attribute__((target("avx512f,popcnt"))) uint64_t
+count_avx512(const E &e, uint64_t m) {
+    return count_blocks<BlockVector512>(e, m);
+}
+
+template <class E>
+__attribute__((target("avx512f,popcnt"))) bool any_avx512(const E &e,
+                                                          uint64_t m) {
+    return any_blocks<BlockVector512>(e, m);
+}
+#endif
+
+#if FBALIGN >= 256
+template <class E>
+__attribute__((target("avx2,popcnt"))) void
+evaluate_avx2(const E &e, BlockType *dst, uint64_t m) {
+    evaluate_blocks<BlockVector256>(e, dst, m);
+}
+
+template <class E>
+__attribute__((target("avx2,popcnt"))) uint64_t count_avx2(const E &e,
+                                                          uint64_t m) {
+    return count_blocks<BlockVector256>(e, m);
+}
+
+template <class E>
+__attribute__((target("avx2,popcnt"))) bool any_avx2(const E &e,
+                                                    uint64_t m) {
+    return any_blocks<BlockVector256>(e, m);
+}
+#endif
+
+// Each dispatcher uses the fastest kernel for the blocks [0, m)
+
+template <class E>
+inline void evaluate_vectors(const E &e, BlockType *dst, uint64_t m) {
+#if FBALIGN == 512
+    if (getSimdLevel() >= SIMD_AVX512) {
+        evaluate_avx512(e, dst, m);
+        return;
+    }
+#endif
+#if FBALIGN >= 256
+    if (getSimdLevel() >= SIMD_AVX2) {
+        evaluate_avx2(e, dst, m);
+        return;
+    }
+#endif
+    evaluate_blocks<BlockType>(e, dst, m);
+}
+
+template <class E> inline uint64_t count_vectors(const E &e, uint64_t m) {
+#if FBALIGN == 512
+    if (getSimdLevel() >= SIMD_AVX512)
+        return count_avx512(e, m);
+#endif
+#if FBALIGN >= 256
+    if (getSimdLevel() >= SIMD_AVX2)
+        return count_avx2(e, m);
+#endif
+    return count_blocks<BlockType>(e, m);
+}
+
+template <class E> inline bool any_vectors(const E &e, uint64_t m) {
+#if FBALIGN == 512
+    if (getSimdLevel() >= SIMD_AVX512)
+        return any_avx512(e, m);
+#endif
+#if FBALIGN >= 256
+    if (getSimdLevel() >= SIMD_AVX2)
+        return any_avx2(e, m);
+#endif
+    return any_blocks<BlockType>(e, m);
+}
+
+// Returns the number of blocks handled by the vector kernels for an
+// expression of 'n' bits: every block below it is entirely inside the
+// bitset, and it is a multiple of every vector length
+inline uint64_t vector_blocks(uint64_t n) {
+    return (n >> BLOCK_SHIFT) & ~(uint64_t)(FBALIGN / 64 - 1);
+}
+
+// Returns the mask of the bits of block 'i' inside a bitset of 'n' bits
+inline BlockType valid_bits(uint64_t i, uint64_t n) {
+    uint64_t full = n >> BLOCK_SHIFT;
+    if (i < full)
+        return (BlockType)-1;
+    if (i > full || !(n & (FastBitset::bits_per_block - 1)))
+        return 0;
+    return ((BlockType)1 << (n & (FastBitset::bits_per_block - 1))) - 1;
+}
+
+//-------//
+// Sinks //
+//-------//
+
+// Write the result of 'e' to 'dst', which has the same number of blocks
+template <class E> inline void evaluate(const E &e, BlockType *dst) {
+    uint64_t n = e.size(), nb = e.getNumBlocks();
+    uint64_t m = vector_blocks(n);
+    evaluate_vectors(e, dst, m);
+    for (uint64_t i = m; i < nb; i++) {
+        BlockType b;
+        e.load(i, b);
+        dst[i] = b & valid_bits(i, n);
+    }
+}
+
+template <class E> inline uint64_t BitExpression<E>::count_bits() const {
+    const E &e = self();
+    uint64_t n = e.size(), nb = e.getNumBlocks();
+    uint64_t m = vector_blocks(n);
+    uint64_t num_set = count_vectors(e, m);
+    for (uint64_t i = m; i < nb; i++) {
+        BlockType b;
+        e.load(i, b);
+        num_set += popcount(b & valid_bits(i, n));
+    }
+    return num_set;
+}
+
+template <class E> inline bool BitExpression<E>::any() const {
+    const E &e = self();
+    uint64_t n = e.size(), nb = e.getNumBlocks();
+    uint64_t m = vector_blocks(n);
+    if (any_vectors(e, m))
+        return true;
+    for (uint64_t i = m; i < nb; i++) {
+        BlockType b;
+        e.load(i, b);
+        if (b & valid_bits(i, n))
+            return true;
+    }
+    return false;
+}
+
+//-------------//
+// Assignments //
+//-------------//
+
+// A bitset which owns its bits is resized to the expression first
+template <class E>
+FastBitset::FastBitset(const BitExpression<E> &expr)
+    : bits(NULL), n(0), nb(0), nr(0), cap(0), owner(true) {
+    createBitset(expr.self().size());
+    evaluate(expr.self(), bits);
+}
+
+template <class E>
+FastBitset &FastBitset::operator=(const BitExpression<E> &expr) {
+    if (owner && n != expr.self().size())
+        resize(expr.self().size());
+    evaluate(expr.self(), bits);
+    return *this;
+}
+
+template <class E>
+FastBitset &FastBitset::operator&=(const BitExpression<E> &expr) {
+    evaluate(*this & expr, bits);
+    return *this;
+}
+
+template <class E>
+FastBitset &FastBitset::operator|=(const BitExpression<E> &expr) {
+    evaluate(*this | expr, bits);
+    return *this;
+}
+
+template <class E>
+FastBitset &FastBitset::operator^=(const BitExpression<E> &expr) {
+    evaluate(*this ^ expr, bits);
+    return *this;
+}
+
+template <class E>
+FastBitset &FastBitset::operator-=(const BitExpression<E> &expr) {
+    evaluate(*this - expr, bits);
+    return *this;
+}
+
+} // namespace fastmath
+
+#endif
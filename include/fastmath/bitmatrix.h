@@ -0,0 +1,507 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+
+
+#ifndef FASTMATH_BITMATRIX_H
+#define FASTMATH_BITMATRIX_H
+
+#include "fastbitset.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The BitMatrix class holds an R x C binary matrix in a single
+ * contiguous, aligned slab of memory. Each row is a FastBitset with
+ * C bits, padded to a fixed stride, so that row-wise operations
+ * stream linearly through memory. It is intended to replace the
+ * Bitvector (a std::vector of FastBitset objects) for large matrices,
+ * where each row would otherwise be a separate allocation.
+ *
+ * Rows are accessed using views: the FastBitsetView returned by row()
+ * or operator[] refers to the memory inside the matrix, so every
+ * FastBitset operation may be used on it directly. A view must not
+ * outlive the matrix it came from. Constructing a FastBitset from a
+ * view produces an independent copy, while assigning to a view copies
+ * the bits into the matrix. The rows of a const matrix are returned as
+ * a ConstFastBitsetView, which may only be read.
+ *
+ * Layout:
+ * Each row uses the same number of blocks as a FastBitset of C bits,
+ * so rows keep the FBALIGN padding. Rows of at least one cache line
+ * are further padded to a whole number of cache lines, and the slab
+ * itself is cache-line aligned.
+ *
+ * File Format:
+ * save() writes a header of one page (4096 bytes) followed by the slab
+ * exactly as it is laid out in memory, so that map() can use the file
+ * with mmap() in place of an allocation. Rows are read from disk only
+ * when they are first touched, so analyses of very large matrices start
+ * at once. The header holds the magic string "FMBITMAT", the format
+ * version, FBALIGN, and the rows, columns, blocks per row and stride,
+ * all as little-endian 64-bit integers. A file may only be mapped by a
+ * build with the same FBALIGN, which fixes the row padding. */
+
+namespace fastmath {
+
+class BitMatrix {
+  public:
+    //----------------------------//
+    // Constructors, Destructors, //
+    // and Other Class Utilities  //
+    //----------------------------//
+
+    // Default Constructor
+    BitMatrix()
+        : slab(NULL), nrows(0), ncols(0), nb(0), stride(0), mapping(NULL),
+          mapped_bytes(0) {}
+
+    // Creation Constructor
+    BitMatrix(uint64_t _nrows, uint64_t _ncols)
+        : slab(NULL), mapping(NULL), mapped_bytes(0) {
+        createMatrix(_nrows, _ncols);
+    }
+
+    // Copy Constructor
+    // A copy of a mapped matrix is held in memory
+    BitMatrix(const BitMatrix &other)
+        : slab(NULL), mapping(NULL), mapped_bytes(0) {
+        createMatrix(other.nrows, other.ncols);
+        if (slab != NULL && other.slab != NULL)
+            memcpy(slab, other.slab, bytes());
+    }
+
+    // Conversion Constructor
+    // All rows in 'bv' are expected to have the same size
+    explicit BitMatrix(const Bitvector &bv)
+        : slab(NULL), mapping(NULL), mapped_bytes(0) {
+        createMatrix(bv.size(), bv.size() ? bv[0].size() : 0);
+        for (uint64_t i = 0; i < nrows; i++)
+            memcpy(getRowAddress(i), bv[i].getAddress(),
+                   sizeof(BlockType) * std::min(nb, bv[i].getNumBlocks()));
+    }
+
+    // Destructor
+    ~BitMatrix() { destroyMatrix(); }
+
+    // Overloaded Assignment Operator
+    BitMatrix &operator=(const BitMatrix &other) {
+        if (__builtin_expect(this != &other, 1L)) {
+            destroyMatrix();
+            createMatrix(other.nrows, other.ncols);
+            if (slab != NULL && other.slab != NULL)
+                memcpy(slab, other.slab, bytes());
+        }
+        return *this;
+    }
+
+    // Move Constructor
+    // The slab (or mapping) is taken from 'other', which is left empty
+    BitMatrix(BitMatrix &&other) noexcept
+        : slab(NULL), nrows(0), ncols(0), nb(0), stride(0), mapping(NULL),
+          mapped_bytes(0) {
+        swap(other);
+    }
+
+    // Move Assignment Operator
+    BitMatrix &operator=(BitMatrix &&other) noexcept {
+        if (__builtin_expect(this != &other, 1L)) {
+            destroyMatrix();
+            swap(other);
+        }
+        return *this;
+    }
+
+    // Exchange the contents of two matrices in constant time
+    inline void swap(BitMatrix &other) {
+        std::swap(slab, other.slab);
+        std::swap(nrows, other.nrows);
+        std::swap(ncols, other.ncols);
+        std::swap(nb, other.nb);
+        std::swap(stride, other.stride);
+        std::swap(mapping, other.mapping);
+        std::swap(mapped_bytes, other.mapped_bytes);
+    }
+
+    // Copy the rows into a Bitvector
+    Bitvector toBitvector() const {
+        Bitvector bv(nrows, FastBitset(ncols));
+        for (uint64_t i = 0; i < nrows; i++)
+            memcpy(bv[i].getAddress(), getRowAddress(i),
+                   sizeof(BlockType) * nb);
+        return bv;
+    }
+
+    //-------------------//
+    // Matrix Properties //
+    //-------------------//
+
+    // Returns the number of rows
+    inline uint64_t getNumRows() const { return nrows; }
+
+    // Returns the number of bits in each row
+    inline uint64_t getNumCols() const { return ncols; }
+
+    // Returns the number of blocks used to represent each row
+    inline uint64_t getNumBlocks() const { return nb; }
+
+    // Returns the distance, in blocks, between consecutive rows
+    inline uint64_t getStride() const { return stride; }
+
+    // Returns the size of the slab in bytes
+    inline size_t bytes() const { return sizeof(BlockType) * nrows * stride; }
+
+    // Return address of the slab (needed for MPI and I/O)
+    inline void *getAddress() { return (void *)slab; }
+    inline const void *getAddress() const { return (const void *)slab; }
+
+    // Return address of the first block in row 'i'
+    inline BlockType *getRowAddress(uint64_t i) { return slab + i * stride; }
+    inline const BlockType *getRowAddress(uint64_t i) const {
+        return slab + i * stride;
+    }
+
+    // Return true if the slab is a file mapped by map()
+    inline bool isMapped() const { return mapping != NULL; }
+
+    //------------//
+    // Row Access //
+    //------------//
+
+    // Returns a view of row 'i'
+    inline FastBitsetView row(uint64_t i) {
+        return FastBitsetView(slab + i * stride, ncols, nb);
+    }
+
+    // Returns a read-only view of row 'i'
+    inline ConstFastBitsetView row(uint64_t i) const {
+        return ConstFastBitsetView(slab + i * stride, ncols, nb);
+    }
+
+    inline FastBitsetView operator[](uint64_t i) { return row(i); }
+
+    inline ConstFastBitsetView operator[](uint64_t i) const {
+        return row(i);
+    }
+
+    // Returns a view of the blocks [offset, offset + length) in row 'i'
+    // NOTE: The offset and length refer to blocks, not bits!
+    // Keep 'length' a multiple of FBALIGN bits to use the SIMD methods
+    inline FastBitsetView segment(uint64_t i, uint64_t offset,
+                                  uint64_t length) {
+        return FastBitsetView(slab + i * stride + offset,
+                              length * FastBitset::bits_per_block, length);
+    }
+
+    inline ConstFastBitsetView segment(uint64_t i, uint64_t offset,
+                                       uint64_t length) const {
+        return ConstFastBitsetView(slab + i * stride + offset,
+                                   length * FastBitset::bits_per_block,
+                                   length);
+    }
+
+    // Bring row 'i' into the cache ahead of its use
+    inline void prefetch(uint64_t i) const {
+        const char *p = (const char *)getRowAddress(i);
+        for (uint64_t j = 0; j < sizeof(BlockType) * nb; j += cache_line)
+            __builtin_prefetch(p + j);
+    }
+
+    //---------------------//
+    // Reading and Writing //
+    //---------------------//
+
+    // Set the bit at row 'i', column 'j' to 1
+    // NOTE: This operation is not thread-safe; see atomic_set()
+    inline void set(uint64_t i, uint64_t j) {
+        slab[i * stride + (j >> BLOCK_SHIFT)] |=
+            (BlockType)1 << (j & (FastBitset::bits_per_block - 1));
+    }
+
+    // Set the bit at row 'i', column 'j' to 0
+    // NOTE: This operation is not thread-safe; see atomic_unset()
+    inline void unset(uint64_t i, uint64_t j) {
+        slab[i * stride + (j >> BLOCK_SHIFT)] &=
+            ~((BlockType)1 << (j & (FastBitset::bits_per_block - 1)));
+    }
+
+    // Read the bit at row 'i', column 'j'
+    inline BlockType read(uint64_t i, uint64_t j) const {
+        return (slab[i * stride + (j >> BLOCK_SHIFT)] >>
+                (j & (FastBitset::bits_per_block - 1))) &
+               (BlockType)1;
+    }
+
+    // Read block 'j' of row 'i'
+    // Iterate over a column of blocks by stepping 'i'
+    inline BlockType readBlock(uint64_t i, uint64_t j) const {
+        return slab[i * stride + j];
+    }
+
+    // Write to block 'j' of row 'i'
+    inline void writeBlock(const BlockType val, uint64_t i, uint64_t j) {
+        slab[i * stride + j] = val;
+    }
+
+    // Reset all bits to zero
+    inline void reset() {
+        if (slab != NULL)
+            memset(slab, 0, bytes());
+    }
+
+    //-------------------//
+    // Atomic Operations //
+    //-------------------//
+
+    // These may be called by several threads at once, with the same
+    // guarantees as FastBitset::atomic_set()
+
+    // Set the bit at row 'i', column 'j' to 1
+    inline void atomic_set(uint64_t i, uint64_t j) {
+        __atomic_fetch_or(slab + i * stride + (j >> BLOCK_SHIFT),
+                          (BlockType)1
+                              << (j & (FastBitset::bits_per_block - 1)),
+                          __ATOMIC_RELAXED);
+    }
+
+    // Set the bit at row 'i', column 'j' to 0
+    inline void atomic_unset(uint64_t i, uint64_t j) {
+        __atomic_fetch_and(slab + i * stride + (j >> BLOCK_SHIFT),
+                           ~((BlockType)1
+                             << (j & (FastBitset::bits_per_block - 1))),
+                           __ATOMIC_RELAXED);
+    }
+
+    // Set the bit at row 'i', column 'j' to 1 and return its previous value
+    inline BlockType test_and_set(uint64_t i, uint64_t j) {
+        BlockType mask = (BlockType)1
+                         << (j & (FastBitset::bits_per_block - 1));
+        return !!(__atomic_fetch_or(slab + i * stride + (j >> BLOCK_SHIFT),
+                                    mask, __ATOMIC_RELAXED) &
+                  mask);
+    }
+
+    // Union 'val' into block 'j' of row 'i', and return the previous value
+    // of the block
+    inline BlockType fetch_or_block(const BlockType val, uint64_t i,
+                                    uint64_t j) {
+        return __atomic_fetch_or(slab + i * stride + j, val,
+                                 __ATOMIC_RELAXED);
+    }
+
+    //--------------//
+    // File Storage //
+    //--------------//
+
+    // Write the matrix to 'filename' in the format used by map()
+    // Returns false if the file could not be written
+    bool save(const char *filename) const {
+        uint64_t header[header_bytes / sizeof(uint64_t)];
+        memset(header, 0, header_bytes);
+        header[0] = file_magic;
+        header[1] = file_version;
+        header[2] = FBALIGN;
+        header[3] = nrows;
+        header[4] = ncols;
+        header[5] = nb;
+        header[6] = stride;
+
+        FILE *f = fopen(filename, "wb");
+        if (f == NULL) {
+            fprintf(stderr, "Could not open %s for writing!\n", filename);
+            fflush(stderr);
+            return false;
+        }
+        bool written = fwrite(header, 1, header_bytes, f) == header_bytes &&
+                       fwrite(slab, 1, bytes(), f) == bytes();
+        written &= !fclose(f);
+        if (!written) {
+            fprintf(stderr, "Could not write %s!\n", filename);
+            fflush(stderr);
+        }
+        return written;
+    }
+
+    // Replace the matrix with the one stored in 'filename' by save(),
+    // using the file itself as the slab
+    // The options are a combination of:
+    //   map_writable:   changes to the matrix are written to the file;
+    //                   otherwise it must only be read, as any change
+    //                   to a read-only mapping is a segmentation fault
+    //   map_populate:   read the whole file now rather than on demand
+    //   map_sequential: rows will be read in order, so read ahead
+    //   map_random:     rows will be read in no particular order, so
+    //                   read only the pages which are touched
+    // Returns false, leaving the matrix empty, if the file could not be
+    // mapped or was not written with the same FBALIGN
+    bool map(const char *filename, const unsigned int options = 0) {
+        destroyMatrix();
+
+        bool writable = options & map_writable;
+        int fd = open(filename, writable ? O_RDWR : O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "Could not open %s!\n", filename);
+            fflush(stderr);
+            return false;
+        }
+
+        uint64_t header[header_bytes / sizeof(uint64_t)];
+        struct stat st;
+        bool valid = !fstat(fd, &st) &&
+                     pread(fd, header, header_bytes, 0) ==
+                         (ssize_t)header_bytes &&
+                     header[0] == file_magic &&
+                     header[1] == file_version && header[2] == FBALIGN &&
+                     header[5] == FastBitset::get_num_blocks(header[4]) &&
+                     header[6] >= header[5] &&
+                     (uint64_t)st.st_size >=
+                         header_bytes + sizeof(BlockType) * header[3] *
+                                            header[6];
+        if (!valid) {
+            fprintf(stderr, "%s is not a BitMatrix file for FBALIGN=%d!\n",
+                    filename, FBALIGN);
+            fflush(stderr);
+            close(fd);
+            return false;
+        }
+
+        size_t length =
+            header_bytes + sizeof(BlockType) * header[3] * header[6];
+        int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+        if (options & map_populate)
+            flags |= MAP_POPULATE;
+#endif
+        void *addr = mmap(NULL, length,
+                          writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                          flags, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            fprintf(stderr, "Could not map %s!\n", filename);
+            fflush(stderr);
+            return false;
+        }
+
+        if (options & map_sequential)
+            madvise(addr, length, MADV_SEQUENTIAL);
+        else if (options & map_random)
+            madvise(addr, length, MADV_RANDOM);
+
+        mapping = addr;
+        mapped_bytes = length;
+        slab = (BlockType *)((char *)addr + header_bytes);
+        nrows = header[3];
+        ncols = header[4];
+        nb = header[5];
+        stride = header[6];
+        return true;
+    }
+
+    // Ask the kernel to read rows [first, first + count) of a mapped
+    // matrix from disk ahead of their use
+    inline void willNeed(uint64_t first, uint64_t count) const {
+        if (mapping == NULL || !count)
+            return;
+        uintptr_t page = sysconf(_SC_PAGESIZE);
+        uintptr_t begin = (uintptr_t)getRowAddress(first) & ~(page - 1);
+        uintptr_t end = (uintptr_t)(getRowAddress(first + count - 1) + nb);
+        madvise((void *)begin, end - begin, MADV_WILLNEED);
+    }
+
+    // Write changes to a writable mapping back to the file now, rather
+    // than when the pages are evicted or the matrix is destroyed
+    inline bool sync() const {
+        return mapping == NULL || !msync(mapping, mapped_bytes, MS_SYNC);
+    }
+
+    static const size_t cache_line = 64;
+
+    // Options for map()
+    static const unsigned int map_writable = 1;
+    static const unsigned int map_populate = 2;
+    static const unsigned int map_sequential = 4;
+    static const unsigned int map_random = 8;
+
+  private:
+    inline void createMatrix(uint64_t _nrows, uint64_t _ncols) {
+        try {
+            nrows = _nrows;
+            ncols = _ncols;
+            nb = FastBitset::get_num_blocks(_ncols);
+
+            // Pad rows to whole cache lines, unless they are shorter
+            // than a cache line, in which case the FBALIGN padding is kept
+            const uint64_t line_blocks = cache_line / sizeof(BlockType);
+            stride = nb < line_blocks
+                         ? nb
+                         : (nb + line_blocks - 1) / line_blocks * line_blocks;
+
+            slab = NULL;
+            if (posix_memalign((void **)&slab, cache_line, bytes()))
+                throw std::bad_alloc();
+            memset(slab, 0, bytes());
+        } catch (std::bad_alloc &) {
+            fprintf(stderr, "Memory allocation failure in %s on line %d!\n",
+                    __FILE__, __LINE__);
+            fflush(stderr);
+            destroyMatrix();
+        }
+    }
+
+    inline void destroyMatrix() {
+        nrows = 0;
+        ncols = 0;
+        nb = 0;
+        stride = 0;
+        if (mapping != NULL) {
+            munmap(mapping, mapped_bytes);
+            mapping = NULL;
+            mapped_bytes = 0;
+            slab = NULL;
+        } else if (slab != NULL) {
+            free(slab);
+            slab = NULL;
+        }
+    }
+
+    // The header fills one page, so that the slab of a mapped file is
+    // aligned to a page
+    static const size_t header_bytes = 4096;
+    static const uint64_t file_version = 1;
+    static const uint64_t file_magic = 0x54414d5449424d46llu; // "FMBITMAT"
+
+    BlockType *slab;     // Storage for all rows
+    uint64_t nrows;      // Number of rows
+    uint64_t ncols;      // Number of bits in each row (not including padding)
+    uint64_t nb;         // Number of blocks in each row
+    uint64_t stride;     // Number of blocks between the starts of two rows
+    void *mapping;       // Start of the mapped file, or NULL if allocated
+    size_t mapped_bytes; // Length of the mapped file
+};
+
+inline void swap(BitMatrix &a, BitMatrix &b) { a.swap(b); }
+
+inline ConcurrentBuilder::ConcurrentBuilder(BitMatrix &m)
+    : bits((BlockType *)m.getAddress()), stride(m.getStride()), block(0),
+      pending(0) {}
+
+} // namespace fastmath
+
+#endif
@@ -20,33 +20,50 @@
 #define FASTMATH_FASTBITSET_H
 
 #define __STDC_FORMAT_MACROS
-#include <boost/functional/hash/hash.hpp>
+#include <algorithm>
+#include <functional>
+#include <immintrin.h>
 #include <inttypes.h>
-#ifdef AVX2_ENABLED
-#include <x86intrin.h>
+#include <limits.h>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
 #endif
 
 #ifndef FBALIGN
 #include "config.h"
 #endif
 
-#if !(FBALIGN == 64 | FBALIGN == 256 | FBALIGN == 512)
-#error "Invalid alignment."
+// Padding to 512 bits allows every kernel to be used
+#ifndef FBALIGN
+#define FBALIGN 512
 #endif
 
-#ifdef AVX2_ENABLED
-#if FBALIGN == 64
+#if !(FBALIGN == 64 | FBALIGN == 256 | FBALIGN == 512)
 #error "Invalid alignment."
 #endif
-#endif
 
 /* The FastBitset class offers highly efficient bitset data
  * structures and algorithms. The class holds an N-bit bitset which
- * is either 64-bit aligned, or 256-bit aligned if AVX2 is supported.
- * Many algorithms here have been optimized via assembly. See the
- * paper 'Causal Set Generator' by W. Cunningham and D. Kriouikov for
+ * is padded to a multiple of FBALIGN bits (64, 256, or 512). Many
+ * algorithms here have been optimized via assembly. See the paper
+ * 'Causal Set Generator' by W. Cunningham and D. Kriouikov for
  * details.
  *
+ * Instruction Sets:
+ * The SIMD version of each algorithm is chosen at runtime, the first
+ * time a bitset is used, from the instruction sets supported by the
+ * CPU (see getSimdLevel below). The AVX2 kernels require FBALIGN to be
+ * at least 256 and the AVX-512 kernels require FBALIGN to be 512, so
+ * a build with FBALIGN=512 runs at full speed on any x86-64 machine.
+ * The environment variable FASTMATH_SIMD may be set to 'scalar',
+ * 'avx2', or 'avx512' to force a lower level, e.g. for benchmarks.
+ *
  * Error Handling:
  * There is no error checking here, so it is likely any mistake using
  * this will result in a segmentation fault. This is intentional in
@@ -89,20 +106,210 @@ const unsigned char count_table<b>::table[] = {
     4, 5, 5, 6, 5, 6, 6, 7, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
     4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8};
 
-#ifdef AVX512_ENABLED
 const unsigned long avx512_table[] = {
     0x0302020102010100llu, 0x0403030203020201llu, 0x0302020102010100llu,
     0x0403030203020201llu, 0x0302020102010100llu, 0x0403030203020201llu,
     0x0302020102010100llu, 0x0403030203020201llu};
+
+// Offsets of the eight 64-bit lanes, used by extract_block_avx512()
+const unsigned long lane_table[] = {0, 1, 2, 3, 4, 5, 6, 7};
+
+// The AVX-512 mask registers can only be listed as clobbers when the
+// compiler targets AVX-512 itself; otherwise it never uses them
+#ifdef __AVX512F__
+#define FASTBITSET_K1_CLOBBER , "%k1"
+#else
+#define FASTBITSET_K1_CLOBBER
 #endif
 
-#ifdef AVX2_ENABLED
 const unsigned char avx_table[] = {
     0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2,
     2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3,
     2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+
+// Masks used for partial-bitset functions
+// These are shared by all instances, so they are not stored in each object
+// mask_table[i] has the lowest 'i' bits set, and mask_table2[i] is its
+// complement; index zero selects the entire block in both tables
+const BlockType mask_table[] = {
+    0xffffffffffffffffllu, 0x0000000000000001llu, 0x0000000000000003llu,
+    0x0000000000000007llu, 0x000000000000000fllu, 0x000000000000001fllu,
+    0x000000000000003fllu, 0x000000000000007fllu, 0x00000000000000ffllu,
+    0x00000000000001ffllu, 0x00000000000003ffllu, 0x00000000000007ffllu,
+    0x0000000000000fffllu, 0x0000000000001fffllu, 0x0000000000003fffllu,
+    0x0000000000007fffllu, 0x000000000000ffffllu, 0x000000000001ffffllu,
+    0x000000000003ffffllu, 0x000000000007ffffllu, 0x00000000000fffffllu,
+    0x00000000001fffffllu, 0x00000000003fffffllu, 0x00000000007fffffllu,
+    0x0000000000ffffffllu, 0x0000000001ffffffllu, 0x0000000003ffffffllu,
+    0x0000000007ffffffllu, 0x000000000fffffffllu, 0x000000001fffffffllu,
+    0x000000003fffffffllu, 0x000000007fffffffllu, 0x00000000ffffffffllu,
+    0x00000001ffffffffllu, 0x00000003ffffffffllu, 0x00000007ffffffffllu,
+    0x0000000fffffffffllu, 0x0000001fffffffffllu, 0x0000003fffffffffllu,
+    0x0000007fffffffffllu, 0x000000ffffffffffllu, 0x000001ffffffffffllu,
+    0x000003ffffffffffllu, 0x000007ffffffffffllu, 0x00000fffffffffffllu,
+    0x00001fffffffffffllu, 0x00003fffffffffffllu, 0x00007fffffffffffllu,
+    0x0000ffffffffffffllu, 0x0001ffffffffffffllu, 0x0003ffffffffffffllu,
+    0x0007ffffffffffffllu, 0x000fffffffffffffllu, 0x001fffffffffffffllu,
+    0x003fffffffffffffllu, 0x007fffffffffffffllu, 0x00ffffffffffffffllu,
+    0x01ffffffffffffffllu, 0x03ffffffffffffffllu, 0x07ffffffffffffffllu,
+    0x0fffffffffffffffllu, 0x1fffffffffffffffllu, 0x3fffffffffffffffllu,
+    0x7fffffffffffffffllu};
+
+const BlockType mask_table2[] = {
+    0xffffffffffffffffllu, 0xfffffffffffffffellu, 0xfffffffffffffffcllu,
+    0xfffffffffffffff8llu, 0xfffffffffffffff0llu, 0xffffffffffffffe0llu,
+    0xffffffffffffffc0llu, 0xffffffffffffff80llu, 0xffffffffffffff00llu,
+    0xfffffffffffffe00llu, 0xfffffffffffffc00llu, 0xfffffffffffff800llu,
+    0xfffffffffffff000llu, 0xffffffffffffe000llu, 0xffffffffffffc000llu,
+    0xffffffffffff8000llu, 0xffffffffffff0000llu, 0xfffffffffffe0000llu,
+    0xfffffffffffc0000llu, 0xfffffffffff80000llu, 0xfffffffffff00000llu,
+    0xffffffffffe00000llu, 0xffffffffffc00000llu, 0xffffffffff800000llu,
+    0xffffffffff000000llu, 0xfffffffffe000000llu, 0xfffffffffc000000llu,
+    0xfffffffff8000000llu, 0xfffffffff0000000llu, 0xffffffffe0000000llu,
+    0xffffffffc0000000llu, 0xffffffff80000000llu, 0xffffffff00000000llu,
+    0xfffffffe00000000llu, 0xfffffffc00000000llu, 0xfffffff800000000llu,
+    0xfffffff000000000llu, 0xffffffe000000000llu, 0xffffffc000000000llu,
+    0xffffff8000000000llu, 0xffffff0000000000llu, 0xfffffe0000000000llu,
+    0xfffffc0000000000llu, 0xfffff80000000000llu, 0xfffff00000000000llu,
+    0xffffe00000000000llu, 0xffffc00000000000llu, 0xffff800000000000llu,
+    0xffff000000000000llu, 0xfffe000000000000llu, 0xfffc000000000000llu,
+    0xfff8000000000000llu, 0xfff0000000000000llu, 0xffe0000000000000llu,
+    0xffc0000000000000llu, 0xff80000000000000llu, 0xff00000000000000llu,
+    0xfe00000000000000llu, 0xfc00000000000000llu, 0xf800000000000000llu,
+    0xf000000000000000llu, 0xe000000000000000llu, 0xc000000000000000llu,
+    0x8000000000000000llu};
+
+// Keys used by FastBitset::hash()
+// Block k is hashed with the key hash_keys[k % 8] + (k / 8) * hash_step
+const BlockType hash_keys[] = {
+    0xbe4ba423396cfeb8llu, 0x1cad21f72c81017cllu, 0xdb979083e96dd4dellu,
+    0x1f67b3b7a4a44072llu, 0x78e5c0cc4ee679cbllu, 0x2172ffcc7dd05a82llu,
+    0x8e2443f7744608b8llu, 0x4c263a81e69035e0llu};
+const BlockType hash_step = 0x9e3779b97f4a7c15llu;
+
+// Instruction sets used by the FastBitset kernels, in increasing order
+// SIMD_AVX512_VPOPCNT adds the vpopcntq instruction (Ice Lake and later)
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_AVX2 = 1,
+    SIMD_AVX512 = 2,
+    SIMD_AVX512_VPOPCNT = 3
+};
+
+// Returns the highest instruction set supported by both the CPU and FBALIGN
+inline SimdLevel getSimdSupport() {
+    SimdLevel level = SIMD_SCALAR;
+#if FBALIGN >= 256
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        level = SIMD_AVX2;
+#if FBALIGN == 512
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512bw"))
+        level = SIMD_AVX512;
+    if (level == SIMD_AVX512 && __builtin_cpu_supports("avx512vpopcntdq"))
+        level = SIMD_AVX512_VPOPCNT;
+#endif
+#endif
+    return level;
+}
+
+// Returns the name used for 'level' by the FASTMATH_SIMD variable
+inline const char *getSimdName(const SimdLevel level) {
+    const char *names[] = {"scalar", "avx2", "avx512", "avx512_vpopcntdq"};
+    return names[level];
+}
+
+// Returns the supported instruction set, lowered to the one named by the
+// environment variable FASTMATH_SIMD if it is set
+inline SimdLevel detectSimdLevel() {
+    SimdLevel level = getSimdSupport();
+    const char *env = getenv("FASTMATH_SIMD");
+    if (env != NULL) {
+        for (int i = SIMD_SCALAR; i <= SIMD_AVX512_VPOPCNT; i++) {
+            if (!strcmp(env, getSimdName((SimdLevel)i))) {
+                level = std::min(level, (SimdLevel)i);
+                break;
+            }
+        }
+    }
+    return level;
+}
+
+// The level is detected once per process, the first time it is used
+inline SimdLevel &simd_level_ref() {
+    static SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+// Returns the instruction set used by the FastBitset kernels
+inline SimdLevel getSimdLevel() { return simd_level_ref(); }
+
+// Force the FastBitset kernels to use an instruction set
+// Levels above those supported by the CPU are lowered to getSimdSupport()
+inline void setSimdLevel(const SimdLevel level) {
+    simd_level_ref() = std::min(level, getSimdSupport());
+}
+
+// Vectors of blocks used by the SIMD kernels, with the same layout as the
+// __m256i and __m512i types of the intrinsics
+typedef BlockType BlockVector256
+    __attribute__((vector_size(32), __may_alias__));
+typedef BlockType BlockVector512
+    __attribute__((vector_size(64), __may_alias__));
+
+// Each of these adds the number of bits set in each 64-bit lane of 'v' to
+// the same lane of 'acc'
+// The AVX2 and AVX-512 versions count each nibble with a lookup table
+// (vpshufb), then sum the bytes of each lane (vpsadbw)
+struct PopcountScalar {
+    static inline void add(const BlockType &v, BlockType &acc) {
+        acc += popcount(v);
+    }
+};
+
+#if FBALIGN >= 256
+struct PopcountAvx2 {
+    __attribute__((target("avx2")))
+    static inline void add(const BlockVector256 &v, BlockVector256 &acc) {
+        const __m256i lookup = _mm256_loadu_si256((const __m256i *)avx_table);
+        const __m256i low_mask = _mm256_set1_epi8(0x0f);
+        __m256i lo = _mm256_and_si256((__m256i)v, low_mask);
+        __m256i hi = _mm256_and_si256((__m256i)(v >> 4), low_mask);
+        __m256i sum = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                      _mm256_shuffle_epi8(lookup, hi));
+        acc += (BlockVector256)_mm256_sad_epu8(sum, _mm256_setzero_si256());
+    }
+};
+#endif
+
+#if FBALIGN == 512
+struct PopcountAvx512 {
+    __attribute__((target("avx512f,avx512bw")))
+    static inline void add(const BlockVector512 &v, BlockVector512 &acc) {
+        const __m512i lookup = _mm512_loadu_si512(avx512_table);
+        const __m512i low_mask = _mm512_set1_epi8(0x0f);
+        __m512i lo = _mm512_and_si512((__m512i)v, low_mask);
+        __m512i hi = _mm512_and_si512((__m512i)(v >> 4), low_mask);
+        __m512i sum = _mm512_add_epi8(_mm512_shuffle_epi8(lookup, lo),
+                                      _mm512_shuffle_epi8(lookup, hi));
+        acc += (BlockVector512)_mm512_sad_epu8(sum, _mm512_setzero_si512());
+    }
+};
+
+// This uses the vpopcntq instruction instead
+struct PopcountVpopcnt {
+    __attribute__((target("avx512f,avx512vpopcntdq")))
+    static inline void add(const BlockVector512 &v, BlockVector512 &acc) {
+        acc += (BlockVector512)_mm512_popcnt_epi64((__m512i)v);
+    }
+};
 #endif
 
+class BitMatrix;
+class SparseBitset;
+template <class E> class BitExpression;
+
 class FastBitset {
   public:
     //----------------------------//
@@ -115,35 +322,105 @@ class FastBitset {
         n = 0;
         nb = 0;
         nr = 0;
+        cap = 0;
         bits = NULL;
+        owner = true;
     }
 
     // Creation Constructor
-    FastBitset(uint64_t _n) { createBitset(_n); }
+    FastBitset(uint64_t _n) : owner(true) { createBitset(_n); }
 
     // Copy Constructor
-    FastBitset(const FastBitset &other) {
+    // A copy always owns its bits, even if 'other' does not
+    FastBitset(const FastBitset &other) : owner(true) {
         if (__builtin_expect(this != &other, 1L)) {
             createBitset(bits, other.n, other.nb);
             std::copy(other.bits, other.bits + other.nb, bits);
         }
     }
 
+    // Move Constructor
+    // The bits are taken from 'other', which is left empty
+    // A view does not own its bits, so they are copied instead
+    FastBitset(FastBitset &&other) noexcept
+        : bits(NULL), n(0), nb(0), nr(0), cap(0), owner(true) {
+        if (other.owner) {
+            swap(other);
+        } else {
+            createBitset(bits, other.n, other.nb);
+            std::copy(other.bits, other.bits + other.nb, bits);
+        }
+    }
+
     // Destructor
     ~FastBitset() { destroyBitset(bits); }
 
     // Overloaded Assignment Operator
+    // If this bitset does not own its bits (e.g. it is a row of a
+    // BitMatrix) the contents of 'other' are copied into them instead
+    // Otherwise the memory is reused when it is large enough
     FastBitset &operator=(const FastBitset &other) {
         if (__builtin_expect(this != &other, 1L)) {
-            BlockType *_bits = NULL;
-            createBitset(_bits, other.n, other.nb);
-            std::copy(other.bits, other.bits + other.nb, _bits);
+            if (!owner) {
+                uint64_t nmin = std::min(nb, other.nb);
+                std::copy(other.bits, other.bits + nmin, bits);
+                if (nb > nmin)
+                    memset(bits + nmin, 0, sizeof(BlockType) * (nb - nmin));
+                return *this;
+            }
+
+            if (other.nb > cap) {
+                destroyBitset(bits);
+                createBitset(bits, other.n, other.nb);
+            } else {
+                n = other.n;
+                nb = other.nb;
+                nr = other.nr;
+            }
+            std::copy(other.bits, other.bits + other.nb, bits);
+        }
+        return *this;
+    }
+
+    // Move Assignment Operator
+    // The bits are taken from 'other', which is left empty, unless
+    // either bitset is a view, in which case they are copied
+    FastBitset &operator=(FastBitset &&other) noexcept {
+        if (__builtin_expect(this != &other, 1L)) {
+            if (!owner || !other.owner)
+                return *this = static_cast<const FastBitset &>(other);
+
             destroyBitset(bits);
-            bits = _bits;
+            swap(other);
         }
         return *this;
     }
 
+    // Expression Constructor and Assignment Operators
+    // The expression (see bitexpr.h) is evaluated in one pass
+    template <class E> FastBitset(const BitExpression<E> &expr);
+    template <class E> FastBitset &operator=(const BitExpression<E> &expr);
+    template <class E> FastBitset &operator&=(const BitExpression<E> &expr);
+    template <class E> FastBitset &operator|=(const BitExpression<E> &expr);
+    template <class E> FastBitset &operator^=(const BitExpression<E> &expr);
+    template <class E> FastBitset &operator-=(const BitExpression<E> &expr);
+
+    // Exchange the contents of two bitsets
+    // Bitsets which own their bits exchange them in constant time; if
+    // either is a view, the bits are exchanged one block at a time, so
+    // both must have the same size
+    inline void swap(FastBitset &other) {
+        if (owner && other.owner) {
+            std::swap(bits, other.bits);
+            std::swap(n, other.n);
+            std::swap(nb, other.nb);
+            std::swap(nr, other.nr);
+            std::swap(cap, other.cap);
+        } else {
+            std::swap_ranges(bits, bits + std::min(nb, other.nb), other.bits);
+        }
+    }
+
     // Equality Operator
     inline bool operator==(FastBitset const &other) const {
         if (nb != other.nb)
@@ -169,6 +446,10 @@ class FastBitset {
     // Returns the number of bits per block
     inline size_t getBlockSize() const { return block_size; }
 
+    // Returns the number of bits which fit in 'bits' without
+    // reallocating, including the padding
+    inline uint64_t getCapacity() const { return cap << BLOCK_SHIFT; }
+
     // Return address of bits (needed for MPI)
     inline void *getAddress() const { return (void *)bits; }
 
@@ -181,43 +462,27 @@ class FastBitset {
     }
 
     // Return true if any bits are set within a particular range
-    inline bool any_in_range(uint64_t offset, uint64_t length) {
-        uint64_t block_idx = offset >> BLOCK_SHIFT;
-        unsigned int idx0 =
-            static_cast<unsigned int>(offset & (bits_per_block - 1));
-        unsigned int idx1 =
-            static_cast<unsigned int>((offset + length) & (bits_per_block - 1));
-        BlockType lower_mask = idx0 ? ~get_bitmask(idx0) : (BlockType)(-1);
-        BlockType upper_mask = idx1 ? get_bitmask(idx1) : (BlockType)(-1);
-
-        uint64_t any_set[4] = {0, 0, 0, 0};
-        uint64_t nmid, rem, max;
-
-        if (length <= bits_per_block &&
-            (idx0 < idx1 || idx0 + idx1 == 0 || (idx0 > idx1 && idx1 == 0)))
-            any_set[0] |= bits[block_idx] & lower_mask & upper_mask;
-        else {
-            nmid = (length - 1) >> BLOCK_SHIFT;
-            if (idx0 < idx1 || idx0 == 0 || idx1 == 0)
-                nmid--;
-            rem = nmid & 3;
-            max = nmid - rem;
-
-            for (uint64_t i = 1; i <= max; i += 4) {
-                any_set[0] |= bits[block_idx + i];
-                any_set[1] |= bits[block_idx + i + 1];
-                any_set[2] |= bits[block_idx + i + 2];
-                any_set[3] |= bits[block_idx + i + 3];
-            }
-
-            for (uint64_t i = 0; i < rem; i++)
-                any_set[0] |= bits[block_idx + max + i + 1];
-
-            any_set[0] |= (bits[block_idx] & lower_mask) |
-                          (bits[block_idx + nmid + 1] & upper_mask);
-        }
+    // The blocks at either end are checked first, and the blocks between
+    // them are scanned with SIMD instructions, stopping at the first set bit
+    // NOTE: The offset and length refer to bit indices, not blocks
+    inline bool any_in_range(uint64_t offset, uint64_t length) const {
+        if (!length)
+            return false;
+        uint64_t b0 = offset >> BLOCK_SHIFT;
+        uint64_t b1 = (offset + length - 1) >> BLOCK_SHIFT;
+        BlockType lower_mask = mask_table2[offset & block_size_m];
+        BlockType upper_mask = mask_table[(offset + length) & block_size_m];
+
+        if (b0 == b1)
+            return !!(bits[b0] & lower_mask & upper_mask);
+        if ((bits[b0] & lower_mask) | (bits[b1] & upper_mask))
+            return true;
+        return any_vectors(bits + b0 + 1, b1 - b0 - 1);
+    }
 
-        return !!(any_set[0] | any_set[1] | any_set[2] | any_set[3]);
+    // Return true if no bits are set within a particular range
+    inline bool none_in_range(uint64_t offset, uint64_t length) const {
+        return !any_in_range(offset, length);
     }
 
     //---------------------//
@@ -225,13 +490,13 @@ class FastBitset {
     //---------------------//
 
     // Set the bit at location 'idx' to 1
-    // NOTE: This operation is not thread-safe
+    // NOTE: This operation is not thread-safe; see atomic_set()
     inline void set(uint64_t idx) {
         bits[idx >> BLOCK_SHIFT] |= (BlockType)1 << (idx & block_size_m);
     }
 
     // Set the bit at location 'idx' to 0
-    // NOTE: This operation is not thread-safe
+    // NOTE: This operation is not thread-safe; see atomic_unset()
     inline void unset(uint64_t idx) {
         bits[idx >> BLOCK_SHIFT] &= ~((BlockType)1 << (idx & block_size_m));
     }
@@ -265,6 +530,8 @@ class FastBitset {
 
     // Read next bit set
     // Use this if the block is not known
+    // This scans from the first block on each call; to visit every bit,
+    // use find_next() or for_each_set_bit() instead
     inline uint64_t next_bit() const {
         if (any()) {
             for (uint64_t i = 0; i < nb; i++)
@@ -274,6 +541,21 @@ class FastBitset {
         return n;
     }
 
+    // Returns the first bit set at or after 'idx', or size() if there
+    // are none
+    inline uint64_t find_next(uint64_t idx) const {
+        if (idx >= n)
+            return n;
+        uint64_t i = idx >> BLOCK_SHIFT;
+        BlockType v = bits[i] & mask_table2[idx & block_size_m];
+        while (!v) {
+            if (++i == nb)
+                return n;
+            v = bits[i];
+        }
+        return (i << BLOCK_SHIFT) + __builtin_ctzl(v);
+    }
+
     // Read next bit set (reverse direction, right to left)
     inline uint64_t prev_bit(uint64_t idx) const {
         uint64_t loc_idx;
@@ -294,12 +576,290 @@ class FastBitset {
         return 0;
     }
 
+    //-------------------//
+    // Atomic Operations //
+    //-------------------//
+
+    // These are safe when several threads write the same bitset at once,
+    // so a parallel loop may fill a shared bitset without a private copy
+    // per thread. Each is one locked instruction on a single block. The
+    // updates are relaxed: other threads are only guaranteed to see them
+    // after the threads synchronize, e.g. at the end of a parallel region.
+    // To set many bits which lie close together, use a ConcurrentBuilder.
+
+    // Set the bit at location 'idx' to 1
+    inline void atomic_set(uint64_t idx) {
+        __atomic_fetch_or(bits + (idx >> BLOCK_SHIFT),
+                          (BlockType)1 << (idx & block_size_m),
+                          __ATOMIC_RELAXED);
+    }
+
+    // Set the bit at location 'idx' to 0
+    inline void atomic_unset(uint64_t idx) {
+        __atomic_fetch_and(bits + (idx >> BLOCK_SHIFT),
+                           ~((BlockType)1 << (idx & block_size_m)),
+                           __ATOMIC_RELAXED);
+    }
+
+    // Flip the bit at location 'idx'
+    inline void atomic_flip(uint64_t idx) {
+        __atomic_fetch_xor(bits + (idx >> BLOCK_SHIFT),
+                           (BlockType)1 << (idx & block_size_m),
+                           __ATOMIC_RELAXED);
+    }
+
+    // Set the bit at location 'idx' to 1 and return its previous value
+    // When several threads set the same bit, exactly one of them reads 0,
+    // so this claims a vertex, e.g. when building the next frontier
+    inline BlockType test_and_set(uint64_t idx) {
+        BlockType mask = (BlockType)1 << (idx & block_size_m);
+        return !!(__atomic_fetch_or(bits + (idx >> BLOCK_SHIFT), mask,
+                                    __ATOMIC_RELAXED) &
+                  mask);
+    }
+
+    // Set the bit at location 'idx' to 0 and return its previous value
+    inline BlockType test_and_unset(uint64_t idx) {
+        BlockType mask = (BlockType)1 << (idx & block_size_m);
+        return !!(__atomic_fetch_and(bits + (idx >> BLOCK_SHIFT), ~mask,
+                                     __ATOMIC_RELAXED) &
+                  mask);
+    }
+
+    // Union 'val' into the block at location 'idx', and return the
+    // previous value of the block
+    inline BlockType fetch_or_block(const BlockType val, uint64_t idx) {
+        return __atomic_fetch_or(bits + idx, val, __ATOMIC_RELAXED);
+    }
+
+    // Intersect the block at location 'idx' with 'val', and return the
+    // previous value of the block
+    inline BlockType fetch_and_block(const BlockType val, uint64_t idx) {
+        return __atomic_fetch_and(bits + idx, val, __ATOMIC_RELAXED);
+    }
+
+    // Read the bit at location 'idx' while other threads may write it
+    inline BlockType atomic_read(uint64_t idx) const {
+        return (__atomic_load_n(bits + (idx >> BLOCK_SHIFT),
+                                __ATOMIC_RELAXED) >>
+                (idx & block_size_m)) &
+               (BlockType)1;
+    }
+
+    //---------//
+    // Hashing //
+    //---------//
+
+    // The hash has eight lanes: block k adds the term hash_term(bits[k], k)
+    // to lane k % 8, where the term is the block plus the product of the
+    // two halves of the block XORed with a key which depends on k, as in
+    // XXH3. The lanes are mixed with the number of blocks at the end.
+    // Since every block adds its own term, each version computes the same
+    // hash, and a HashedBitset can update the lanes when a single block
+    // changes.
+    // The number of bits is not mixed in, since operator== compares only
+    // the blocks, and bitsets which are equal must have the same hash.
+
+    // This uses the fastest version supported at runtime
+    inline size_t hash() const {
+        BlockType lanes[8];
+        hash_lanes(lanes);
+        return hash_digest(lanes, nb);
+    }
+
+    // Write the sums of the eight lanes to 'lanes'
+    inline void hash_lanes(BlockType *lanes) const {
+#if FBALIGN == 512
+        if (getSimdLevel() >= SIMD_AVX512) {
+            hash_avx512(lanes);
+            return;
+        }
+#endif
+#if FBALIGN >= 256
+        if (getSimdLevel() >= SIMD_AVX2) {
+            hash_v2(lanes);
+            return;
+        }
+#endif
+        hash_v1(lanes);
+    }
+
+    inline void hash_v1(BlockType *lanes) const {
+        for (unsigned int l = 0; l < 8; l++)
+            lanes[l] = 0;
+        for (uint64_t k = 0; k < nb; k++)
+            lanes[k & 7] += hash_term(bits[k], k);
+    }
+
+#if FBALIGN >= 256
+    // Eight blocks at a time, in two 256-bit vectors
+    inline void hash_v2(BlockType *lanes) const {
+        uint64_t max = nb & ~(uint64_t)7;
+        for (unsigned int l = 0; l < 8; l++)
+            lanes[l] = 0;
+
+        if (max) {
+            asm volatile("vmovdqu (%2), %%ymm1		\n\t" // keys
+                         "vmovdqu 32(%2), %%ymm6		\n\t"
+                         "vpbroadcastq (%3), %%ymm2	\n\t" // step
+                         "vpxor %%ymm3, %%ymm3, %%ymm3	\n\t" // lanes
+                         "vpxor %%ymm7, %%ymm7, %%ymm7	\n\t"
+                         "xorq %%rcx, %%rcx		\n"
+                         "forloop%=:			\n\t"
+                         "vmovdqu (%1,%%rcx,8), %%ymm0	\n\t"
+                         "vpxor %%ymm0, %%ymm1, %%ymm4	\n\t"
+                         "vpsrlq $32, %%ymm4, %%ymm5	\n\t"
+                         "vpmuludq %%ymm5, %%ymm4, %%ymm4	\n\t"
+                         "vpaddq %%ymm0, %%ymm3, %%ymm3	\n\t"
+                         "vpaddq %%ymm4, %%ymm3, %%ymm3	\n\t"
+                         "vmovdqu 32(%1,%%rcx,8), %%ymm0	\n\t"
+                         "vpxor %%ymm0, %%ymm6, %%ymm4	\n\t"
+                         "vpsrlq $32, %%ymm4, %%ymm5	\n\t"
+                         "vpmuludq %%ymm5, %%ymm4, %%ymm4	\n\t"
+                         "vpaddq %%ymm0, %%ymm7, %%ymm7	\n\t"
+                         "vpaddq %%ymm4, %%ymm7, %%ymm7	\n\t"
+                         "vpaddq %%ymm2, %%ymm1, %%ymm1	\n\t"
+                         "vpaddq %%ymm2, %%ymm6, %%ymm6	\n\t"
+                         "addq $8, %%rcx			\n\t"
+                         "cmpq %4, %%rcx			\n\t"
+                         "jl forloop%=			\n\t"
+                         "vmovdqu %%ymm3, (%0)		\n\t"
+                         "vmovdqu %%ymm7, 32(%0)		\n\t"
+                         "vzeroupper			\n\t"
+                         :
+                         : "r"(lanes), "r"(bits), "r"(hash_keys),
+                           "r"(&hash_step), "r"(max)
+                         : "%rcx", "%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                           "%xmm4", "%xmm5", "%xmm6", "%xmm7", "memory");
+        }
+
+        for (uint64_t k = max; k < nb; k++)
+            lanes[k & 7] += hash_term(bits[k], k);
+    }
+#endif
+
+#if FBALIGN == 512
+    // Eight blocks at a time, one in each lane of a 512-bit vector
+    // The blocks and the products are summed separately, so the two
+    // additions in each iteration are independent
+    inline void hash_avx512(BlockType *lanes) const {
+        uint64_t max = nb & ~(uint64_t)7;
+        for (unsigned int l = 0; l < 8; l++)
+            lanes[l] = 0;
+
+        if (max) {
+            asm volatile("vmovdqu64 (%2), %%zmm1			\n\t" // keys
+                         "vpbroadcastq (%3), %%zmm2		\n\t" // step
+                         "vpxorq %%zmm3, %%zmm3, %%zmm3		\n\t"
+                         "vpxorq %%zmm6, %%zmm6, %%zmm6		\n\t"
+                         "xorq %%rcx, %%rcx			\n"
+                         "forloop%=:				\n\t"
+                         "vmovdqu64 (%1,%%rcx,8), %%zmm0		\n\t"
+                         "vpxorq %%zmm0, %%zmm1, %%zmm4		\n\t"
+                         "vpsrlq $32, %%zmm4, %%zmm5		\n\t"
+                         "vpmuludq %%zmm5, %%zmm4, %%zmm4		\n\t"
+                         "vpaddq %%zmm0, %%zmm3, %%zmm3		\n\t"
+                         "vpaddq %%zmm4, %%zmm6, %%zmm6		\n\t"
+                         "vpaddq %%zmm2, %%zmm1, %%zmm1		\n\t"
+                         "addq $8, %%rcx				\n\t"
+                         "cmpq %4, %%rcx				\n\t"
+                         "jl forloop%=				\n\t"
+                         "vpaddq %%zmm6, %%zmm3, %%zmm3		\n\t"
+                         "vmovdqu64 %%zmm3, (%0)			\n\t"
+                         "vzeroupper				\n\t"
+                         :
+                         : "r"(lanes), "r"(bits), "r"(hash_keys),
+                           "r"(&hash_step), "r"(max)
+                         : "%rcx", "%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                           "%xmm4", "%xmm5", "%xmm6", "memory");
+        }
+
+        for (uint64_t k = max; k < nb; k++)
+            lanes[k & 7] += hash_term(bits[k], k);
+    }
+#endif
+
+    // The term added to lane k % 8 when block 'k' has the value 'val'
+    static inline BlockType hash_term(const BlockType val, uint64_t k) {
+        BlockType x = val ^ (hash_keys[k & 7] + (k >> 3) * hash_step);
+        return val + (x & 0xffffffffllu) * (x >> 32);
+    }
+
+    // Mix the lanes with the number of blocks '_nb', using the finalizer
+    // of MurmurHash3 after each lane
+    static inline size_t hash_digest(const BlockType *lanes, uint64_t _nb) {
+        BlockType h = _nb * hash_step;
+        for (unsigned int l = 0; l < 8; l++) {
+            h ^= lanes[l];
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdllu;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53llu;
+            h ^= h >> 33;
+        }
+        return (size_t)h;
+    }
+
     //---------------//
     // Create Bitset //
     //---------------//
 
     inline void createBitset(uint64_t _n) { createBitset(bits, _n); }
 
+    //--------------------//
+    // Reserve and Resize //
+    //--------------------//
+
+    // Make room for '_n' bits, keeping the current bits, so that a later
+    // resize() up to '_n' bits does not allocate
+    // A view cannot be reallocated, so this does nothing for a view
+    inline void reserve(uint64_t _n) {
+        uint64_t _nb = get_num_blocks(_n);
+        if (!owner || _nb <= cap)
+            return;
+
+        BlockType *_bits = NULL;
+        try {
+            if (posix_memalign((void **)&_bits, alignment,
+                               sizeof(BlockType) * _nb))
+                throw std::bad_alloc();
+        } catch (std::bad_alloc &) {
+            fprintf(stderr, "Memory allocation failure in %s on line %d!\n",
+                    __FILE__, __LINE__);
+            fflush(stderr);
+            return;
+        }
+
+        if (bits != NULL)
+            memcpy(_bits, bits, sizeof(BlockType) * nb);
+        memset(_bits + nb, 0, sizeof(BlockType) * (_nb - nb));
+        free(bits);
+        bits = _bits;
+        cap = _nb;
+    }
+
+    // Change the number of bits to '_n', keeping the bits below both the
+    // old and the new sizes, while any new bits are zero
+    // Memory is allocated only when '_n' exceeds the capacity and is never
+    // released, so a bitset may be resized repeatedly without allocating
+    // A view may only be resized within its memory
+    inline void resize(uint64_t _n) {
+        uint64_t _nb = get_num_blocks(_n);
+        if (_nb > cap) {
+            reserve(_n);
+            if (_nb > cap)
+                return;
+        }
+
+        // Blocks past the old size may hold bits from an earlier size
+        if (_nb > nb)
+            memset(bits + nb, 0, sizeof(BlockType) * (_nb - nb));
+        n = _n;
+        nb = _nb;
+        nr = nb & 3;
+        trim();
+    }
+
     //--------------------//
     // Reset Bits to Zero //
     //--------------------//
@@ -347,7 +907,7 @@ class FastBitset {
             uint64_t block_idx = n >> BLOCK_SHIFT;
             unsigned int idx0 =
                 static_cast<unsigned int>(n & (bits_per_block - 1));
-            BlockType lower_mask = masks2[idx0];
+            BlockType lower_mask = mask_table2[idx0];
 
             bits[block_idx] = (bits[block_idx] & ~lower_mask);
             if (length > bits_per_block) {
@@ -391,8 +951,8 @@ class FastBitset {
             static_cast<unsigned int>(offset & (bits_per_block - 1));
         unsigned int idx1 =
             static_cast<unsigned int>((offset + length) & (bits_per_block - 1));
-        BlockType lower_mask = masks2[idx0];
-        BlockType upper_mask = masks[idx1];
+        BlockType lower_mask = mask_table2[idx0];
+        BlockType upper_mask = mask_table[idx1];
 
         if (length <= bits_per_block &&
             (idx0 < idx1 || idx0 + idx1 == 0 || (idx0 > idx1 && idx1 == 0)))
@@ -414,12 +974,15 @@ class FastBitset {
         }
     }
 
-//---------------------//
-// Counting Operations //
-//---------------------//
+    //---------------------//
+    // Counting Operations //
+    //---------------------//
 
-// Alias to be used externally
-#define count_bits() count_v3()
+    // Count the number of bits set
+    // This uses the fastest version supported at runtime
+    inline uint64_t count_bits() const {
+        return count_vectors<0xf0>(bits, bits, nb);
+    }
 
     // Computes the Hamming weight
     // Make sure to compile with the flag -mpopcnt to use this
@@ -433,97 +996,67 @@ class FastBitset {
     // Modified count based on Boost's algorithm
     inline uint64_t count_v2() const { return do_count(bits, nb); }
 
-    // Modified count using assembly code (super fast)
+    // Modified count using the popcnt instruction (super fast)
     inline uint64_t count_v3() const {
-        uint64_t cnt[4] = {0, 0, 0, 0};
-#ifdef AVX2_ENABLED
-        uint64_t max = nb;
-#else
-        uint64_t max = nb - nr;
-#endif
+        return count_vectors_v1<0xf0>(bits, bits, nb);
+    }
 
-        for (uint64_t i = 0; i < max; i += 4) {
-            asm volatile("popcntq %4, %4	\n\t"
-                         "addq %4, %0	\n\t"
-                         "popcntq %5, %5	\n\t"
-                         "addq %5, %1	\n\t"
-                         "popcntq %6, %6	\n\t"
-                         "addq %6, %2	\n\t"
-                         "popcntq %7, %7	\n\t"
-                         "addq %7, %3	\n\t"
-                         : "+r"(cnt[0]), "+r"(cnt[1]), "+r"(cnt[2]),
-                           "+r"(cnt[3])
-                         : "r"(bits[i]), "r"(bits[i + 1]), "r"(bits[i + 2]),
-                           "r"(bits[i + 3]));
-        }
-
-#ifndef AVX2_ENABLED
-        if (nr)
-            *cnt += do_count(bits + max, nr);
-#endif
+    // Count using the Harley-Seal method (see count_blocks_hs) with AVX2
+    // or AVX-512, whichever is the widest supported at runtime
+    // count_bits() uses this for bitsets of at least harley_seal_threshold
+    // blocks when the vpopcntq instruction is not available
+    inline uint64_t count_v4() const {
+        return count_vectors_hs<0xf0>(bits, bits, nb);
+    }
 
-        return cnt[0] + cnt[1] + cnt[2] + cnt[3];
+#if FBALIGN == 512
+    // Count using AVX-512
+    // The vpopcntq instruction is used if the CPU supports it; otherwise
+    // each byte is counted with a lookup table (see PopcountAvx512)
+    inline uint64_t count_avx512() const {
+        if (getSimdLevel() >= SIMD_AVX512_VPOPCNT)
+            return count_vectors_vpopcnt<0xf0>(bits, bits, nb);
+        return count_vectors_avx512<0xf0>(bits, bits, nb);
     }
+#endif
 
     // Count a subset of bits
     // NOTE: The offset and the length are for bits, not blocks
     inline uint64_t partial_count(uint64_t offset, uint64_t length) const {
-        uint64_t block_idx = offset >> BLOCK_SHIFT;
-        unsigned int idx0 = static_cast<unsigned int>(offset & block_size_m);
-        unsigned int idx1 =
-            static_cast<unsigned int>((offset + length) & block_size_m);
-        BlockType lower_mask = masks2[idx0];
-        BlockType upper_mask = masks[idx1];
-
-        uint64_t cnt[4] = {0, 0, 0, 0};
-        uint64_t nmid, rem, max;
-
-        if (length <= bits_per_block &&
-            (idx0 < idx1 || idx0 + idx1 == 0 || (idx0 > idx1 && idx1 == 0)))
-            cnt[0] = popcount(bits[block_idx] & lower_mask & upper_mask);
-        else {
-            nmid = (length - 1) >> BLOCK_SHIFT;
-            if (idx0 < idx1 || idx0 == 0 || idx1 == 0)
-                nmid--;
-            rem = nmid & 3;
-            max = nmid - rem;
-
-            for (uint64_t i = 1; i <= max; i += 4) {
-                asm volatile(
-                    "popcntq %4, %4	\n\t"
-                    "addq %4, %0	\n\t"
-                    "popcntq %5, %5	\n\t"
-                    "addq %5, %1	\n\t"
-                    "popcntq %6, %6	\n\t"
-                    "addq %6, %2	\n\t"
-                    "popcntq %7, %7	\n\t"
-                    "addq %7, %3	\n\t"
-                    : "+r"(cnt[0]), "+r"(cnt[1]), "+r"(cnt[2]), "+r"(cnt[3])
-                    : "r"(bits[block_idx + i]), "r"(bits[block_idx + i + 1]),
-                      "r"(bits[block_idx + i + 2]),
-                      "r"(bits[block_idx + i + 3]));
-            }
-
-            if (rem)
-                cnt[0] += do_count((bits + block_idx + max + 1), rem);
-
-            cnt[0] += popcount(bits[block_idx] & lower_mask) +
-                      popcount(bits[block_idx + nmid + 1] & upper_mask);
-        }
-
-        return cnt[0] + cnt[1] + cnt[2] + cnt[3];
+        if (!length)
+            return 0;
+        uint64_t b0 = offset >> BLOCK_SHIFT;
+        uint64_t b1 = (offset + length - 1) >> BLOCK_SHIFT;
+        BlockType lower_mask = mask_table2[offset & block_size_m];
+        BlockType upper_mask = mask_table[(offset + length) & block_size_m];
+
+        if (b0 == b1)
+            return popcount(bits[b0] & lower_mask & upper_mask);
+        return popcount(bits[b0] & lower_mask) +
+               popcount(bits[b1] & upper_mask) +
+               count_vectors<0xf0>(bits + b0 + 1, bits + b0 + 1, b1 - b0 - 1);
     }
 
-//------------------//
-// Set Intersection //
-//------------------//
+    //------------------//
+    // Set Intersection //
+    //------------------//
 
-// Aliases to be used externally
-#ifdef AVX2_ENABLED
-#define setIntersection(fb) setIntersection_v2(fb)
-#else
-#define setIntersection(fb) setIntersection_v1(fb)
+    // This uses the fastest version supported at runtime
+    inline void setIntersection(const FastBitset &fb) {
+#if FBALIGN == 512
+        if (getSimdLevel() >= SIMD_AVX512) {
+            setIntersection_avx512(fb);
+            return;
+        }
+#endif
+#if FBALIGN >= 256
+        if (getSimdLevel() >= SIMD_AVX2) {
+            setIntersection_v2(fb);
+            return;
+        }
 #endif
+        setIntersection_v1(fb);
+    }
 
     inline void setIntersection_v1(const FastBitset &fb) {
         for (uint64_t i = std::min(nb, fb.nb); i-- > 0;)
@@ -538,20 +1071,9 @@ class FastBitset {
             memset(bits + fb.nb, 0, sizeof(BlockType) * (nb - fb.nb));
     }
 
-#ifdef AVX2_ENABLED
+#if FBALIGN >= 256
     inline void setIntersection_v2(const FastBitset &fb) {
-        asm volatile("movq %2, %%rcx			\n"
-                     "forloop%=:			\n\t"
-                     "subq $4, %%rcx			\n\t"
-                     "vmovdqu (%0,%%rcx,8), %%ymm0	\n\t"
-                     "vmovdqu (%1,%%rcx,8), %%ymm1	\n\t"
-                     "vpand %%ymm0, %%ymm1, %%ymm0	\n\t"
-                     "vmovdqu %%ymm0, (%0,%%rcx,8)	\n\t"
-                     "cmpq $0, %%rcx			\n\t"
-                     "jne forloop%=			\n\t"
-                     : "+r"(bits)
-                     : "r"(fb.bits), "r"(std::min(nb, fb.nb))
-                     : "%rcx", "memory");
+        combine_vectors_v2<0xc0>(bits, fb.bits, std::min(nb, fb.nb));
     }
 
     inline void setIntersectionG_v2(const FastBitset &fb) {
@@ -561,386 +1083,461 @@ class FastBitset {
     }
 #endif
 
+#if FBALIGN == 512
+    inline void setIntersection_avx512(const FastBitset &fb) {
+        combine_vectors_avx512<0xc0>(bits, fb.bits, std::min(nb, fb.nb));
+    }
+#endif
+
     // Perform a subset intersection
     // This is equivalent to a full intersection with some bitmasks
     // NOTE: The offset and length refer to bit indices, not blocks
     inline void partial_intersection(const FastBitset &fb, uint64_t offset,
                                      uint64_t length) {
-        uint64_t block_idx = offset >> BLOCK_SHIFT;
-        unsigned int idx0 = static_cast<unsigned int>(offset & block_size_m);
-        unsigned int idx1 =
-            static_cast<unsigned int>((offset + length) & block_size_m);
-        BlockType lower_mask = masks2[idx0];
-        BlockType upper_mask = masks[idx1];
-        uint64_t nmid, nused;
+        if (!length) {
+            reset();
+            return;
+        }
+        uint64_t b0 = offset >> BLOCK_SHIFT;
+        uint64_t b1 = (offset + length - 1) >> BLOCK_SHIFT;
+        BlockType lower_mask = mask_table2[offset & block_size_m];
+        BlockType upper_mask = mask_table[(offset + length) & block_size_m];
 
-        if (length <= bits_per_block &&
-            (idx0 < idx1 || idx0 + idx1 == 0 || (idx0 > idx1 && idx1 == 0))) {
-            bits[block_idx] &= fb.bits[block_idx] & lower_mask & upper_mask;
-            nused = 1;
+        if (b0 == b1) {
+            bits[b0] &= fb.bits[b0] & lower_mask & upper_mask;
         } else {
-            nmid = (length - 1) >> BLOCK_SHIFT;
-            if (idx0 < idx1 || idx0 == 0 || idx1 == 0)
-                nmid--;
-
-#ifdef AVX2_ENABLED
-            uint64_t rem = nmid & 3;
-            uint64_t max = nmid - rem;
-
-            if (max) {
-                asm volatile("movq %3, %%rax			\n\t"
-                             "movq %2, %%rcx			\n\t"
-                             "forloop%=:			\n\t"
-                             "vmovdqu (%0,%%rcx,8), %%ymm0	\n\t"
-                             "vmovdqu (%1,%%rcx,8), %%ymm1	\n\t"
-                             "vpand %%ymm0, %%ymm1, %%ymm0	\n\t"
-                             "vmovdqu %%ymm0, (%0,%%rcx,8)	\n\t"
-                             "addq $4, %%rcx			\n\t"
-                             "cmpq %%rax, %%rcx		\n\t"
-                             "jl forloop%=			\n\t"
-                             : "+r"(bits)
-                             : "r"(fb.bits), "r"(block_idx + 1),
-                               "r"(max + block_idx)
-                             : "%rax", "%rcx", "memory");
-            }
-
-            if (rem)
-                for (uint64_t i = max + 1; i <= nmid; i++)
-                    bits[block_idx + i] &= fb.bits[block_idx + i];
-#else
-            for (uint64_t i = 1; i <= nmid; i++)
-                bits[block_idx + i] &= fb.bits[block_idx + i];
-#endif
-
-            bits[block_idx] &= fb.bits[block_idx] & lower_mask;
-            bits[block_idx + nmid + 1] &=
-                fb.bits[block_idx + nmid + 1] & upper_mask;
-            nused = nmid + 2;
+            bits[b0] &= fb.bits[b0] & lower_mask;
+            bits[b1] &= fb.bits[b1] & upper_mask;
+            combine_vectors<0xc0>(bits + b0 + 1, fb.bits + b0 + 1,
+                                  b1 - b0 - 1);
         }
 
-        uint64_t low = block_idx;
-        uint64_t high = nb - low - nused;
-
-        if (low)
-            memset(bits, 0, sizeof(BlockType) * low);
-        if (high)
-            memset(bits + low + nused, 0, sizeof(BlockType) * high);
+        if (b0)
+            memset(bits, 0, sizeof(BlockType) * b0);
+        if (b1 + 1 < nb)
+            memset(bits + b1 + 1, 0, sizeof(BlockType) * (nb - b1 - 1));
     }
 
-//-----------//
-// Set Union //
-//-----------//
+    //-----------//
+    // Set Union //
+    //-----------//
 
-// Aliases to be used externally
-#ifdef AVX2_ENABLED
-#define setUnion(fb) setUnion_v2(fb)
-#else
-#define setUnion(fb) setUnion_v1(fb)
+    // This uses the fastest version supported at runtime
+    inline void setUnion(const FastBitset &fb) {
+#if FBALIGN == 512
+        if (getSimdLevel() >= SIMD_AVX512) {
+            setUnion_avx512(fb);
+            return;
+        }
+#endif
+#if FBALIGN >= 256
+        if (getSimdLevel() >= SIMD_AVX2) {
+            setUnion_v2(fb);
+            return;
+        }
 #endif
+        setUnion_v1(fb);
+    }
 
     inline void setUnion_v1(const FastBitset &fb) {
         for (uint64_t i = std::min(nb, fb.nb); i-- > 0;)
             bits[i] |= fb.bits[i];
     }
 
-#ifdef AVX2_ENABLED
+#if FBALIGN >= 256
     inline void setUnion_v2(const FastBitset &fb) {
-        asm volatile("movq %2, %%rcx			\n"
-                     "forloop%=:			\n\t"
-                     "subq $4, %%rcx			\n\t"
-                     "vmovdqu (%0,%%rcx,8), %%ymm0	\n\t"
-                     "vmovdqu (%1,%%rcx,8), %%ymm1	\n\t"
-                     "vpor %%ymm0, %%ymm1, %%ymm0	\n\t"
-                     "vmovdqu %%ymm0, (%0,%%rcx,8)	\n\t"
-                     "cmpq $0, %%rcx			\n\t"
-                     "jne forloop%=			\n\t"
-                     : "+r"(bits)
-                     : "r"(fb.bits), "r"(std::min(nb, fb.nb))
-                     : "%rcx", "memory");
+        combine_vectors_v2<0xfc>(bits, fb.bits, std::min(nb, fb.nb));
     }
 #endif
 
-//--------------------//
-// Set Disjoint Union //
-//--------------------//
+#if FBALIGN == 512
+    inline void setUnion_avx512(const FastBitset &fb) {
+        combine_vectors_avx512<0xfc>(bits, fb.bits, std::min(nb, fb.nb));
+    }
+#endif
 
-// Aliases to be used externally
-#ifdef AVX2_ENABLED
-#define setDisjointUnion(fb) setDisjointUnion_v2(fb)
-#else
-#define setDisjointUnion(fb) setDisjointUnion_v1(fb)
+    //--------------------//
+    // Set Disjoint Union //
+    //--------------------//
+
+    // This uses the fastest version supported at runtime
+    inline void setDisjointUnion(const FastBitset &fb) {
+#if FBALIGN == 512
+        if (getSimdLevel() >= SIMD_AVX512) {
+            setDisjointUnion_avx512(fb);
+            return;
+        }
+#endif
+#if FBALIGN >= 256
+        if (getSimdLevel() >= SIMD_AVX2) {
+            setDisjointUnion_v2(fb);
+            return;
+        }
 #endif
+        setDisjointUnion_v1(fb);
+    }
 
     inline void setDisjointUnion_v1(const FastBitset &fb) {
         for (uint64_t i = std::min(nb, fb.nb); i-- > 0;)
             bits[i] ^= fb.bits[i];
     }
 
-#ifdef AVX2_ENABLED
+#if FBALIGN >= 256
     inline void setDisjointUnion_v2(const FastBitset &fb) {
-        asm volatile("movq %2, %%rcx			\n"
-                     "forloop%=:			\n\t"
-                     "subq $4, %%rcx			\n\t"
-                     "vmovdqu (%0,%%rcx,8), %%ymm0	\n\t"
-                     "vmovdqu (%1,%%rcx,8), %%ymm1	\n\t"
-                     "vpxor %%ymm0, %%ymm1, %%ymm0	\n\t"
-                     "vmovdqu %%ymm0, (%0,%%rcx,8)	\n\t"
-                     "cmpq $0, %%rcx			\n\t"
-                     "jne forloop%=			\n\t"
-                     : "+r"(bits)
-                     : "r"(fb.bits), "r"(std::min(nb, fb.nb))
-                     : "%rcx", "memory");
+        combine_vectors_v2<0x3c>(bits, fb.bits, std::min(nb, fb.nb));
+    }
+#endif
+
+#if FBALIGN == 512
+    inline void setDisjointUnion_avx512(const FastBitset &fb) {
+        combine_vectors_avx512<0x3c>(bits, fb.bits, std::min(nb, fb.nb));
     }
 #endif
 
-//----------------//
-// Set Difference //
-//----------------//
+    //----------------//
+    // Set Difference //
+    //----------------//
 
-// Aliases to be used externally
-#ifdef AVX2_ENABLED
-#define setDifference(fb) setDifference_v2(fb)
-#else
-#define setDifference(fb) setDifference_v1(fb)
+    // This uses the fastest version supported at runtime
+    inline void setDifference(const FastBitset &fb) {
+#if FBALIGN == 512
+        if (getSimdLevel() >= SIMD_AVX512) {
+            setDifference_avx512(fb);
+            return;
+        }
+#endif
+#if FBALIGN >= 256
+        if (getSimdLevel() >= SIMD_AVX2) {
+            setDifference_v2(fb);
+            return;
+        }
 #endif
+        setDifference_v1(fb);
+    }
 
     inline void setDifference_v1(const FastBitset &fb) {
         for (uint64_t i = std::min(nb, fb.nb); i-- > 0;)
             bits[i] &= (bits[i] ^ fb.bits[i]);
     }
 
-#ifdef AVX2_ENABLED
+#if FBALIGN >= 256
     inline void setDifference_v2(const FastBitset &fb) {
-        asm volatile("movq %2, %%rcx			\n"
-                     "forloop%=:			\n\t"
-                     "subq $4, %%rcx			\n\t"
-                     "vmovdqu (%0,%%rcx,8), %%ymm0	\n\t"
-                     "vmovdqu (%1,%%rcx,8), %%ymm1	\n\t"
-                     "vpxor %%ymm0, %%ymm1, %%ymm1	\n\t"
-                     "vpand %%ymm0, %%ymm1, %%ymm0	\n\t"
-                     "vmovdqu %%ymm0, (%0,%%rcx,8)	\n\t"
-                     "cmpq $0, %%rcx			\n\t"
-                     "jne forloop%=			\n\t"
-                     : "+r"(bits)
-                     : "r"(fb.bits), "r"(std::min(nb, fb.nb))
-                     : "%rcx", "memory");
+        combine_vectors_v2<0x30>(bits, fb.bits, std::min(nb, fb.nb));
     }
 #endif
 
-    ///////////////////////////
-    // Partial Inner Product //
-    ///////////////////////////
+#if FBALIGN == 512
+    inline void setDifference_avx512(const FastBitset &fb) {
+        combine_vectors_avx512<0x30>(bits, fb.bits, std::min(nb, fb.nb));
+    }
+#endif
 
-    // This combines the set intersection with an
-    // AVX implementation of the popcnt algorithm
-    // In general, this should be faster than
-    // a setIntersection() followed by count_bits()
-    inline uint64_t partial_vecprod(const FastBitset &fb, uint64_t offset,
-                                    uint64_t length) {
-        uint64_t block_idx = offset >> BLOCK_SHIFT;
-        unsigned int idx0 = static_cast<unsigned int>(offset & block_size_m);
-        unsigned int idx1 =
-            static_cast<unsigned int>((offset + length) & block_size_m);
-        BlockType lower_mask = masks2[idx0];
-        BlockType upper_mask = masks[idx1];
-        uint64_t cnt[4] = {0, 0, 0, 0};
-        uint64_t nmid, rem, max;
+    /////////////////////
+    // Combined Counts //
+    /////////////////////
 
-        if (length <= bits_per_block &&
-            (idx0 < idx1 || idx0 + idx1 == 0 || (idx0 > idx1 && idx1 == 0))) {
-            return popcount(bits[block_idx] & fb.bits[block_idx] & lower_mask &
-                            upper_mask);
-        } else {
-            nmid = (length - 1) >> BLOCK_SHIFT;
-            if (idx0 < idx1 || idx0 == 0 || idx1 == 0)
-                nmid--;
-            rem = nmid & 3;
-            max = nmid - rem;
-
-#ifdef AVX2_ENABLED
-            if (max && n >= 4096) {
-                uint64_t __attribute__((unused)) *cntp = &cnt[0];
-                unsigned char mask = 0xf;
-                asm volatile(
-                    "movq %4, %%rax			\n\t"
-                    "movq %3, %%rcx			\n\t"
-                    "vzeroall			\n\t"
-                    "vmovdqu (%5), %%ymm2		\n\t" // lookup in ymm2
-                    "vpbroadcastb (%6), %%ymm3	\n\t" // low_mask in ymm3
-
-                    "forloop%=:			\n\t"
-                    "vmovdqu (%1,%%rcx,8), %%ymm0	\n\t"
-                    "vmovdqu (%2,%%rcx,8), %%ymm1	\n\t"
-                    "vpand %%ymm0, %%ymm1, %%ymm0	\n\t" // a & b in ymm0
-
-                    "vpand %%ymm0, %%ymm3, %%ymm4	\n\t" // lo in ymm4
-                    "vpsrlw $4, %%ymm0, %%ymm5	\n\t"         // hi in ymm5
-                    "vpand %%ymm5, %%ymm3, %%ymm5	\n\t"
-
-                    "vpshufb %%ymm4, %%ymm2, %%ymm4	\n\t" // p1 in ymm4
-                    "vpshufb %%ymm5, %%ymm2, %%ymm5	\n\t" // p2 in ymm5
-
-                    "vpaddb %%ymm4, %%ymm5, %%ymm5	\n\t" // sum in ymm5
-                    "vpsadbw %%ymm5, %%ymm7, %%ymm5	\n\t"
-                    "vpaddq %%ymm5, %%ymm6, %%ymm6	\n\t" // total in ymm6
-
-                    "addq $4, %%rcx			\n\t"
-                    "cmpq %%rax, %%rcx		\n\t"
-                    "jl forloop%=			\n\t"
-
-                    "vmovdqu %%ymm6, (%0)		\n\t" // result in cnt
-                    : "+r"(cntp)
-                    : "r"(bits), "r"(fb.bits), "r"(block_idx + 1),
-                      "r"(max + block_idx), "r"(avx_table), "r"(&mask)
-                    : "%rax", "%rcx", "memory");
-            } else
-#endif
-            {
-                for (uint64_t i = 1; i <= max; i += 4) {
-                    asm volatile(
-                        "popcntq %4, %4	\n\t"
-                        "addq %4, %0	\n\t"
-                        "popcntq %5, %5	\n\t"
-                        "addq %5, %1	\n\t"
-                        "popcntq %6, %6	\n\t"
-                        "addq %6, %2	\n\t"
-                        "popcntq %7, %7	\n\t"
-                        "addq %7, %3	\n\t"
-                        : "+r"(cnt[0]), "+r"(cnt[1]), "+r"(cnt[2]), "+r"(cnt[3])
-                        : "r"(bits[block_idx + i] & fb.bits[block_idx + i]),
-                          "r"(bits[block_idx + i + 1] &
-                              fb.bits[block_idx + i + 1]),
-                          "r"(bits[block_idx + i + 2] &
-                              fb.bits[block_idx + i + 2]),
-                          "r"(bits[block_idx + i + 3] &
-                              fb.bits[block_idx + i + 3]));
-                }
-            }
+    // These count the bits in a combination of two bitsets, without
+    // modifying either one or allocating a temporary bitset
+    // Each makes a single pass using the fastest version supported at
+    // runtime, so it reads half as much memory as a copy followed by a
+    // set operation and count_bits()
+    // As with the set operations, only the first min(nb, fb.nb) blocks
+    // are used
+
+    // Inner product, or size of the intersection
+    inline uint64_t vecprod(const FastBitset &fb) const {
+        return count_combined<0xc0>(fb);
+    }
 
-            if (rem)
-                for (uint64_t i = max + 1; i <= nmid; i++)
-                    cnt[0] +=
-                        popcount(bits[block_idx + i] & fb.bits[block_idx + i]);
+    // Inner product using the Harley-Seal method, as in count_v4()
+    inline uint64_t vecprod_v2(const FastBitset &fb) const {
+        return count_vectors_hs<0xc0>(bits, fb.bits, std::min(nb, fb.nb));
+    }
 
-            cnt[1] +=
-                popcount(bits[block_idx] & fb.bits[block_idx] & lower_mask) +
-                popcount(bits[block_idx + nmid + 1] &
-                         fb.bits[block_idx + nmid + 1] & upper_mask);
-        }
+    inline uint64_t count_union(const FastBitset &fb) const {
+        return count_combined<0xfc>(fb);
+    }
 
-        return cnt[0] + cnt[1] + cnt[2] + cnt[3];
+    inline uint64_t count_disjoint_union(const FastBitset &fb) const {
+        return count_combined<0x3c>(fb);
     }
 
-// Same as the above, optimized for AVX-512
-#ifdef AVX512_ENABLED
-    inline uint64_t partial_vecprod_avx512(const FastBitset &fb,
-                                           uint64_t offset, uint64_t length) {
-        uint64_t block_idx = offset >> BLOCK_SHIFT;
-        unsigned int idx0 = static_cast<unsigned int>(offset & block_size_m);
-        unsigned int idx1 =
-            static_cast<unsigned int>((offset + length) & block_size_m);
-        BlockType lower_mask = masks2[idx0];
-        BlockType upper_mask = masks[idx1];
-        uint64_t cnt[8] = {0, 0, 0, 0, 0, 0, 0, 0};
-        uint64_t nmid, rem, max;
+    inline uint64_t count_difference(const FastBitset &fb) const {
+        return count_combined<0x30>(fb);
+    }
 
-        if (length <= bits_per_block &&
-            (idx0 < idx1 || idx0 + idx1 == 0 || (idx0 > idx1 && idx1 == 0))) {
-            return popcount(bits[block_idx] & fb.bits[block_idx] & lower_mask &
-                            upper_mask);
-        } else {
-            nmid = (length - 1) >> BLOCK_SHIFT;
-            if (idx0 < idx1 || idx0 == 0 || idx1 == 0)
-                nmid--;
-            rem = nmid & 7;
-            max = nmid - rem;
-
-            if (max && n >= 8192) {
-                uint64_t __attribute__((unused)) *cntp = &cnt[0];
-                unsigned char mask = 0xf;
-                asm volatile(
-                    "movq %4, %%rax				\n\t"
-                    "movq %3, %%rcx				\n\t"
-                    "vzeroall				\n\t"
-                    "vmovdqu64 (%5), %%zmm2			\n\t" // lookup
-                                                                      // in zmm2
-                    "vpbroadcastb (%6), %%zmm3		\n\t" // low_mask in
-                                                              // zmm3
-
-                    "forloop%=:				\n\t"
-                    "vmovdqu64 (%1,%%rcx,8), %%zmm0		\n\t"
-                    "vmovdqu64 (%2,%%rcx,8), %%zmm1		\n\t"
-                    "vpandd %%zmm0, %%zmm1, %%zmm0		\n\t" // a & b
-                                                                      // in zmm0
-
-                    "vpandd %%zmm0, %%zmm3, %%zmm4		\n\t" // lo in
-                                                                      // zmm4
-                    "vpsrld $4, %%zmm0, %%zmm5		\n\t" // hi in zmm5
-                    "vpandd %%zmm5, %%zmm3, %%zmm5		\n\t"
-
-                    "vpshufb %%zmm4, %%zmm2, %%zmm4		\n\t" // p1 in
-                                                                      // zmm4
-                    "vpshufb %%zmm5, %%zmm2, %%zmm5		\n\t" // p2 in
-                                                                      // zmm5
-
-                    "vpaddb %%zmm4, %%zmm5, %%zmm5		\n\t" // sum in
-                                                                      // zmm5
-                    "vpsadbw %%zmm5, %%zmm7, %%zmm5		\n\t"
-                    "vpaddq %%zmm5, %%zmm6, %%zmm6		\n\t" // total
-                                                                      // in zmm6
-
-                    "addq $8, %%rcx				\n\t"
-                    "cmpq %%rax, %%rcx			\n\t"
-                    "jl forloop%=				\n\t"
-
-                    "vmovdqu64 %%zmm6, (%0)			\n\t" // result
-                                                                      // in cnt
-                    : "+r"(cntp)
-                    : "r"(bits), "r"(fb.bits), "r"(block_idx + 1),
-                      "r"(max + block_idx), "r"(avx512_table), "r"(&mask)
-                    : "%rax", "%rcx", "memory");
-            } else {
-                for (uint64_t i = 1; i <= max; i += 4) {
-                    asm volatile(
-                        "popcntq %4, %4	\n\t"
-                        "addq %4, %0	\n\t"
-                        "popcntq %5, %5	\n\t"
-                        "addq %5, %1	\n\t"
-                        "popcntq %6, %6	\n\t"
-                        "addq %6, %2	\n\t"
-                        "popcntq %7, %7	\n\t"
-                        "addq %7, %3	\n\t"
-                        : "+r"(cnt[0]), "+r"(cnt[1]), "+r"(cnt[2]), "+r"(cnt[3])
-                        : "r"(bits[block_idx + i] & fb.bits[block_idx + i]),
-                          "r"(bits[block_idx + i + 1] &
-                              fb.bits[block_idx + i + 1]),
-                          "r"(bits[block_idx + i + 2] &
-                              fb.bits[block_idx + i + 2]),
-                          "r"(bits[block_idx + i + 3] &
-                              fb.bits[block_idx + i + 3]));
-                }
-            }
+    // Number of positions at which the two bitsets differ
+    inline uint64_t hamming(const FastBitset &fb) const {
+        return count_disjoint_union(fb);
+    }
+
+    // Jaccard index |A & B| / |A | B|, defined as 1 if both are empty
+    inline double jaccard(const FastBitset &fb) const {
+        uint64_t nunion = count_union(fb);
+        return nunion ? (double)vecprod(fb) / nunion : 1.0;
+    }
 
-            if (rem)
-                for (uint64_t i = max + 1; i <= nmid; i++)
-                    cnt[i - max - 1] +=
-                        popcount(bits[block_idx + i] & fb.bits[block_idx + i]);
+    /////////////////////////
+    // Parallel Operations //
+    /////////////////////////
 
-            cnt[7] +=
-                popcount(bits[block_idx] & fb.bits[block_idx] & lower_mask) +
-                popcount(bits[block_idx + nmid + 1] &
-                         fb.bits[block_idx + nmid + 1] & upper_mask);
-        }
+    // These split the blocks into one chunk per OpenMP thread and apply
+    // the fastest version of the operation to each chunk, so that a
+    // single large bitset can use the memory bandwidth of every core
+    // Chunks are a whole number of cache lines, so threads never write
+    // to the same line
+    // Bitsets with fewer than 'parallel_threshold' blocks use one thread,
+    // since starting the threads would cost more than the operation
 
-        return cnt[0] + cnt[1] + cnt[2] + cnt[3] + cnt[4] + cnt[5] + cnt[6] +
-               cnt[7];
+    inline void setIntersection_parallel(const FastBitset &fb) {
+        parallel_set_operation(&FastBitset::setIntersection, fb);
     }
-#endif
 
-// Intended for use with small bitsets, up to 256 bits
-#ifdef AVX2_ENABLED
-    inline uint64_t partial_vecprod_small(const FastBitset &fb, uint64_t i,
-                                          uint64_t j) {
+    inline void setUnion_parallel(const FastBitset &fb) {
+        parallel_set_operation(&FastBitset::setUnion, fb);
+    }
+
+    inline void setDisjointUnion_parallel(const FastBitset &fb) {
+        parallel_set_operation(&FastBitset::setDisjointUnion, fb);
+    }
+
+    inline void setDifference_parallel(const FastBitset &fb) {
+        parallel_set_operation(&FastBitset::setDifference, fb);
+    }
+
+    inline uint64_t count_parallel() const {
+        if (nb < parallel_threshold)
+            return count_bits();
+
+        uint64_t num_set = 0;
+#ifdef _OPENMP
+#pragma omp parallel reduction(+ : num_set)
+#endif
+        {
+            uint64_t begin, length;
+            get_chunk(nb, begin, length);
+            if (length)
+                num_set += FastBitset(bits + begin, length << BLOCK_SHIFT,
+                                      length)
+                               .count_bits();
+        }
+        return num_set;
+    }
+
+    // Same as clone(fb), with the copy split across threads
+    inline void clone_parallel(FastBitset &fb) const {
+        fb.n = n;
+        fb.nb = nb;
+        fb.nr = nr;
+        if (nb < parallel_threshold) {
+            memcpy(fb.bits, bits, sizeof(BlockType) * nb);
+            return;
+        }
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        {
+            uint64_t begin, length;
+            get_chunk(nb, begin, length);
+            memcpy(fb.bits + begin, bits + begin, sizeof(BlockType) * length);
+        }
+    }
+
+    // Same as reset(), with the blocks split across threads
+    inline void reset_parallel() {
+        if (nb < parallel_threshold) {
+            reset();
+            return;
+        }
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        {
+            uint64_t begin, length;
+            get_chunk(nb, begin, length);
+            memset(bits + begin, 0, sizeof(BlockType) * length);
+        }
+    }
+
+    /////////////////////////
+    // Set Bit Enumeration //
+    /////////////////////////
+
+    // These visit the set bits in increasing order, decoding one block
+    // at a time, so enumerating k bits costs O(nb + k) instead of one
+    // next_bit() scan per bit
+    // The function is called as f(idx) for the index of each set bit
+
+    template <class Function>
+    inline Function for_each_set_bit(Function f) const {
+        for (uint64_t i = 0; i < nb; i++)
+            for (BlockType v = bits[i]; v; v &= v - 1)
+                f((i << BLOCK_SHIFT) + __builtin_ctzl(v));
+        return f;
+    }
+
+    // Visit the bits set in the range [offset, offset + length)
+    // NOTE: The offset and the length are for bits, not blocks
+    template <class Function>
+    inline Function for_each_set_bit(uint64_t offset, uint64_t length,
+                                     Function f) const {
+        if (!length)
+            return f;
+        uint64_t first = offset >> BLOCK_SHIFT;
+        uint64_t last = (offset + length - 1) >> BLOCK_SHIFT;
+        for (uint64_t i = first; i <= last; i++)
+            for (BlockType v = masked_block(i, offset, length); v; v &= v - 1)
+                f((i << BLOCK_SHIFT) + __builtin_ctzl(v));
+        return f;
+    }
+
+    // The blocks are split across OpenMP threads as in the parallel
+    // operations, so 'f' is called concurrently and in no particular
+    // order; each thread uses its own copy of 'f'
+    template <class Function>
+    inline void for_each_set_bit_parallel(Function f) const {
+        if (nb < parallel_threshold) {
+            for_each_set_bit(f);
+            return;
+        }
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        {
+            uint64_t begin, length;
+            get_chunk(nb, begin, length);
+            for_each_set_bit(begin << BLOCK_SHIFT, length << BLOCK_SHIFT, f);
+        }
+    }
+
+    // Write the index of each set bit to 'out' in increasing order, and
+    // return the number written; 'out' must have room for count_bits()
+    // Blocks with eight or more bits set are decoded with vpcompressq
+    // if AVX-512 is supported
+    inline uint64_t extract_indices(uint64_t *out) const {
+        return extract_indices(out, 0, nb << BLOCK_SHIFT);
+    }
+
+    // Extract the bits set in the range [offset, offset + length)
+    // NOTE: The offset and the length are for bits, not blocks
+    inline uint64_t extract_indices(uint64_t *out, uint64_t offset,
+                                    uint64_t length) const {
+        if (!length)
+            return 0;
+        uint64_t first = offset >> BLOCK_SHIFT;
+        uint64_t last = (offset + length - 1) >> BLOCK_SHIFT;
+        uint64_t *end = out;
+
+#if FBALIGN == 512
+        if (getSimdLevel() >= SIMD_AVX512) {
+            for (uint64_t i = first; i <= last; i++) {
+                BlockType v = masked_block(i, offset, length);
+                if (!v)
+                    continue;
+
+                // Blocks with fewer than eight bits are faster in scalar code
+                uint64_t cnt;
+                asm("popcntq %1, %0" : "=r"(cnt) : "r"(v));
+                if (cnt < 8)
+                    end = extract_block(v, i << BLOCK_SHIFT, end);
+                else
+                    end = extract_block_avx512(v, i << BLOCK_SHIFT, end);
+            }
+            return end - out;
+        }
+#endif
+
+        for (uint64_t i = first; i <= last; i++)
+            end = extract_block(masked_block(i, offset, length),
+                                i << BLOCK_SHIFT, end);
+        return end - out;
+    }
+
+    // Same as extract_indices(out), with the blocks split across threads
+    // Each thread counts its chunk, and then writes its indices after
+    // those of the preceding chunks
+    inline uint64_t extract_indices_parallel(uint64_t *out) const {
+        if (nb < parallel_threshold)
+            return extract_indices(out);
+
+#ifdef _OPENMP
+        uint64_t nthreads = omp_get_max_threads();
+#else
+        uint64_t nthreads = 1;
+#endif
+        std::vector<uint64_t> offsets(nthreads + 1, 0);
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        {
+            uint64_t begin, length;
+            get_chunk(nb, begin, length);
+#ifdef _OPENMP
+            uint64_t thread = omp_get_thread_num();
+#else
+            uint64_t thread = 0;
+#endif
+            if (length)
+                offsets[thread + 1] =
+                    FastBitset(bits + begin, length << BLOCK_SHIFT, length)
+                        .count_bits();
+
+#ifdef _OPENMP
+#pragma omp barrier
+#pragma omp single
+#endif
+            for (uint64_t i = 0; i < nthreads; i++)
+                offsets[i + 1] += offsets[i];
+
+            extract_indices(out + offsets[thread], begin << BLOCK_SHIFT,
+                            length << BLOCK_SHIFT);
+        }
+
+        return offsets[nthreads];
+    }
+
+    ///////////////////////////
+    // Partial Inner Product //
+    ///////////////////////////
+
+    // This combines the set intersection with a SIMD implementation of
+    // the popcnt algorithm
+    // In general, this should be faster than
+    // a setIntersection() followed by count_bits()
+    // The fastest version supported at runtime is used
+    inline uint64_t partial_vecprod(const FastBitset &fb, uint64_t offset,
+                                    uint64_t length) const {
+        if (!length)
+            return 0;
+        uint64_t b0 = offset >> BLOCK_SHIFT;
+        uint64_t b1 = (offset + length - 1) >> BLOCK_SHIFT;
+        BlockType lower_mask = mask_table2[offset & block_size_m];
+        BlockType upper_mask = mask_table[(offset + length) & block_size_m];
+
+        if (b0 == b1)
+            return popcount(bits[b0] & fb.bits[b0] & lower_mask & upper_mask);
+        return popcount(bits[b0] & fb.bits[b0] & lower_mask) +
+               popcount(bits[b1] & fb.bits[b1] & upper_mask) +
+               count_vectors<0xc0>(bits + b0 + 1, fb.bits + b0 + 1,
+                                   b1 - b0 - 1);
+    }
+
+    // Same as the above, which now selects the AVX-512 kernels itself
+    // This is kept for compatibility
+    inline uint64_t partial_vecprod_avx512(const FastBitset &fb,
+                                           uint64_t offset,
+                                           uint64_t length) const {
+        return partial_vecprod(fb, offset, length);
+    }
+
+// Intended for use with small bitsets, up to 256 bits
+#if FBALIGN >= 256
+    inline uint64_t partial_vecprod_small(const FastBitset &fb, uint64_t i,
+                                          uint64_t j) {
         uint64_t block0 = i >> BLOCK_SHIFT;
         uint64_t block1 = j >> BLOCK_SHIFT;
         uint64_t idx0 = i & block_size_m;
@@ -949,34 +1546,34 @@ class FastBitset {
 
         // First 64 Bits
         uint64_t bits0 = (bits[0] & fb.bits[0]);
-        bits0 &= (~0ULL >> ((!!block0) << 6)) & masks2[idx0];
-        bits0 &= (~0ULL << ((!block1) << 6)) | masks[idx1];
+        bits0 &= (~0ULL >> ((!!block0) << 6)) & mask_table2[idx0];
+        bits0 &= (~0ULL << ((!block1) << 6)) | mask_table[idx1];
         cnt[0] = popcount(bits0);
 
         // Second 64 bits
         uint64_t bits1 = (bits[1] & fb.bits[1]);
-        uint64_t msk1L = (~0ULL >> ((block0 == 1) << 6)) | masks2[idx0];
+        uint64_t msk1L = (~0ULL >> ((block0 == 1) << 6)) | mask_table2[idx0];
         msk1L &= ~0ULL >> ((block0 > 1) << 6);
         bits1 &= msk1L;
-        uint64_t msk1U = (~0ULL << ((block1 == 1) << 6)) | masks[idx1];
+        uint64_t msk1U = (~0ULL << ((block1 == 1) << 6)) | mask_table[idx1];
         msk1U &= ~0ULL >> ((block1 < 1) << 6);
         bits1 &= msk1U;
         cnt[1] = popcount(bits1);
 
         // Third 64 bits
         uint64_t bits2 = (bits[2] & fb.bits[2]);
-        uint64_t msk2L = (~0ULL >> ((block0 == 2) << 6)) | masks2[idx0];
+        uint64_t msk2L = (~0ULL >> ((block0 == 2) << 6)) | mask_table2[idx0];
         msk2L &= ~0ULL >> ((block0 > 2) << 6);
         bits1 &= msk2L;
-        uint64_t msk2U = (~0ULL << ((block1 == 2) << 6)) | masks[idx1];
+        uint64_t msk2U = (~0ULL << ((block1 == 2) << 6)) | mask_table[idx1];
         msk2U &= ~0ULL >> ((block1 < 2) << 6);
         bits1 &= msk2U;
         cnt[2] = popcount(bits2);
 
         // Fourth 64 bits
         uint64_t bits3 = (bits[3] & fb.bits[3]);
-        bits3 &= (~0ULL >> ((block0 == 3) << 6)) | masks2[idx0];
-        bits3 &= (~0ULL << ((block1 < 3) << 6)) & masks[idx1];
+        bits3 &= (~0ULL >> ((block0 == 3) << 6)) | mask_table2[idx0];
+        bits3 &= (~0ULL << ((block1 < 3) << 6)) & mask_table[idx1];
         cnt[3] = popcount(bits3);
 
         return cnt[0] + cnt[1] + cnt[2] + cnt[3];
@@ -987,29 +1584,56 @@ class FastBitset {
     // Shift Operations //
     //////////////////////
 
-    // Note: we require 0 < shift < 64
-    inline void shift_left(FastBitset &workspace, unsigned shift) {
-        workspace.bits[nb - 1] = 0;
-        for (uint64_t i = nb - 1; i > 0; i--) {
-            workspace.bits[i - 1] = masks[shift];
-            workspace.bits[i - 1] &= bits[i];
-            bits[i] >>= shift;
-            bits[i] |= workspace.bits[i] << (64 - shift);
+    // Shift every bit 'shift' places toward index zero, in place
+    // Bits shifted past either end are lost, and any distance is allowed
+    // Whole blocks are moved, and the remaining sub-block shift combines
+    // each block with its neighbour, 8 (AVX-512) or 4 (AVX2) at a time
+    inline void shift_left(uint64_t shift) {
+        if (shift >= n) {
+            reset();
+            return;
+        }
+
+        uint64_t q = shift >> BLOCK_SHIFT;
+        unsigned int r = static_cast<unsigned int>(shift & block_size_m);
+        uint64_t len = nb - q; // Number of blocks which receive bits
+        if (!r) {
+            memmove(bits, bits + q, sizeof(BlockType) * len);
+        } else {
+            funnel(bits, bits + q, len - 1, r);
+            bits[len - 1] = bits[nb - 1] >> r;
         }
-        bits[0] >>= shift;
-        bits[0] |= workspace.bits[0] << (64 - shift);
+        memset(bits + len, 0, sizeof(BlockType) * q);
     }
 
-    inline void shift_right(FastBitset &workspace, unsigned shift) {
-        workspace.bits[0] = 0;
-        for (uint64_t i = 0; i < nb - 1; i++) {
-            workspace.bits[i + 1] = masks[shift] << (64 - shift);
-            workspace.bits[i + 1] &= bits[i];
-            bits[i] <<= shift;
-            bits[i] |= workspace.bits[i] >> (64 - shift);
+    // Shift every bit 'shift' places away from index zero, in place
+    inline void shift_right(uint64_t shift) {
+        if (shift >= n) {
+            reset();
+            return;
         }
-        bits[nb - 1] <<= shift;
-        bits[nb - 1] |= workspace.bits[nb - 1] >> (64 - shift);
+
+        uint64_t q = shift >> BLOCK_SHIFT;
+        unsigned int r = static_cast<unsigned int>(shift & block_size_m);
+        if (!r) {
+            memmove(bits + q, bits, sizeof(BlockType) * (nb - q));
+        } else {
+            // Blocks above 'q' take bits from two source blocks
+            funnel_down(bits + q + 1, bits, nb - q - 1, 64 - r);
+            bits[q] = bits[0] << r;
+        }
+        memset(bits, 0, sizeof(BlockType) * q);
+        trim();
+    }
+
+    // These older versions require 0 < shift < 64, and no longer use the
+    // workspace
+    inline void shift_left(FastBitset &, unsigned shift) {
+        shift_left((uint64_t)shift);
+    }
+
+    inline void shift_right(FastBitset &, unsigned shift) {
+        shift_right((uint64_t)shift);
     }
 
     /////////////////////
@@ -1022,147 +1646,155 @@ class FastBitset {
         bits[blockidx] ^= fb.bits[blockidx];
     }
 
-    // We require workspace.size() >= 2
+    // These older versions no longer use the workspaces, and accept
+    // ranges of any length
     inline void swap_range(FastBitset &fb, uint64_t offset0, uint64_t offset1,
-                           uint64_t length, FastBitset &workspace0,
-                           FastBitset &workspace1, FastBitset &workspace2) {
-        // 1. Copy bits into the workspace
-        this->clone(workspace0);
-
-        // 2. Copy fb.bits into the workspace
-        fb.clone(workspace1);
-
-        // 3. Align the ranges of bits on offset0
-        if (offset0 < offset1) // Shift left
-            workspace1.shift_left(workspace2, offset1 - offset0);
-        else if (offset0 > offset1) // Shift right
-            workspace1.shift_right(workspace2, offset0 - offset1);
-
-        // 4. Block indices and masks
-        uint64_t block_idx = offset0 >> BLOCK_SHIFT;
-        unsigned int idx0 = static_cast<unsigned int>(offset0 & block_size_m);
-        unsigned int idx1 =
-            static_cast<unsigned int>((offset0 + length) & block_size_m);
-        BlockType lower_mask = masks2[idx0];
-        BlockType upper_mask = masks[idx1];
-
-        // 5. Do the swap
-        if (length <= bits_per_block &&
-            (idx0 < idx1 || idx0 + idx1 == 0 || (idx0 > idx1 && idx1 == 0))) {
-            // 5a. Mask the unused bits in the workspace
-            workspace0.bits[block_idx] &= lower_mask & upper_mask;
-            workspace1.bits[block_idx] &= lower_mask & upper_mask;
-
-            // 5b. Mask the range being swapped in 'bits'
-            bits[block_idx] &= ~(lower_mask & upper_mask);
-
-            // 5c. Insert the swapped bits using OR
-            bits[block_idx] |= workspace1.bits[block_idx];
-
-            // 5d. Mask the range being swapped in 'fb.bits'
-            workspace1.reset();
-            workspace1.bits[block_idx] |= lower_mask & upper_mask;
-            if (offset0 < offset1)
-                workspace1.shift_right(workspace2, offset1 - offset0);
-            else
-                workspace1.shift_left(workspace2, offset0 - offset1);
-            workspace1.flip();
-
-            // 5e. Mask the range in 'fb.bits'
-            fb.setIntersection(workspace1);
-
-            // 5f. Insert the swapped bits
-            if (offset0 < offset1)
-                workspace0.shift_right(workspace1, offset1 - offset0);
-            else
-                workspace0.shift_left(workspace1, offset0 - offset1);
-            fb.setUnion(workspace0);
-        } else {
-            fprintf(stderr, "This is not supported.\n");
-            fflush(stderr);
-            assert(false);
-        }
+                           uint64_t length, FastBitset &, FastBitset &,
+                           FastBitset &) {
+        swap_range(fb, offset0, offset1, length);
     }
 
     inline void swap_range_v2(FastBitset &fb, uint64_t offset0,
-                              uint64_t offset1, uint64_t length,
-                              FastBitset &workspace0, FastBitset &workspace1,
-                              FastBitset &workspace2) {
-        // 1. Copy bits into the workspaces
-        this->clone(workspace0);
-        fb.clone(workspace1);
-
-        // 2. Shift the target bits to their new positions
-        if (offset1 < offset0) {
-            workspace0.shift_left(workspace2, offset0 - offset1);
-            workspace1.shift_right(workspace2, offset0 - offset1);
-        } else {
-            workspace0.shift_right(workspace2, offset1 - offset0);
-            workspace1.shift_left(workspace2, offset1 - offset0);
+                              uint64_t offset1, uint64_t length, FastBitset &,
+                              FastBitset &, FastBitset &) {
+        swap_range(fb, offset0, offset1, length);
+    }
+
+    //////////////////////////
+    // Bit Range Operations //
+    //////////////////////////
+
+    // These move 'length' bits between arbitrary bit offsets, and only
+    // touch the blocks in the ranges involved. Blocks in the middle of a
+    // range are copied with the funnel shift kernels (or memmove, when
+    // the offsets are equally aligned), and the blocks at either end are
+    // merged with masks.
+    // NOTE: The offsets and the length are for bits, not blocks
+
+    // Copy the bits [src, src + length) of 'fb' over the bits
+    // [dst, dst + length) of this bitset
+    // The ranges may overlap if 'fb' is this bitset
+    inline void copy_range(const FastBitset &fb, uint64_t src, uint64_t dst,
+                           uint64_t length) {
+        if (!length)
+            return;
+
+        uint64_t d0 = dst >> BLOCK_SHIFT;
+        uint64_t d1 = (dst + length - 1) >> BLOCK_SHIFT;
+        BlockType lower_mask = mask_table2[dst & block_size_m];
+        BlockType upper_mask = mask_table[(dst + length) & block_size_m];
+
+        // Source bit which lands on the first bit of block d0 + 1
+        uint64_t pos = src + ((d0 + 1) << BLOCK_SHIFT) - dst;
+        bool down = bits == fb.bits && dst > src;
+
+        if (d0 == d1) {
+            merge_block(d0, fetch(fb, src - (dst & block_size_m)),
+                        lower_mask & upper_mask);
+            return;
         }
 
-        // 3. Set up the masks
-        uint64_t block_idx0 = offset0 >> BLOCK_SHIFT;
-        uint64_t block_idx1 = offset1 >> BLOCK_SHIFT;
-        unsigned l_idx0 = offset0 & block_size_m;
-        unsigned l_idx1 = offset1 & block_size_m;
-        unsigned u_idx0 = (offset0 + length) & block_size_m;
-        unsigned u_idx1 = (offset1 + length) & block_size_m;
+        // Blocks are written in the direction which reads each source
+        // block before it could be overwritten
+        if (down)
+            merge_block(d1, fetch(fb, pos + ((d1 - d0 - 1) << BLOCK_SHIFT)),
+                        upper_mask);
+        else
+            merge_block(d0, fetch(fb, src - (dst & block_size_m)),
+                        lower_mask);
+
+        uint64_t nmid = d1 - d0 - 1;
+        BlockType *out = bits + d0 + 1;
+        const BlockType *in = fb.bits + (pos >> BLOCK_SHIFT);
+        unsigned int r = static_cast<unsigned int>(pos & block_size_m);
+        if (!r)
+            memmove(out, in, sizeof(BlockType) * nmid);
+        else if (down)
+            funnel_down(out, in, nmid, r);
+        else
+            funnel(out, in, nmid, r);
 
-        BlockType l_mask0 = masks2[l_idx0];
-        BlockType l_mask1 = masks2[l_idx1];
-        BlockType u_mask0 = masks[u_idx0];
-        BlockType u_mask1 = masks[u_idx1];
+        if (down)
+            merge_block(d0, fetch(fb, src - (dst & block_size_m)),
+                        lower_mask);
+        else
+            merge_block(d1, fetch(fb, pos + ((d1 - d0 - 1) << BLOCK_SHIFT)),
+                        upper_mask);
+    }
 
-        // 4. Single-block swap
-        if (length <= bits_per_block &&
-            (l_idx0 < u_idx0 || l_idx0 + u_idx0 == 0 ||
-             (l_idx0 > u_idx0 && u_idx0 == 0)) &&
-            (l_idx1 < u_idx1 || l_idx1 + u_idx1 == 0 ||
-             (l_idx1 > u_idx1 && u_idx1 == 0))) {
-            // 4a. Apply the masks
-            workspace0.bits[block_idx1] &= l_mask1 & u_mask1;
-            workspace1.bits[block_idx0] &= l_mask0 & u_mask0;
-            bits[block_idx0] &= ~(l_mask0 & u_mask0);
-            fb.bits[block_idx1] &= ~(l_mask1 & u_mask1);
-
-            // 4b. Insert the copied bits
-            bits[block_idx0] |= workspace1.bits[block_idx0];
-            fb.bits[block_idx1] |= workspace0.bits[block_idx1];
-        } else {
-            // 5. Multiple-block swap
-            uint64_t nmid0 = (length - 1) >> BLOCK_SHIFT, nmid1 = nmid0;
-            if (l_idx0 < u_idx0 || l_idx0 == 0 || u_idx0 == 0)
-                nmid0--;
-            if (l_idx1 < u_idx1 || l_idx1 == 0 || u_idx1 == 0)
-                nmid1--;
-
-            // 5a. Whole blocks
-            if (nmid1)
-                workspace0.clone(fb, block_idx1 + 1, nmid1);
-            if (nmid0)
-                workspace1.clone(*this, block_idx0 + 1, nmid0);
-
-            // 5b. Initial blocks
-            workspace0.bits[block_idx1] &= l_mask1;
-            workspace1.bits[block_idx0] &= l_mask0;
-            bits[block_idx0] &= ~l_mask0;
-            bits[block_idx0] |= workspace1.bits[block_idx0];
-            fb.bits[block_idx1] &= ~l_mask1;
-            fb.bits[block_idx1] |= workspace0.bits[block_idx1];
-
-            // 5c. Final blocks
-            workspace0.bits[block_idx1 + nmid1 + 1] &= u_mask1;
-            workspace1.bits[block_idx0 + nmid0 + 1] &= u_mask0;
-            bits[block_idx0 + nmid0 + 1] &= ~u_mask0;
-            bits[block_idx0 + nmid1 + 1] |=
-                workspace1.bits[block_idx0 + nmid0 + 1];
-            fb.bits[block_idx1 + nmid1 + 1] &= ~u_mask1;
-            fb.bits[block_idx1 + nmid1 + 1] |=
-                workspace0.bits[block_idx1 + nmid1 + 1];
+    // Same as copy_range(), after which the source bits which were not
+    // overwritten are reset
+    inline void move_range(FastBitset &fb, uint64_t src, uint64_t dst,
+                           uint64_t length) {
+        copy_range(fb, src, dst, length);
+        if (bits != fb.bits || src + length <= dst || dst + length <= src)
+            fb.reset_range(src, length);
+        else if (src < dst)
+            fb.reset_range(src, dst - src);
+        else if (dst < src)
+            fb.reset_range(dst + length, src - dst);
+    }
+
+    // Exchange the bits [offset0, offset0 + length) of this bitset with
+    // the bits [offset1, offset1 + length) of 'fb'
+    // The ranges must not overlap if 'fb' is this bitset
+    // Long ranges are exchanged through a 4 KB buffer on the stack
+    inline void swap_range(FastBitset &fb, uint64_t offset0, uint64_t offset1,
+                           uint64_t length) {
+        BlockType buffer[swap_blocks];
+        FastBitset tmp(buffer, swap_blocks << BLOCK_SHIFT, swap_blocks);
+        for (uint64_t done = 0; done < length; done += tmp.n) {
+            uint64_t m = std::min(length - done, tmp.n);
+            tmp.copy_range(*this, offset0 + done, 0, m);
+            copy_range(fb, offset1 + done, offset0 + done, m);
+            fb.copy_range(tmp, 0, offset1 + done, m);
         }
     }
 
+    //////////////////////////
+    // Range Set Operations //
+    //////////////////////////
+
+    // These change only the bits [offset, offset + length), as in
+    // partial_vecprod(): the blocks at either end are merged with masks,
+    // and the blocks between them use the same SIMD kernels as the full
+    // set operations. Unlike partial_intersection(), the bits outside the
+    // range are left unchanged.
+    // NOTE: The offset and length refer to bit indices, not blocks
+
+    // Set the bits in the range to one
+    inline void set_range(uint64_t offset, uint64_t length) {
+        fill_range(offset, length, ~(BlockType)0);
+    }
+
+    // Reset the bits in the range to zero
+    inline void reset_range(uint64_t offset, uint64_t length) {
+        fill_range(offset, length, 0);
+    }
+
+    // Flip the bits in the range
+    inline void flip_range(uint64_t offset, uint64_t length) {
+        range_operation<0x0f>(*this, offset, length);
+    }
+
+    // Union with the bits of 'fb' in the range
+    inline void partial_union(const FastBitset &fb, uint64_t offset,
+                              uint64_t length) {
+        range_operation<0xfc>(fb, offset, length);
+    }
+
+    // Disjoint union with the bits of 'fb' in the range
+    inline void partial_disjoint_union(const FastBitset &fb, uint64_t offset,
+                                       uint64_t length) {
+        range_operation<0x3c>(fb, offset, length);
+    }
+
+    // Difference with the bits of 'fb' in the range
+    inline void partial_difference(const FastBitset &fb, uint64_t offset,
+                                   uint64_t length) {
+        range_operation<0x30>(fb, offset, length);
+    }
+
     //----------//
     // Printing //
     //----------//
@@ -1187,26 +1819,41 @@ class FastBitset {
 
     static const size_t bits_per_block = sizeof(BlockType) * CHAR_BIT;
 
-  private:
-    BlockType masks[64]; // Masks used for partial-bitset functions
-    BlockType masks2[64];
+    // Number of blocks (1 MB) below which the parallel operations use
+    // only one thread
+    static const uint64_t parallel_threshold = 1 << 17;
+
+    // Number of blocks (1 KB) from which the counts use the
+    // Harley-Seal kernels, unless the vpopcntq instruction is available
+    static const uint64_t harley_seal_threshold = 1 << 7;
+
+    // Byte alignment of the bits, so that each group of FBALIGN bits
+    // never crosses an FBALIGN boundary
+    static const size_t alignment = FBALIGN / CHAR_BIT > sizeof(void *)
+                                        ? FBALIGN / CHAR_BIT
+                                        : sizeof(void *);
+
+  protected:
+    friend class BitMatrix;
+    friend class SparseBitset;
+
+    // View Constructor
+    // The bitset uses the memory at '_bits' but does not own it
+    FastBitset(BlockType *_bits, uint64_t _n, uint64_t _nb)
+        : bits(_bits), n(_n), nb(_nb), nr(_nb & 3), cap(_nb),
+          owner(false) {}
 
     inline void createBitset(BlockType *&_bits, uint64_t _n, uint64_t _nb) {
         try {
             n = _n;
             nb = _nb;
             nr = nb & 3; // Equivalent to nb % 4
-            _bits = (BlockType *)malloc(sizeof(BlockType) * nb);
-            if (_bits == NULL)
+            cap = nb;
+            _bits = NULL;
+            if (posix_memalign((void **)&_bits, alignment,
+                               sizeof(BlockType) * nb))
                 throw std::bad_alloc();
             memset(_bits, 0, sizeof(BlockType) * nb);
-
-            for (unsigned int i = 0; i < 64; i++) {
-                masks[i] = get_bitmask(i);
-                masks2[i] = ~masks[i];
-            }
-            masks[0] = (BlockType)(-1);
-            masks2[0] = masks[0];
         } catch (std::bad_alloc &) {
             fprintf(stderr, "Memory allocation failure in %s on line %d!\n",
                     __FILE__, __LINE__);
@@ -1223,8 +1870,10 @@ class FastBitset {
         n = 0;
         nb = 0;
         nr = 0;
+        cap = 0;
         if (_bits != NULL) {
-            free(_bits);
+            if (owner)
+                free(_bits);
             _bits = NULL;
         }
     }
@@ -1237,12 +1886,14 @@ class FastBitset {
     uint64_t n;             // Number of bits (not including padding)
     uint64_t nb;            // Number of blocks
     uint64_t nr;            // Remainder variable
+    uint64_t cap;           // Number of blocks allocated
+    bool owner;             // False if 'bits' is borrowed memory
 
     // Return the number of unsigned integers necessary to store '_n' bits
     // Note if AVX2 is being used, extra blocks may be allocated to enforce
     // 32-byte alignment However, the size of BlockType is not equal to
     // block_size in this case.
-    inline uint64_t get_num_blocks(uint64_t _n) {
+    static inline uint64_t get_num_blocks(uint64_t _n) {
         if (block_size == 512)
             return ((_n + block_size - 1) >> (BLOCK_SHIFT + 3)) << 3;
         else if (block_size == 256)
@@ -1268,6 +1919,647 @@ class FastBitset {
         return num;
     }
 
+    // Combines two blocks, or two vectors of blocks, using the truth
+    // table 'op', where 'a' is the first operand of vpternlogq and 'b'
+    // is both the second and third
+    // Vectors are passed by reference, since these are also called from
+    // code compiled without AVX
+    template <int op, class V>
+    __attribute__((always_inline)) static inline void
+    combine(const V &a, const V &b, V &v) {
+        switch (op) {
+        case 0xc0:
+            v = a & b;
+            break;
+        case 0xfc:
+            v = a | b;
+            break;
+        case 0x3c:
+            v = a ^ b;
+            break;
+        case 0x30:
+            v = a & ~b;
+            break;
+        case 0xf0:
+            v = a;
+            break;
+        case 0x0f:
+            v = ~a;
+            break;
+        default: {
+            V r = a ^ a;
+            if (op & 0x01)
+                r |= ~a & ~b;
+            if (op & 0x08)
+                r |= ~a & b;
+            if (op & 0x10)
+                r |= a & ~b;
+            if (op & 0x80)
+                r |= a & b;
+            v = r;
+        }
+        }
+    }
+
+    template <int op>
+    __attribute__((always_inline)) static inline BlockType
+    combine(const BlockType a, const BlockType b) {
+        BlockType v;
+        combine<op>(a, b, v);
+        return v;
+    }
+
+    // Count the bits in combine<op>() applied to each pair of blocks
+    template <int op>
+    inline uint64_t count_combined(const FastBitset &fb) const {
+        return count_vectors<op>(bits, fb.bits, std::min(nb, fb.nb));
+    }
+
+    //----------------//
+    // Vector Kernels //
+    //----------------//
+
+    // These stream through 'count' blocks using vectors of type V. Four
+    // vectors are handled per iteration, so that the loads of one are
+    // not waiting on the previous, followed by single vectors and then
+    // single blocks, so 'count' may be any number of blocks. The blocks
+    // are read with memcpy, which compiles to unaligned vector loads.
+    // The streams are sequential, so prefetching is left to the hardware.
+    // Each kernel is written once and compiled for each instruction set
+    // by the wrappers below, so the compiler schedules the loop itself,
+    // and any combination of the operands is inlined into it. They are
+    // always inlined, since GCC does not otherwise inline a function into
+    // one compiled for a different instruction set.
+
+    // Replaces each block a[i] with combine<op>(a[i], b[i])
+    // The arrays may be the same, but must not otherwise overlap
+    template <int op, class V>
+    __attribute__((always_inline)) static inline void
+    combine_blocks(BlockType *a, const BlockType *b, uint64_t count) {
+        const uint64_t w = sizeof(V) / sizeof(BlockType);
+        uint64_t i = 0;
+        for (; i + 4 * w <= count; i += 4 * w) {
+            for (uint64_t k = 0; k < 4; k++) {
+                V x, y;
+                memcpy(&x, a + i + k * w, sizeof(V));
+                memcpy(&y, b + i + k * w, sizeof(V));
+                combine<op>(x, y, x);
+                memcpy(a + i + k * w, &x, sizeof(V));
+            }
+        }
+        for (; i + w <= count; i += w) {
+            V x, y;
+            memcpy(&x, a + i, sizeof(V));
+            memcpy(&y, b + i, sizeof(V));
+            combine<op>(x, y, x);
+            memcpy(a + i, &x, sizeof(V));
+        }
+        for (; i < count; i++)
+            a[i] = combine<op>(a[i], b[i]);
+    }
+
+    // Counts the bits in combine<op>(a[i], b[i]), where P counts the bits
+    // in each lane of a vector (see PopcountAvx2)
+    // Each lane of the four accumulators holds its own sum
+    template <int op, class V, class P>
+    __attribute__((always_inline)) static inline uint64_t
+    count_blocks(const BlockType *a, const BlockType *b, uint64_t count) {
+        const uint64_t w = sizeof(V) / sizeof(BlockType);
+        V acc[4];
+        memset(acc, 0, sizeof(acc));
+        uint64_t i = 0;
+        for (; i + 4 * w <= count; i += 4 * w) {
+            for (uint64_t k = 0; k < 4; k++) {
+                V x, y;
+                memcpy(&x, a + i + k * w, sizeof(V));
+                memcpy(&y, b + i + k * w, sizeof(V));
+                combine<op>(x, y, x);
+                P::add(x, acc[k]);
+            }
+        }
+        for (; i + w <= count; i += w) {
+            V x, y;
+            memcpy(&x, a + i, sizeof(V));
+            memcpy(&y, b + i, sizeof(V));
+            combine<op>(x, y, x);
+            P::add(x, acc[0]);
+        }
+
+        BlockType lanes[4 * w];
+        memcpy(lanes, acc, sizeof(acc));
+        uint64_t num_set = 0;
+        for (uint64_t k = 0; k < 4 * w; k++)
+            num_set += lanes[k];
+        for (; i < count; i++)
+            num_set += popcount(combine<op>(a[i], b[i]));
+        return num_set;
+    }
+
+    // Carry-save adder: adds the bits of a, b, and c in each position,
+    // giving the high and low bits of the sum
+    template <class V>
+    __attribute__((always_inline)) static inline void
+    csa(V &high, V &low, const V &a, const V &b, const V &c) {
+        V u = a ^ b;
+        high = (a & b) | (u & c);
+        low = u ^ c;
+    }
+
+    // Adds two vectors of combined blocks to 'low' with a carry-save adder
+    template <int op, class V>
+    __attribute__((always_inline)) static inline void
+    csa_blocks(const BlockType *a, const BlockType *b, V &high, V &low) {
+        const uint64_t w = sizeof(V) / sizeof(BlockType);
+        V x, y, u, v;
+        memcpy(&x, a, sizeof(V));
+        memcpy(&y, b, sizeof(V));
+        memcpy(&u, a + w, sizeof(V));
+        memcpy(&v, b + w, sizeof(V));
+        combine<op>(x, y, x);
+        combine<op>(u, v, u);
+        csa(high, low, low, x, u);
+    }
+
+    // The same count as count_blocks(), using the Harley-Seal method
+    // Sixteen vectors are added with a tree of carry-save adders, so that
+    // only the vector of carries of weight 16 is counted, rather than all
+    // sixteen. The vectors of weight 1, 2, 4 and 8 still held are counted
+    // once at the end, and the rest of the blocks with count_blocks().
+    // This is only faster when P is a lookup table; vpopcntq counts a
+    // vector in fewer instructions than one adder
+    template <int op, class V, class P>
+    __attribute__((always_inline)) static inline uint64_t
+    count_blocks_hs(const BlockType *a, const BlockType *b, uint64_t count) {
+        const uint64_t w = sizeof(V) / sizeof(BlockType);
+        V total = {}, ones = {}, twos = {}, fours = {}, eights = {};
+        V twos_a, twos_b, fours_a, fours_b, eights_a, eights_b, sixteens;
+        uint64_t i = 0;
+        for (; i + 16 * w <= count; i += 16 * w) {
+            const BlockType *pa = a + i, *pb = b + i;
+            csa_blocks<op>(pa, pb, twos_a, ones);
+            csa_blocks<op>(pa + 2 * w, pb + 2 * w, twos_b, ones);
+            csa(fours_a, twos, twos, twos_a, twos_b);
+            csa_blocks<op>(pa + 4 * w, pb + 4 * w, twos_a, ones);
+            csa_blocks<op>(pa + 6 * w, pb + 6 * w, twos_b, ones);
+            csa(fours_b, twos, twos, twos_a, twos_b);
+            csa(eights_a, fours, fours, fours_a, fours_b);
+            csa_blocks<op>(pa + 8 * w, pb + 8 * w, twos_a, ones);
+            csa_blocks<op>(pa + 10 * w, pb + 10 * w, twos_b, ones);
+            csa(fours_a, twos, twos, twos_a, twos_b);
+            csa_blocks<op>(pa + 12 * w, pb + 12 * w, twos_a, ones);
+            csa_blocks<op>(pa + 14 * w, pb + 14 * w, twos_b, ones);
+            csa(fours_b, twos, twos, twos_a, twos_b);
+            csa(eights_b, fours, fours, fours_a, fours_b);
+            csa(sixteens, eights, eights, eights_a, eights_b);
+            P::add(sixteens, total);
+        }
+
+        V n1 = {}, n2 = {}, n4 = {}, n8 = {};
+        P::add(ones, n1);
+        P::add(twos, n2);
+        P::add(fours, n4);
+        P::add(eights, n8);
+        total = (total << 4) + (n8 << 3) + (n4 << 2) + (n2 << 1) + n1;
+
+        BlockType lanes[w];
+        memcpy(lanes, &total, sizeof(V));
+        uint64_t num_set = 0;
+        for (uint64_t k = 0; k < w; k++)
+            num_set += lanes[k];
+        return num_set + count_blocks<op, V, P>(a + i, b + i, count - i);
+    }
+
+    // Returns true if any of the blocks p[i] is nonzero, stopping after
+    // the first group of four vectors which has one
+    template <class V>
+    __attribute__((always_inline)) static inline bool
+    any_blocks(const BlockType *p, uint64_t count) {
+        const uint64_t w = sizeof(V) / sizeof(BlockType);
+        uint64_t i = 0;
+        for (; i + 4 * w <= count; i += 4 * w) {
+            V x, y;
+            memcpy(&x, p + i, sizeof(V));
+            for (uint64_t k = 1; k < 4; k++) {
+                memcpy(&y, p + i + k * w, sizeof(V));
+                x |= y;
+            }
+            BlockType lanes[w];
+            memcpy(lanes, &x, sizeof(V));
+            BlockType any_set = 0;
+            for (uint64_t k = 0; k < w; k++)
+                any_set |= lanes[k];
+            if (any_set)
+                return true;
+        }
+        BlockType any_set = 0;
+        for (; i < count; i++)
+            any_set |= p[i];
+        return !!any_set;
+    }
+
+    // The kernels compiled for each instruction set
+    // The scalar versions still use the popcnt instruction, as count_v3()
+    // always has
+
+    template <int op>
+    __attribute__((target("popcnt"))) static uint64_t
+    count_vectors_v1(const BlockType *a, const BlockType *b, uint64_t count) {
+        return count_blocks<op, BlockType, PopcountScalar>(a, b, count);
+    }
+
+#if FBALIGN >= 256
+    template <int op>
+    __attribute__((target("avx2,popcnt"))) static void
+    combine_vectors_v2(BlockType *a, const BlockType *b, uint64_t count) {
+        combine_blocks<op, BlockVector256>(a, b, count);
+    }
+
+    template <int op>
+    __attribute__((target("avx2,popcnt"))) static uint64_t
+    count_vectors_v2(const BlockType *a, const BlockType *b, uint64_t count) {
+        return count_blocks<op, BlockVector256, PopcountAvx2>(a, b, count);
+    }
+
+    template <int op>
+    __attribute__((target("avx2,popcnt"))) static uint64_t
+    count_vectors_hs_v2(const BlockType *a, const BlockType *b,
+                        uint64_t count) {
+        return count_blocks_hs<op, BlockVector256, PopcountAvx2>(a, b, count);
+    }
+
+    __attribute__((target("avx2,popcnt"))) static bool
+    any_vectors_v2(const BlockType *p, uint64_t count) {
+        return any_blocks<BlockVector256>(p, count);
+    }
+#endif
+
+#if FBALIGN == 512
+    template <int op>
+    __attribute__((target("avx512f,avx512bw,popcnt"))) static void
+    combine_vectors_avx512(BlockType *a, const BlockType *b,
+                           uint64_t count) {
+        combine_blocks<op, BlockVector512>(a, b, count);
+    }
+
+    template <int op>
+    __attribute__((target("avx512f,avx512bw,popcnt"))) static uint64_t
+    count_vectors_avx512(const BlockType *a, const BlockType *b,
+                         uint64_t count) {
+        return count_blocks<op, BlockVector512, PopcountAvx512>(a, b, count);
+    }
+
+    template <int op>
+    __attribute__((target("avx512f,avx512bw,popcnt"))) static uint64_t
+    count_vectors_hs_avx512(const BlockType *a, const BlockType *b,
+                            uint64_t count) {
+        return count_blocks_hs<op, BlockVector512, PopcountAvx512>(a, b,
+                                                                  count);
+    }
+
+    template <int op>
+    __attribute__((target("avx512f,avx512bw,avx512vpopcntdq,popcnt")))
+    static uint64_t count_vectors_vpopcnt(const BlockType *a,
+                                          const BlockType *b, uint64_t count) {
+        return count_blocks<op, BlockVector512, PopcountVpopcnt>(a, b, count);
+    }
+
+    __attribute__((target("avx512f,avx512bw,popcnt"))) static bool
+    any_vectors_avx512(const BlockType *p, uint64_t count) {
+        return any_blocks<BlockVector512>(p, count);
+    }
+#endif
+
+    // These use the fastest kernel supported at runtime
+
+    template <int op>
+    static inline void combine_vectors(BlockType *a, const BlockType *b,
+                                       uint64_t count) {
+#if FBALIGN == 512
+        if (getSimdLevel() >= SIMD_AVX512) {
+            combine_vectors_avx512<op>(a, b, count);
+            return;
+        }
+#endif
+#if FBALIGN >= 256
+        if (getSimdLevel() >= SIMD_AVX2) {
+            combine_vectors_v2<op>(a, b, count);
+            return;
+        }
+#endif
+        combine_blocks<op, BlockType>(a, b, count);
+    }
+
+    template <int op>
+    static inline uint64_t count_vectors(const BlockType *a,
+                                         const BlockType *b, uint64_t count) {
+#if FBALIGN == 512
+        if (getSimdLevel() >= SIMD_AVX512_VPOPCNT)
+            return count_vectors_vpopcnt<op>(a, b, count);
+        if (getSimdLevel() >= SIMD_AVX512)
+            return count >= harley_seal_threshold
+                       ? count_vectors_hs_avx512<op>(a, b, count)
+                       : count_vectors_avx512<op>(a, b, count);
+#endif
+#if FBALIGN >= 256
+        if (getSimdLevel() >= SIMD_AVX2)
+            return count >= harley_seal_threshold
+                       ? count_vectors_hs_v2<op>(a, b, count)
+                       : count_vectors_v2<op>(a, b, count);
+#endif
+        return count_vectors_v1<op>(a, b, count);
+    }
+
+    // The Harley-Seal kernels with the widest vectors supported at runtime
+    // The scalar version counts each block, since the adders take longer
+    // than the popcnt instruction
+    template <int op>
+    static inline uint64_t count_vectors_hs(const BlockType *a,
+                                            const BlockType *b,
+                                            uint64_t count) {
+#if FBALIGN == 512
+        if (getSimdLevel() >= SIMD_AVX512)
+            return count_vectors_hs_avx512<op>(a, b, count);
+#endif
+#if FBALIGN >= 256
+        if (getSimdLevel() >= SIMD_AVX2)
+            return count_vectors_hs_v2<op>(a, b, count);
+#endif
+        return count_vectors_v1<op>(a, b, count);
+    }
+
+    static inline bool any_vectors(const BlockType *p, uint64_t count) {
+#if FBALIGN == 512
+        if (getSimdLevel() >= SIMD_AVX512)
+            return any_vectors_avx512(p, count);
+#endif
+#if FBALIGN >= 256
+        if (getSimdLevel() >= SIMD_AVX2)
+            return any_vectors_v2(p, count);
+#endif
+        return any_blocks<BlockType>(p, count);
+    }
+
+    // Returns the range of blocks [begin, begin + length) handled by the
+    // calling thread when 'nblocks' blocks are split across the team
+    // Chunks are rounded up to whole cache lines, so the last threads
+    // may receive less than the others, or nothing at all
+    static inline void get_chunk(uint64_t nblocks, uint64_t &begin,
+                                 uint64_t &length) {
+#ifdef _OPENMP
+        uint64_t nthreads = omp_get_num_threads();
+        uint64_t thread = omp_get_thread_num();
+#else
+        uint64_t nthreads = 1;
+        uint64_t thread = 0;
+#endif
+        uint64_t line = 64 / sizeof(BlockType);
+        uint64_t chunk = (nblocks + nthreads - 1) / nthreads;
+        chunk = (chunk + line - 1) / line * line;
+        begin = std::min(thread * chunk, nblocks);
+        length = std::min(chunk, nblocks - begin);
+    }
+
+    // Applies a set operation to each thread's chunk of the bitsets
+    inline void
+    parallel_set_operation(void (FastBitset::*op)(const FastBitset &),
+                           const FastBitset &fb) {
+        uint64_t nmin = std::min(nb, fb.nb);
+        if (nmin < parallel_threshold) {
+            (this->*op)(fb);
+            return;
+        }
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        {
+            uint64_t begin, length;
+            get_chunk(nmin, begin, length);
+            if (length) {
+                FastBitset a(bits + begin, length << BLOCK_SHIFT, length);
+                FastBitset b(fb.bits + begin, length << BLOCK_SHIFT, length);
+                (a.*op)(b);
+            }
+        }
+    }
+
+    // Block 'i' with the bits outside [offset, offset + length) cleared
+    inline BlockType masked_block(uint64_t i, uint64_t offset,
+                                  uint64_t length) const {
+        BlockType v = bits[i];
+        if (i == offset >> BLOCK_SHIFT)
+            v &= mask_table2[offset & block_size_m];
+        if (i == (offset + length - 1) >> BLOCK_SHIFT)
+            v &= mask_table[(offset + length) & block_size_m];
+        return v;
+    }
+
+    // Write the indices of the bits set in 'v' to 'out', where 'base' is
+    // the index of its lowest bit, and return the end of the output
+    static inline uint64_t *extract_block(BlockType v, uint64_t base,
+                                          uint64_t *out) {
+        for (; v; v &= v - 1)
+            *out++ = base + __builtin_ctzl(v);
+        return out;
+    }
+
+#if FBALIGN == 512
+    // Each byte of 'v' selects up to eight lanes of the indices
+    // base + (0..7), which vpcompressq packs into the output
+    static inline uint64_t *extract_block_avx512(BlockType v, uint64_t base,
+                                                 uint64_t *out) {
+        asm volatile("vpbroadcastq %2, %%zmm0			\n\t"
+                     "vpaddq (%3), %%zmm0, %%zmm0		\n\t"
+                     "movl $8, %%ecx				\n\t"
+                     "vpbroadcastq %%rcx, %%zmm1		\n"
+                     "forloop%=:				\n\t"
+                     "movzbl %b1, %%eax			\n\t"
+                     "kmovw %%eax, %%k1			\n\t"
+                     "vpcompressq %%zmm0, (%0)%{%%k1%}		\n\t"
+                     "popcntl %%eax, %%eax			\n\t"
+                     "leaq (%0,%%rax,8), %0			\n\t"
+                     "vpaddq %%zmm1, %%zmm0, %%zmm0		\n\t"
+                     "shrq $8, %1				\n\t"
+                     "decl %%ecx				\n\t"
+                     "jnz forloop%=				\n\t"
+                     "vzeroupper				\n\t"
+                     : "+r"(out), "+r"(v)
+                     : "r"(base), "r"(lane_table)
+                     : "%rax", "%rcx", "%xmm0", "%xmm1",
+                       "memory" FASTBITSET_K1_CLOBBER);
+        return out;
+    }
+#endif
+
+    // Number of blocks in the buffer used by swap_range()
+    static const uint64_t swap_blocks = 512;
+
+    // Returns the 64 bits of 'fb' starting at bit 'pos', where 'pos' may
+    // be as low as -63 (wrapped around); bits outside 'fb' read as zero
+    static inline BlockType fetch(const FastBitset &fb, uint64_t pos) {
+        if ((int64_t)pos < 0)
+            return fb.bits[0] << (0 - pos);
+
+        uint64_t w = pos >> BLOCK_SHIFT;
+        unsigned int r = static_cast<unsigned int>(pos & block_size_m);
+        BlockType v = w < fb.nb ? fb.bits[w] >> r : 0;
+        if (r && w + 1 < fb.nb)
+            v |= fb.bits[w + 1] << (64 - r);
+        return v;
+    }
+
+    // Replace the bits of block 'i' selected by 'mask' with those of 'v'
+    inline void merge_block(uint64_t i, BlockType v, BlockType mask) {
+        bits[i] = (bits[i] & ~mask) | (v & mask);
+    }
+
+    // Set the bits [offset, offset + length) to those of 'v'
+    inline void fill_range(uint64_t offset, uint64_t length, BlockType v) {
+        if (!length)
+            return;
+        uint64_t b0 = offset >> BLOCK_SHIFT;
+        uint64_t b1 = (offset + length - 1) >> BLOCK_SHIFT;
+        BlockType lower_mask = mask_table2[offset & block_size_m];
+        BlockType upper_mask = mask_table[(offset + length) & block_size_m];
+        if (b0 == b1) {
+            merge_block(b0, v, lower_mask & upper_mask);
+        } else {
+            merge_block(b0, v, lower_mask);
+            memset(bits + b0 + 1, (int)(v & 0xff),
+                   sizeof(BlockType) * (b1 - b0 - 1));
+            merge_block(b1, v, upper_mask);
+        }
+    }
+
+    // Applies combine<op>() to the bits [offset, offset + length)
+    // The blocks between the ends of the range are given to the vector
+    // kernels, and those at either end are merged with masks
+    template <int op>
+    inline void range_operation(const FastBitset &fb, uint64_t offset,
+                                uint64_t length) {
+        if (!length)
+            return;
+        uint64_t b0 = offset >> BLOCK_SHIFT;
+        uint64_t b1 = (offset + length - 1) >> BLOCK_SHIFT;
+        BlockType lower_mask = mask_table2[offset & block_size_m];
+        BlockType upper_mask = mask_table[(offset + length) & block_size_m];
+        if (b0 == b1) {
+            merge_block(b0, combine<op>(bits[b0], fb.bits[b0]),
+                        lower_mask & upper_mask);
+            return;
+        }
+
+        merge_block(b0, combine<op>(bits[b0], fb.bits[b0]), lower_mask);
+        merge_block(b1, combine<op>(bits[b1], fb.bits[b1]), upper_mask);
+        combine_vectors<op>(bits + b0 + 1, fb.bits + b0 + 1, b1 - b0 - 1);
+    }
+
+    // Funnel shift kernels, used by the shift and range operations
+    // Each writes dst[i] = (src[i] >> r) | (src[i + 1] << (64 - r)) for
+    // 'count' blocks, where 0 < r < 64, i.e. it copies the bits of 'src'
+    // starting at bit 'r'. funnel() runs upward and funnel_down() runs
+    // downward, so the source may overlap the destination from above or
+    // below respectively.
+    // Like the vector kernels above, each is written once for vectors of
+    // type V, a vector at a time followed by single blocks. Both vectors
+    // of a step are loaded before it is stored, so an overlapping store
+    // only overwrites blocks which have already been read.
+    template <class V>
+    __attribute__((always_inline)) static inline void
+    funnel_vector(BlockType *dst, const BlockType *src, unsigned int r) {
+        V x, y;
+        memcpy(&x, src, sizeof(V));
+        memcpy(&y, src + 1, sizeof(V));
+        x = (x >> r) | (y << (64 - r));
+        memcpy(dst, &x, sizeof(V));
+    }
+
+    template <class V>
+    __attribute__((always_inline)) static inline void
+    funnel_blocks(BlockType *dst, const BlockType *src, uint64_t count,
+                  unsigned int r) {
+        const uint64_t w = sizeof(V) / sizeof(BlockType);
+        uint64_t i = 0;
+        for (; i + w <= count; i += w)
+            funnel_vector<V>(dst + i, src + i, r);
+        for (; i < count; i++)
+            funnel_vector<BlockType>(dst + i, src + i, r);
+    }
+
+    template <class V>
+    __attribute__((always_inline)) static inline void
+    funnel_down_blocks(BlockType *dst, const BlockType *src, uint64_t count,
+                       unsigned int r) {
+        const uint64_t w = sizeof(V) / sizeof(BlockType);
+        uint64_t i = count;
+        for (; i >= w; i -= w)
+            funnel_vector<V>(dst + i - w, src + i - w, r);
+        while (i-- > 0)
+            funnel_vector<BlockType>(dst + i, src + i, r);
+    }
+
+#if FBALIGN >= 256
+    __attribute__((target("avx2,popcnt"))) static void
+    funnel_v2(BlockType *dst, const BlockType *src, uint64_t count,
+              unsigned int r) {
+        funnel_blocks<BlockVector256>(dst, src, count, r);
+    }
+
+    __attribute__((target("avx2,popcnt"))) static void
+    funnel_down_v2(BlockType *dst, const BlockType *src, uint64_t count,
+                   unsigned int r) {
+        funnel_down_blocks<BlockVector256>(dst, src, count, r);
+    }
+#endif
+
+#if FBALIGN == 512
+    __attribute__((target("avx512f,avx512bw,popcnt"))) static void
+    funnel_avx512(BlockType *dst, const BlockType *src, uint64_t count,
+                  unsigned int r) {
+        funnel_blocks<BlockVector512>(dst, src, count, r);
+    }
+
+    __attribute__((target("avx512f,avx512bw,popcnt"))) static void
+    funnel_down_avx512(BlockType *dst, const BlockType *src, uint64_t count,
+                       unsigned int r) {
+        funnel_down_blocks<BlockVector512>(dst, src, count, r);
+    }
+#endif
+
+    static inline void funnel(BlockType *dst, const BlockType *src,
+                              uint64_t count, unsigned int r) {
+#if FBALIGN == 512
+        if (getSimdLevel() >= SIMD_AVX512) {
+            funnel_avx512(dst, src, count, r);
+            return;
+        }
+#endif
+#if FBALIGN >= 256
+        if (getSimdLevel() >= SIMD_AVX2) {
+            funnel_v2(dst, src, count, r);
+            return;
+        }
+#endif
+        funnel_blocks<BlockType>(dst, src, count, r);
+    }
+
+    static inline void funnel_down(BlockType *dst, const BlockType *src,
+                                   uint64_t count, unsigned int r) {
+#if FBALIGN == 512
+        if (getSimdLevel() >= SIMD_AVX512) {
+            funnel_down_avx512(dst, src, count, r);
+            return;
+        }
+#endif
+#if FBALIGN >= 256
+        if (getSimdLevel() >= SIMD_AVX2) {
+            funnel_down_v2(dst, src, count, r);
+            return;
+        }
+#endif
+        funnel_down_blocks<BlockType>(dst, src, count, r);
+    }
+
     // Returns a value with the last #'offset' bits set to 1
     // Note the value 'offset' must be less than the number of bits in BlockType
     BlockType get_bitmask(unsigned int offset) {
@@ -1275,7 +2567,333 @@ class FastBitset {
     }
 };
 
+// A FastBitset which refers to memory it does not own, such as a row of
+// a BitMatrix. Copying a view produces another view of the same bits,
+// while assigning to a view copies the bits into that memory. To obtain
+// an independent copy, construct a FastBitset from the view instead.
+//
+// A view may also be placed over memory provided by the caller, such as
+// a buffer received with MPI, a dataset read from HDF5, or a region
+// mapped with mmap(), so that the bits are used without being copied.
+// The buffer must hold bytes(n) bytes, which covers the padding to a
+// multiple of FBALIGN bits; every operation reads the padding, and
+// expects it to be zero. The buffer should be aligned to
+// FastBitset::alignment bytes (as memory from posix_memalign or mmap
+// is), since the SIMD kernels are slower on misaligned data. The view
+// must not outlive the buffer, and the buffer is never freed by it.
+class FastBitsetView : public FastBitset {
+  public:
+    // External Memory Constructor
+    // The view uses the first bytes(_n) bytes at 'buffer'
+    // If the padding of the buffer may not be zero, call trim() first
+    FastBitsetView(void *buffer, uint64_t _n)
+        : FastBitset((BlockType *)buffer, _n, get_num_blocks(_n)) {}
+
+    FastBitsetView(const FastBitsetView &other)
+        : FastBitset(other.bits, other.n, other.nb) {}
+
+    FastBitsetView &operator=(const FastBitsetView &other) {
+        FastBitset::operator=(other);
+        return *this;
+    }
+
+    FastBitsetView &operator=(const FastBitset &other) {
+        FastBitset::operator=(other);
+        return *this;
+    }
+
+    template <class E>
+    FastBitsetView &operator=(const BitExpression<E> &expr) {
+        FastBitset::operator=(expr);
+        return *this;
+    }
+
+    // Returns the number of bytes needed to hold '_n' bits, which is the
+    // size of the buffer used by a view or by a FastBitset of '_n' bits
+    static inline size_t bytes(uint64_t _n) {
+        return sizeof(BlockType) * get_num_blocks(_n);
+    }
+
+  private:
+    friend class BitMatrix;
+    friend class ConstFastBitsetView;
+
+    FastBitsetView(BlockType *_bits, uint64_t _n, uint64_t _nb)
+        : FastBitset(_bits, _n, _nb) {}
+};
+
+// A view which may only be read, such as a row of a const BitMatrix.
+// It has only the const methods of a FastBitset, and converts to a
+// const FastBitset & where one is expected, so it may be an operand of
+// any operation which reads a bitset. Copying it produces another
+// read-only view, and it cannot be assigned to.
+class ConstFastBitsetView {
+  public:
+    ConstFastBitsetView(const ConstFastBitsetView &other)
+        : view(other.view) {}
+
+    ConstFastBitsetView &operator=(const ConstFastBitsetView &) = delete;
+
+    inline const FastBitset &bitset() const { return view; }
+    inline operator const FastBitset &() const { return view; }
+
+    inline bool operator==(const FastBitset &other) const {
+        return view == other;
+    }
+
+    inline uint64_t size() const { return view.size(); }
+    inline uint64_t getNumBlocks() const { return view.getNumBlocks(); }
+    inline size_t getBlockSize() const { return view.getBlockSize(); }
+    inline const void *getAddress() const { return view.getAddress(); }
+
+    inline bool any() const { return view.any(); }
+    inline bool any_in_range(uint64_t offset, uint64_t length) const {
+        return view.any_in_range(offset, length);
+    }
+    inline bool none_in_range(uint64_t offset, uint64_t length) const {
+        return view.none_in_range(offset, length);
+    }
+
+    inline BlockType read(uint64_t idx) const { return view.read(idx); }
+    inline BlockType readBlock(uint64_t idx) const {
+        return view.readBlock(idx);
+    }
+    inline BlockType atomic_read(uint64_t idx) const {
+        return view.atomic_read(idx);
+    }
+
+    inline uint64_t next_bit() const { return view.next_bit(); }
+    inline uint64_t next_bit(uint64_t idx) const { return view.next_bit(idx); }
+    inline uint64_t find_next(uint64_t idx) const {
+        return view.find_next(idx);
+    }
+    inline uint64_t prev_bit() const { return view.prev_bit(); }
+    inline uint64_t prev_bit(uint64_t idx) const { return view.prev_bit(idx); }
+
+    inline size_t hash() const { return view.hash(); }
+
+    inline uint64_t count_bits() const { return view.count_bits(); }
+    inline uint64_t count_v1() const { return view.count_v1(); }
+    inline uint64_t count_v2() const { return view.count_v2(); }
+    inline uint64_t count_v3() const { return view.count_v3(); }
+    inline uint64_t count_v4() const { return view.count_v4(); }
+#if FBALIGN == 512
+    inline uint64_t count_avx512() const { return view.count_avx512(); }
+#endif
+    inline uint64_t count_parallel() const { return view.count_parallel(); }
+    inline uint64_t partial_count(uint64_t offset, uint64_t length) const {
+        return view.partial_count(offset, length);
+    }
+
+    inline uint64_t vecprod(const FastBitset &fb) const {
+        return view.vecprod(fb);
+    }
+    inline uint64_t vecprod_v2(const FastBitset &fb) const {
+        return view.vecprod_v2(fb);
+    }
+    inline uint64_t count_union(const FastBitset &fb) const {
+        return view.count_union(fb);
+    }
+    inline uint64_t count_disjoint_union(const FastBitset &fb) const {
+        return view.count_disjoint_union(fb);
+    }
+    inline uint64_t count_difference(const FastBitset &fb) const {
+        return view.count_difference(fb);
+    }
+    inline uint64_t hamming(const FastBitset &fb) const {
+        return view.hamming(fb);
+    }
+    inline double jaccard(const FastBitset &fb) const {
+        return view.jaccard(fb);
+    }
+    inline uint64_t partial_vecprod(const FastBitset &fb, uint64_t offset,
+                                    uint64_t length) const {
+        return view.partial_vecprod(fb, offset, length);
+    }
+
+    template <class Function>
+    inline Function for_each_set_bit(Function f) const {
+        return view.for_each_set_bit(f);
+    }
+    inline uint64_t extract_indices(uint64_t *out) const {
+        return view.extract_indices(out);
+    }
+    inline uint64_t extract_indices(uint64_t *out, uint64_t offset,
+                                    uint64_t length) const {
+        return view.extract_indices(out, offset, length);
+    }
+    inline uint64_t extract_indices_parallel(uint64_t *out) const {
+        return view.extract_indices_parallel(out);
+    }
+
+    inline void clone(FastBitset &fb) const { view.clone(fb); }
+    std::string toString() const { return view.toString(); }
+    void printBitset() const { view.printBitset(); }
+
+  private:
+    friend class BitMatrix;
+
+    // The view is never written through, so the const is cast away only
+    // to share the FastBitset implementation
+    ConstFastBitsetView(const BlockType *_bits, uint64_t _n, uint64_t _nb)
+        : view(const_cast<BlockType *>(_bits), _n, _nb) {}
+
+    const FastBitsetView view;
+};
+
+// Overloads of std::swap, found by argument-dependent lookup, so that
+// std::sort and other algorithms exchange bitsets without copying them
+inline void swap(FastBitset &a, FastBitset &b) { a.swap(b); }
+inline void swap(FastBitsetView &a, FastBitsetView &b) { a.swap(b); }
+
+// Sets bits of a bitset or BitMatrix shared by several threads, without
+// a private copy per thread. Each thread uses its own builder, which
+// collects the bits set in one block and unions them into the shared
+// block with a single atomic operation once a bit in another block is
+// set, or when the builder is flushed or destroyed. A thread which sets
+// its bits in order, such as the neighbours of one vertex, then uses one
+// atomic operation per block rather than one per bit.
+// The bits are visible to other threads once every builder has been
+// flushed and the threads have synchronized, e.g. at the end of the
+// parallel region in which the builders were declared.
+class ConcurrentBuilder {
+  public:
+    explicit ConcurrentBuilder(FastBitset &fb)
+        : bits((BlockType *)fb.getAddress()), stride(fb.getNumBlocks()),
+          block(0), pending(0) {}
+
+    explicit ConcurrentBuilder(BitMatrix &m);
+
+    ~ConcurrentBuilder() { flush(); }
+
+    // Set the bit at location 'idx' of the bitset
+    inline void set(uint64_t idx) { add(idx >> BLOCK_SHIFT, idx); }
+
+    // Set the bit at row 'i', column 'j' of the matrix
+    inline void set(uint64_t i, uint64_t j) {
+        add(i * stride + (j >> BLOCK_SHIFT), j);
+    }
+
+    // Write the pending bits to the shared memory
+    inline void flush() {
+        if (pending)
+            __atomic_fetch_or(bits + block, pending, __ATOMIC_RELAXED);
+        pending = 0;
+    }
+
+  private:
+    BlockType *bits;
+    uint64_t stride; // Blocks in each row
+    uint64_t block;  // The block holding the pending bits
+    BlockType pending;
+
+    inline void add(uint64_t _block, uint64_t idx) {
+        if (_block != block) {
+            flush();
+            block = _block;
+        }
+        pending |= (BlockType)1 << (idx & (FastBitset::bits_per_block - 1));
+    }
+
+    // A builder may not be copied, since its pending bits would be
+    // written twice
+    ConcurrentBuilder(const ConcurrentBuilder &);
+    ConcurrentBuilder &operator=(const ConcurrentBuilder &);
+};
+
+// A FastBitset which keeps the lanes of its hash up to date, so that its
+// hash is found in constant time, e.g. when the rows of a matrix are
+// deduplicated in a hash table which is probed many times
+// The bits are changed only through the members below, each of which
+// updates the lane of the block it changes; the bitset itself is read
+// through bitset(). The digest is computed from the lanes when it is
+// first used after a change, and cached until the next change.
+class HashedBitset {
+  public:
+    HashedBitset() { rehash(); }
+
+    explicit HashedBitset(uint64_t _n) : fb(_n) { rehash(); }
+
+    explicit HashedBitset(const FastBitset &other) : fb(other) { rehash(); }
+
+    HashedBitset &operator=(const FastBitset &other) {
+        fb = other;
+        rehash();
+        return *this;
+    }
+
+    inline const FastBitset &bitset() const { return fb; }
+    inline uint64_t size() const { return fb.size(); }
+    inline BlockType read(uint64_t idx) const { return fb.read(idx); }
+    inline BlockType readBlock(uint64_t idx) const { return fb.readBlock(idx); }
+
+    // Set the bit at location 'idx' to 1
+    inline void set(uint64_t idx) {
+        uint64_t k = idx >> BLOCK_SHIFT;
+        update(fb.readBlock(k) | bit(idx), k);
+    }
+
+    // Set the bit at location 'idx' to 0
+    inline void unset(uint64_t idx) {
+        uint64_t k = idx >> BLOCK_SHIFT;
+        update(fb.readBlock(k) & ~bit(idx), k);
+    }
+
+    // Flip the bit at location 'idx'
+    inline void flip(uint64_t idx) {
+        uint64_t k = idx >> BLOCK_SHIFT;
+        update(fb.readBlock(k) ^ bit(idx), k);
+    }
+
+    // Write to the block at location 'idx'
+    inline void writeBlock(const BlockType val, uint64_t idx) {
+        update(val, idx);
+    }
+
+    // The same value as bitset().hash(), without reading the bits
+    inline size_t hash() const {
+        if (!valid) {
+            digest = FastBitset::hash_digest(lanes, fb.getNumBlocks());
+            valid = true;
+        }
+        return digest;
+    }
+
+    // Bitsets with different hashes are not compared
+    inline bool operator==(const HashedBitset &other) const {
+        return hash() == other.hash() && fb == other.fb;
+    }
+
+    inline bool operator!=(const HashedBitset &other) const {
+        return !(*this == other);
+    }
+
+  private:
+    FastBitset fb;
+    BlockType lanes[8];
+    mutable size_t digest;
+    mutable bool valid;
+
+    static inline BlockType bit(uint64_t idx) {
+        return (BlockType)1 << (idx & (FastBitset::bits_per_block - 1));
+    }
+
+    // Replace the term of block 'k' in its lane
+    inline void update(const BlockType val, uint64_t k) {
+        lanes[k & 7] += FastBitset::hash_term(val, k) -
+                        FastBitset::hash_term(fb.readBlock(k), k);
+        fb.writeBlock(val, k);
+        valid = false;
+    }
+
+    inline void rehash() {
+        fb.hash_lanes(lanes);
+        valid = false;
+    }
+};
+
 // Data structure used for binary matrices
+// See also the BitMatrix, which stores all rows contiguously
 typedef std::vector<FastBitset> Bitvector;
 
 } // namespace fastmath
@@ -1285,10 +2903,14 @@ namespace std {
 template <> class hash<fastmath::FastBitset> {
   public:
     size_t operator()(fastmath::FastBitset const &fb) const {
-        size_t seed = 0;
-        for (uint64_t i = 0; i < fb.getNumBlocks(); i++)
-            boost::hash_combine(seed, (size_t)fb.readBlock(i));
-        return seed;
+        return fb.hash();
+    }
+};
+
+template <> class hash<fastmath::HashedBitset> {
+  public:
+    size_t operator()(fastmath::HashedBitset const &hb) const {
+        return hb.hash();
     }
 };
 } // namespace std
@@ -0,0 +1,235 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#ifndef FASTMATH_RANKSELECT_H
+#define FASTMATH_RANKSELECT_H
+
+#include "fastbitset.h"
+
+/* The RankSelect is an auxiliary index over a FastBitset which answers
+ *
+ *  rank(i):   the number of bits set before bit 'i', in O(1)
+ *  select(k): the position of the k-th set bit (counting from zero),
+ *             in near O(1)
+ *
+ * The counts follow the layout of Zhou, Andersen and Kaminsky's "poppy":
+ * one 64-bit entry per 2048 bits holds the count before it (relative to
+ * the enclosing 2^32 bits) and the counts of its first three 512-bit
+ * basic blocks, so a rank reads one entry and at most one cache line of
+ * the bitset. Every 8192nd set bit records which entry holds it, which
+ * narrows the search done by select. Altogether the index takes about
+ * 3.5% of the size of the bitset.
+ *
+ * The index refers to the bitset it was built from, which must outlive
+ * it. It is not updated when the bitset changes; call build() again, or
+ * clear() to release the index until it is next needed. */
+
+namespace fastmath {
+
+class RankSelect {
+  public:
+    //----------------------------//
+    // Constructors, Destructors, //
+    // and Other Class Utilities  //
+    //----------------------------//
+
+    // Default Constructor
+    RankSelect() : fb(NULL), ones(0) {}
+
+    // Build Constructor
+    explicit RankSelect(const FastBitset &_fb) : fb(NULL), ones(0) {
+        build(_fb);
+    }
+
+    // Build the index over the current contents of '_fb'
+    inline void build(const FastBitset &_fb) {
+        fb = &_fb;
+        const BlockType *bits = (const BlockType *)fb->getAddress();
+        uint64_t nb = fb->getNumBlocks();
+        uint64_t nentries = (nb + entry_blocks - 1) / entry_blocks;
+
+        try {
+            lower.assign(nentries, 0);
+            upper.assign((fb->size() >> upper_shift) + 1, 0);
+            samples.clear();
+        } catch (std::bad_alloc &) {
+            fprintf(stderr, "Memory allocation failure in %s on line %d!\n",
+                    __FILE__, __LINE__);
+            fflush(stderr);
+            clear();
+            return;
+        }
+
+        uint64_t total = 0;
+        for (uint64_t j = 0; j < nentries; j++) {
+            if (!(j & (upper_entries - 1)))
+                upper[j >> (upper_shift - entry_shift)] = total;
+
+            // Counts of the four basic blocks
+            uint64_t cnt[4] = {0, 0, 0, 0};
+            uint64_t first = j * entry_blocks;
+            uint64_t last = std::min(first + entry_blocks, nb);
+            for (uint64_t i = first; i < last; i++)
+                cnt[(i - first) / basic_blocks] += popcount(bits[i]);
+
+            uint64_t sum = cnt[0] + cnt[1] + cnt[2] + cnt[3];
+            lower[j] = ((total - upper[j >> (upper_shift - entry_shift)])
+                        << 32) |
+                       cnt[0] | (cnt[1] << 10) | (cnt[2] << 20);
+
+            while (samples.size() * sample_rate < total + sum)
+                samples.push_back(j);
+            total += sum;
+        }
+        ones = total;
+    }
+
+    // Release the index, so that it must be built again before it is used
+    inline void clear() {
+        fb = NULL;
+        ones = 0;
+        std::vector<uint64_t>().swap(lower);
+        std::vector<uint64_t>().swap(upper);
+        std::vector<uint64_t>().swap(samples);
+    }
+
+    //------------------//
+    // Index Properties //
+    //------------------//
+
+    // Returns true if the index has been built
+    inline bool valid() const { return fb != NULL; }
+
+    // Returns the number of bits set, as of the last build()
+    inline uint64_t count_bits() const { return ones; }
+
+    // Returns the memory used by the index
+    inline size_t bytes() const {
+        return sizeof(RankSelect) +
+               sizeof(uint64_t) *
+                   (lower.capacity() + upper.capacity() + samples.capacity());
+    }
+
+    //---------//
+    // Queries //
+    //---------//
+
+    // Number of bits set in the range [0, idx)
+    // This is equal to fb.partial_count(0, idx)
+    inline uint64_t rank(uint64_t idx) const {
+        if (idx >= fb->size())
+            return ones;
+
+        const BlockType *bits = (const BlockType *)fb->getAddress();
+        uint64_t entry = lower[idx >> entry_shift];
+        uint64_t r = upper[idx >> upper_shift] + (entry >> 32);
+        unsigned int basic = (idx >> basic_shift) & 3;
+        for (unsigned int k = 0; k < basic; k++)
+            r += (entry >> (10 * k)) & 0x3ff;
+
+        uint64_t block = idx >> BLOCK_SHIFT;
+        for (uint64_t i = (idx >> basic_shift) * basic_blocks; i < block; i++)
+            r += popcount(bits[i]);
+        if (idx & 63)
+            r += popcount(bits[block] & mask_table[idx & 63]);
+        return r;
+    }
+
+    // Position of the set bit with rank 'k', so that select(rank(i)) == i
+    // whenever bit 'i' is set
+    // Returns the size of the bitset if fewer than k + 1 bits are set
+    inline uint64_t select(uint64_t k) const {
+        if (k >= ones)
+            return fb->size();
+
+        // The entry holding the bit lies between two samples; find the
+        // last entry with no more than 'k' bits before it
+        uint64_t s = k / sample_rate;
+        uint64_t lo = samples[s];
+        uint64_t hi = s + 1 < samples.size() ? samples[s + 1]
+                                             : lower.size() - 1;
+        while (lo < hi) {
+            uint64_t mid = (lo + hi + 1) >> 1;
+            if (before(mid) <= k)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+
+        k -= before(lo);
+        uint64_t entry = lower[lo];
+        uint64_t block = lo * entry_blocks;
+        for (unsigned int b = 0; b < 3; b++) {
+            uint64_t c = (entry >> (10 * b)) & 0x3ff;
+            if (k < c)
+                break;
+            k -= c;
+            block += basic_blocks;
+        }
+
+        const BlockType *bits = (const BlockType *)fb->getAddress();
+        for (uint64_t c = popcount(bits[block]); k >= c;
+             c = popcount(bits[block])) {
+            k -= c;
+            block++;
+        }
+        return (block << BLOCK_SHIFT) + select_in_block(bits[block], k);
+    }
+
+  private:
+    const FastBitset *fb;          // Bitset which has been indexed
+    uint64_t ones;                 // Number of bits set
+    std::vector<uint64_t> lower;   // Relative count and basic block
+                                   // counts, for each 2048 bits
+    std::vector<uint64_t> upper;   // Absolute count for each 2^32 bits
+    std::vector<uint64_t> samples; // Entry holding every 8192nd bit set
+
+    static const unsigned int basic_shift = 9; // 512 bits
+    static const unsigned int entry_shift = 11; // 2048 bits
+    static const unsigned int upper_shift = 32;
+    static const uint64_t basic_blocks = 1 << (basic_shift - BLOCK_SHIFT);
+    static const uint64_t entry_blocks = 1 << (entry_shift - BLOCK_SHIFT);
+    static const uint64_t upper_entries = 1ULL << (upper_shift - entry_shift);
+    static const uint64_t sample_rate = 8192;
+
+    // Number of bits set before the entry 'j'
+    inline uint64_t before(uint64_t j) const {
+        return upper[j >> (upper_shift - entry_shift)] + (lower[j] >> 32);
+    }
+
+    // Position of the set bit with rank 'k' within the block 'v'
+    // The bytes are skipped using their counts, and the bits within the
+    // last byte are cleared one at a time
+    static inline unsigned int select_in_block(BlockType v, uint64_t k) {
+        unsigned int shift = 0;
+        for (;; shift += 8) {
+            unsigned int c = count_table<>::table[(v >> shift) & 0xff];
+            if (k < c)
+                break;
+            k -= c;
+        }
+
+        BlockType b = (v >> shift) & 0xff;
+        for (; k; k--)
+            b &= b - 1;
+        return shift + __builtin_ctzl(b);
+    }
+};
+
+} // namespace fastmath
+
+#endif
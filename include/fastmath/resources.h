@@ -41,6 +41,7 @@
 #define BOOST_OPTIONAL_USE_OLD_DEFINITION_OF_NONE
 #include <boost/optional.hpp>
 
+#include <fastmath/bitmatrix.h>
 #include <fastmath/printcolor.h>
 #include <fastmath/stopwatch.h>
 
@@ -794,6 +795,253 @@ save_h5_matrix_close(hid_t &file, hid_t &group, hid_t &dataspace,
     H5Fclose(file);
 }
 
+//-------------------//
+// Bit-Packed Arrays //
+//-------------------//
+
+// Bitsets and bit matrices are stored as unsigned 64-bit blocks, eight
+// times smaller than a boolean dataset, without the FBALIGN padding: a
+// FastBitset of n bits is a dataset of ceil(n / 64) blocks, and a
+// BitMatrix with C columns is a dataset of ceil(C / 64) blocks per row.
+// The number of bits in each row is kept in the attribute "nbits".
+// The data are written from, and read into, the bitset memory without
+// any copies. Chunks hold whole rows of about 1 MB, and are compressed
+// with deflate when 'deflate' (the level, 1 through 9) is not zero.
+// An existing dataset with the same name is replaced.
+
+// Number of blocks in each chunk of a bit-packed dataset
+static const hsize_t h5_chunk_blocks = 1 << 17;
+
+// Return true if the object 'dataname' exists, where 'dataname' may be a
+// path through groups which do not exist yet
+inline bool exists_h5(hid_t file, const char *dataname) {
+    herr_t (*old_func)(hid_t, void *);
+    void *old_client_data;
+    H5Eget_auto(H5E_DEFAULT, &old_func, &old_client_data);
+    H5Eset_auto(H5E_DEFAULT, NULL, NULL);
+    bool exists = H5Lexists(file, dataname, H5P_DEFAULT) > 0 &&
+                  H5Oexists_by_name(file, dataname, H5P_DEFAULT) > 0;
+    H5Eset_auto(H5E_DEFAULT, old_func, old_client_data);
+    return exists;
+}
+
+// Create the dataset 'dataname' with 'dim' dimensions of size 'shape',
+// in which the last dimension holds 'nbits' bits
+inline hid_t create_h5_bits(hid_t file, const char *dataname, hsize_t dim,
+                            const hsize_t *shape, uint64_t nbits,
+                            unsigned int deflate) {
+    hid_t lcpl_id = H5Pcreate(H5P_LINK_CREATE);
+    H5Pset_create_intermediate_group(lcpl_id, 1);
+    if (exists_h5(file, dataname))
+        H5Ldelete(file, dataname, H5P_DEFAULT);
+
+    // Chunks are made of whole rows
+    hid_t props = H5Pcreate(H5P_DATASET_CREATE);
+    hsize_t row = shape[dim - 1], chunk[2];
+    if (row && shape[0]) {
+        chunk[dim - 1] = row;
+        if (dim == 2)
+            chunk[0] = std::max((hsize_t)1,
+                                std::min(shape[0], h5_chunk_blocks / row));
+        else
+            chunk[0] = std::min(row, h5_chunk_blocks);
+        H5Pset_chunk(props, dim, chunk);
+        if (deflate && H5Zfilter_avail(H5Z_FILTER_DEFLATE) > 0)
+            H5Pset_deflate(props, std::min(deflate, 9u));
+    }
+
+    hid_t dataspace = H5Screate_simple(dim, shape, NULL);
+    hid_t dataset = H5Dcreate(file, dataname, getH5DataType<uint64_t>(),
+                              dataspace, lcpl_id, props, H5P_DEFAULT);
+    H5Sclose(dataspace);
+    H5Pclose(props);
+    H5Pclose(lcpl_id);
+
+    if (dataset >= 0) {
+        hsize_t one = 1;
+        hid_t attrspace = H5Screate_simple(1, &one, NULL);
+        hid_t attr = H5Acreate2(dataset, "nbits", getH5DataType<uint64_t>(),
+                                attrspace, H5P_DEFAULT, H5P_DEFAULT);
+        H5Awrite(attr, H5T_NATIVE_UINT64, &nbits);
+        H5Aclose(attr);
+        H5Sclose(attrspace);
+    }
+    return dataset;
+}
+
+// Open the file 'filename' for writing, creating it if it does not exist
+inline hid_t open_h5_for_writing(const char *filename) {
+    if (access(filename, F_OK) == -1)
+        return H5Fcreate(filename, H5F_ACC_EXCL, H5P_DEFAULT, H5P_DEFAULT);
+    else
+        return H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT);
+}
+
+// Open the bit-packed dataset 'dataname' with 'dim' dimensions, and read
+// its shape and the number of bits in each row
+// Returns a negative value if there is no such dataset
+inline hid_t open_h5_bits(hid_t file, const char *dataname, hsize_t dim,
+                          hsize_t *shape, uint64_t &nbits) {
+    if (file < 0 || !exists_h5(file, dataname))
+        return -1;
+    hid_t dataset = H5Dopen(file, dataname, H5P_DEFAULT);
+    hid_t dataspace = H5Dget_space(dataset);
+    bool valid = H5Sget_simple_extent_ndims(dataspace) == (int)dim &&
+                 H5Aexists(dataset, "nbits") > 0;
+    if (valid) {
+        H5Sget_simple_extent_dims(dataspace, shape, NULL);
+        hid_t attr = H5Aopen(dataset, "nbits", H5P_DEFAULT);
+        H5Aread(attr, H5T_NATIVE_UINT64, &nbits);
+        H5Aclose(attr);
+        valid = shape[dim - 1] == (nbits + 63) >> 6;
+    }
+    H5Sclose(dataspace);
+    if (!valid) {
+        H5Dclose(dataset);
+        return -1;
+    }
+    return dataset;
+}
+
+// Save the bitset 'fb' as the dataset 'dataname'
+inline bool save_h5_bitset(const char *filename, const char *dataname,
+                           const FastBitset &fb, unsigned int deflate = 0) {
+    hid_t file = open_h5_for_writing(filename);
+    if (file < 0)
+        return false;
+
+    hsize_t shape = (fb.size() + 63) >> 6;
+    hid_t dataset = create_h5_bits(file, dataname, 1, &shape, fb.size(),
+                                   deflate);
+    herr_t status = -1;
+    if (dataset >= 0) {
+        if (shape)
+            status = H5Dwrite(dataset, H5T_NATIVE_UINT64, H5S_ALL, H5S_ALL,
+                              H5P_DEFAULT, fb.getAddress());
+        else
+            status = 0;
+        H5Dclose(dataset);
+    }
+    H5Fclose(file);
+    return status >= 0;
+}
+
+// Save the matrix 'm' as the dataset 'dataname'
+// Each row is written directly from the slab, skipping the padding
+inline bool save_h5_bitmatrix(const char *filename, const char *dataname,
+                              const BitMatrix &m, unsigned int deflate = 0) {
+    hid_t file = open_h5_for_writing(filename);
+    if (file < 0)
+        return false;
+
+    hsize_t shape[] = {m.getNumRows(), (m.getNumCols() + 63) >> 6};
+    hid_t dataset = create_h5_bits(file, dataname, 2, shape, m.getNumCols(),
+                                   deflate);
+    herr_t status = -1;
+    if (dataset >= 0) {
+        status = 0;
+        if (shape[0] && shape[1]) {
+            // The slab is a matrix with 'stride' columns, of which the
+            // first 'shape[1]' are selected
+            hsize_t slab[] = {shape[0], m.getStride()}, start[] = {0, 0};
+            hid_t memspace = H5Screate_simple(2, slab, NULL);
+            H5Sselect_hyperslab(memspace, H5S_SELECT_SET, start, NULL, shape,
+                                NULL);
+            status = H5Dwrite(dataset, H5T_NATIVE_UINT64, memspace, H5S_ALL,
+                              H5P_DEFAULT, m.getAddress());
+            H5Sclose(memspace);
+        }
+        H5Dclose(dataset);
+    }
+    H5Fclose(file);
+    return status >= 0;
+}
+
+// Save a Bitvector, whose rows must have the same size, as a matrix
+inline bool save_h5_bitmatrix(const char *filename, const char *dataname,
+                              const Bitvector &bv, unsigned int deflate = 0) {
+    return save_h5_bitmatrix(filename, dataname, BitMatrix(bv), deflate);
+}
+
+// Replace 'fb' with the bitset stored as the dataset 'dataname'
+// Returns false, leaving 'fb' unchanged, if it could not be read
+inline bool load_h5_bitset(const char *filename, const char *dataname,
+                           FastBitset &fb) {
+    if (access(filename, F_OK) == -1)
+        return false;
+    hid_t file = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+    hsize_t shape;
+    uint64_t nbits;
+    hid_t dataset = open_h5_bits(file, dataname, 1, &shape, nbits);
+    herr_t status = -1;
+    if (dataset >= 0) {
+        FastBitset bits(nbits);
+        status = 0;
+        if (shape) {
+            status = H5Dread(dataset, H5T_NATIVE_UINT64, H5S_ALL, H5S_ALL,
+                             H5P_DEFAULT, bits.getAddress());
+            // A file written elsewhere may have bits set past the end,
+            // which must be cleared like the rest of the padding
+            bits.writeBlock(bits.readBlock(shape - 1) & mask_table[nbits & 63],
+                            shape - 1);
+        }
+        if (status >= 0)
+            fb.swap(bits);
+        H5Dclose(dataset);
+    }
+    if (file >= 0)
+        H5Fclose(file);
+    return status >= 0;
+}
+
+// Replace 'm' with the matrix stored as the dataset 'dataname'
+// Each row is read directly into the slab
+// Returns false, leaving 'm' unchanged, if it could not be read
+inline bool load_h5_bitmatrix(const char *filename, const char *dataname,
+                              BitMatrix &m) {
+    if (access(filename, F_OK) == -1)
+        return false;
+    hid_t file = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+    hsize_t shape[2];
+    uint64_t nbits;
+    hid_t dataset = open_h5_bits(file, dataname, 2, shape, nbits);
+    herr_t status = -1;
+    if (dataset >= 0) {
+        BitMatrix bits(shape[0], nbits);
+        status = 0;
+        if (shape[0] && shape[1]) {
+            hsize_t slab[] = {shape[0], bits.getStride()}, start[] = {0, 0};
+            hid_t memspace = H5Screate_simple(2, slab, NULL);
+            H5Sselect_hyperslab(memspace, H5S_SELECT_SET, start, NULL, shape,
+                                NULL);
+            status = H5Dread(dataset, H5T_NATIVE_UINT64, memspace, H5S_ALL,
+                             H5P_DEFAULT, bits.getAddress());
+            H5Sclose(memspace);
+            // Clear any bits set past the end of each row, as for a bitset
+            for (uint64_t i = 0; i < shape[0]; i++)
+                bits.writeBlock(bits.readBlock(i, shape[1] - 1) &
+                                    mask_table[nbits & 63],
+                                i, shape[1] - 1);
+        }
+        if (status >= 0)
+            m.swap(bits);
+        H5Dclose(dataset);
+    }
+    if (file >= 0)
+        H5Fclose(file);
+    return status >= 0;
+}
+
+// Replace 'bv' with the matrix stored as the dataset 'dataname'
+inline bool load_h5_bitmatrix(const char *filename, const char *dataname,
+                              Bitvector &bv) {
+    BitMatrix m;
+    if (!load_h5_bitmatrix(filename, dataname, m))
+        return false;
+    bv = m.toBitvector();
+    return true;
+}
+
 } // namespace fastmath
 
 #endif
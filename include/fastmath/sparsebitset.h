@@ -0,0 +1,824 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#ifndef FASTMATH_SPARSEBITSET_H
+#define FASTMATH_SPARSEBITSET_H
+
+#include "fastbitset.h"
+#include <algorithm>
+#include <iterator>
+
+/* The SparseBitset is a compressed bitset for rows with very few bits
+ * set, following the design of Roaring bitmaps. The bits are split
+ * into chunks of 2^16, and only chunks with at least one bit set are
+ * stored, each in whichever of three containers is smallest:
+ *
+ *  Array:  the sorted 16-bit positions of the set bits, used for at
+ *          most 4096 bits (8 KB)
+ *  Bitmap: all 2^16 bits of the chunk (8 KB)
+ *  Run:    the start and length of each run of consecutive bits
+ *
+ * Modifications produce array and bitmap containers; run containers are
+ * only made by optimize(), and are expanded again if they are modified.
+ *
+ * The set operations follow those of the FastBitset, and there are
+ * mixed kernels which take a FastBitset as the other operand without
+ * converting either one. Operations which write to a FastBitset are
+ * named after what they do to it, e.g. unionInto(fb) is fb |= this.
+ * To choose a representation for each row of a matrix, compare bytes()
+ * with the size of the equivalent FastBitset.
+ *
+ * As with the FastBitset, the two operands of an operation are expected
+ * to have the same size, and indices are not checked. */
+
+namespace fastmath {
+
+// Representations used for each chunk of a SparseBitset
+enum SparseContainerType {
+    ARRAY_CONTAINER = 0,
+    BITMAP_CONTAINER = 1,
+    RUN_CONTAINER = 2
+};
+
+// One chunk of 2^16 bits of a SparseBitset
+struct SparseContainer {
+    SparseContainer() : key(0), type(ARRAY_CONTAINER), card(0) {}
+
+    inline void swap(SparseContainer &other) {
+        std::swap(key, other.key);
+        std::swap(type, other.type);
+        std::swap(card, other.card);
+        values.swap(other.values);
+        words.swap(other.words);
+    }
+
+    uint64_t key;                 // Index of the chunk
+    SparseContainerType type;     // Representation used
+    uint32_t card;                // Number of bits set
+    std::vector<uint16_t> values; // Positions (array), or the start and
+                                  // length minus one of each run (run)
+    std::vector<BlockType> words; // Bits of the chunk (bitmap)
+};
+
+class SparseBitset {
+  public:
+    //----------------------------//
+    // Constructors, Destructors, //
+    // and Other Class Utilities  //
+    //----------------------------//
+
+    // Default Constructor
+    SparseBitset() : n(0) {}
+
+    // Creation Constructor
+    SparseBitset(uint64_t _n) : n(_n) {}
+
+    // Conversion Constructor
+    explicit SparseBitset(const FastBitset &fb) { fromFastBitset(fb); }
+
+    // Equality Operator
+    // Bitsets are equal if the same bits are set, whatever the containers
+    inline bool operator==(const SparseBitset &other) const {
+        if (n != other.n || containers.size() != other.containers.size())
+            return false;
+
+        BlockType w0[chunk_blocks], w1[chunk_blocks];
+        for (size_t i = 0; i < containers.size(); i++) {
+            const SparseContainer &c0 = containers[i];
+            const SparseContainer &c1 = other.containers[i];
+            if (c0.key != c1.key || c0.card != c1.card)
+                return false;
+            toWords(c0, w0);
+            toWords(c1, w1);
+            if (memcmp(w0, w1, sizeof(w0)))
+                return false;
+        }
+        return true;
+    }
+
+    //-------------------//
+    // Bitset Properties //
+    //-------------------//
+
+    // Returns the number of bits
+    inline uint64_t size() const { return n; }
+
+    // Returns the number of chunks with at least one bit set
+    inline uint64_t getNumContainers() const { return containers.size(); }
+
+    // Returns the memory used, including the object itself
+    inline size_t bytes() const {
+        size_t b = sizeof(SparseBitset) +
+                   sizeof(SparseContainer) * containers.capacity();
+        for (size_t i = 0; i < containers.size(); i++)
+            b += sizeof(uint16_t) * containers[i].values.capacity() +
+                 sizeof(BlockType) * containers[i].words.capacity();
+        return b;
+    }
+
+    // Return true if any bits are set
+    // Empty containers are never stored, so this does not scan anything
+    inline bool any() const { return !containers.empty(); }
+
+    // Count the number of bits set
+    inline uint64_t count_bits() const {
+        uint64_t num_set = 0;
+        for (size_t i = 0; i < containers.size(); i++)
+            num_set += containers[i].card;
+        return num_set;
+    }
+
+    //---------------------//
+    // Reading and Writing //
+    //---------------------//
+
+    // Set the bit at location 'idx' to 1
+    inline void set(uint64_t idx) {
+        uint64_t key = idx >> chunk_shift;
+        uint16_t low = static_cast<uint16_t>(idx & chunk_mask);
+        size_t pos = lowerBound(key);
+
+        if (pos == containers.size() || containers[pos].key != key) {
+            containers.insert(containers.begin() + pos, SparseContainer());
+            containers[pos].key = key;
+            containers[pos].card = 1;
+            containers[pos].values.push_back(low);
+            return;
+        }
+
+        SparseContainer &c = containers[pos];
+        if (c.type == RUN_CONTAINER) {
+            if (contains(c, low))
+                return;
+            expand(c);
+        }
+
+        if (c.type == ARRAY_CONTAINER) {
+            std::vector<uint16_t>::iterator it =
+                std::lower_bound(c.values.begin(), c.values.end(), low);
+            if (it != c.values.end() && *it == low)
+                return;
+            c.values.insert(it, low);
+            c.card++;
+            if (c.card > array_max)
+                toBitmap(c);
+        } else {
+            BlockType bit = (BlockType)1 << (low & 63);
+            c.card += !(c.words[low >> 6] & bit);
+            c.words[low >> 6] |= bit;
+        }
+    }
+
+    // Set the bit at location 'idx' to 0
+    inline void unset(uint64_t idx) {
+        uint64_t key = idx >> chunk_shift;
+        uint16_t low = static_cast<uint16_t>(idx & chunk_mask);
+        size_t pos = lowerBound(key);
+        if (pos == containers.size() || containers[pos].key != key)
+            return;
+
+        SparseContainer &c = containers[pos];
+        if (!contains(c, low))
+            return;
+        if (c.type == RUN_CONTAINER)
+            expand(c);
+
+        if (c.type == ARRAY_CONTAINER) {
+            c.values.erase(
+                std::lower_bound(c.values.begin(), c.values.end(), low));
+        } else {
+            c.words[low >> 6] &= ~((BlockType)1 << (low & 63));
+        }
+
+        if (!--c.card)
+            containers.erase(containers.begin() + pos);
+        else if (c.type == BITMAP_CONTAINER && c.card <= array_max)
+            toArray(c);
+    }
+
+    // Read the bit at location 'idx'
+    inline BlockType read(uint64_t idx) const {
+        size_t pos = lowerBound(idx >> chunk_shift);
+        if (pos == containers.size() ||
+            containers[pos].key != idx >> chunk_shift)
+            return 0;
+        return contains(containers[pos],
+                        static_cast<uint16_t>(idx & chunk_mask));
+    }
+
+    // Returns the first bit set, or size() if there are none
+    inline uint64_t next_bit() const { return find_next(0); }
+
+    // Returns the first bit set at or after 'idx', or size() if there
+    // are none
+    inline uint64_t find_next(uint64_t idx) const {
+        uint64_t key = idx >> chunk_shift;
+        for (size_t pos = lowerBound(key); pos < containers.size(); pos++) {
+            const SparseContainer &c = containers[pos];
+            uint32_t low = c.key == key ? idx & chunk_mask : 0;
+            int32_t next = nextValue(c, low);
+            if (next >= 0)
+                return (c.key << chunk_shift) + next;
+        }
+        return n;
+    }
+
+    // Reset all bits to zero
+    inline void reset() { containers.clear(); }
+
+    // Use the smallest container for each chunk, including runs
+    // This is worth calling once a bitset is no longer being modified
+    inline void optimize() {
+        BlockType w[chunk_blocks];
+        std::vector<uint16_t> runs;
+        for (size_t i = 0; i < containers.size(); i++) {
+            SparseContainer &c = containers[i];
+            toWords(c, w);
+            wordsToRuns(w, runs);
+
+            size_t run_bytes = sizeof(uint16_t) * runs.size();
+            size_t other_bytes = c.card <= array_max
+                                     ? sizeof(uint16_t) * c.card
+                                     : sizeof(BlockType) * chunk_blocks;
+            if (run_bytes < other_bytes) {
+                c.type = RUN_CONTAINER;
+                c.values.swap(runs);
+                std::vector<uint16_t>(c.values).swap(c.values);
+                std::vector<BlockType>().swap(c.words);
+            } else if (c.type == RUN_CONTAINER) {
+                expand(c);
+            }
+        }
+    }
+
+    //-------------//
+    // Conversions //
+    //-------------//
+
+    // Replace the contents with the bits of 'fb'
+    inline void fromFastBitset(const FastBitset &fb) {
+        n = fb.n;
+        containers.clear();
+        for (uint64_t first = 0; first < fb.nb; first += chunk_blocks) {
+            uint64_t len = chunkLength(fb, first);
+            const BlockType *b = fb.bits + first;
+            uint32_t card = 0;
+            for (uint64_t i = 0; i < len; i++)
+                card += popcount(b[i]);
+            if (!card)
+                continue;
+
+            containers.push_back(SparseContainer());
+            SparseContainer &c = containers.back();
+            c.key = first / chunk_blocks;
+            c.card = card;
+            if (card <= array_max) {
+                c.values.reserve(card);
+                for (uint64_t i = 0; i < len; i++)
+                    for (BlockType v = b[i]; v; v &= v - 1)
+                        c.values.push_back((i << BLOCK_SHIFT) +
+                                           __builtin_ctzl(v));
+            } else {
+                c.type = BITMAP_CONTAINER;
+                c.words.assign(chunk_blocks, 0);
+                memcpy(&c.words[0], b, sizeof(BlockType) * len);
+            }
+        }
+    }
+
+    // Write the bits into 'fb', which must be at least as large
+    inline void toFastBitset(FastBitset &fb) const {
+        fb.reset();
+        unionInto(fb);
+    }
+
+    inline FastBitset toFastBitset() const {
+        FastBitset fb(n);
+        unionInto(fb);
+        return fb;
+    }
+
+    //----------------//
+    // Set Operations //
+    //----------------//
+
+    inline void setIntersection(const SparseBitset &sb) {
+        apply<0xc0>(sb);
+    }
+
+    inline void setUnion(const SparseBitset &sb) { apply<0xfc>(sb); }
+
+    inline void setDisjointUnion(const SparseBitset &sb) {
+        apply<0x3c>(sb);
+    }
+
+    inline void setDifference(const SparseBitset &sb) { apply<0x30>(sb); }
+
+    // Size of the intersection, without modifying either bitset
+    inline uint64_t vecprod(const SparseBitset &sb) const {
+        uint64_t cnt = 0;
+        BlockType w0[chunk_blocks], w1[chunk_blocks];
+        size_t i = 0, j = 0;
+        while (i < containers.size() && j < sb.containers.size()) {
+            const SparseContainer &c0 = containers[i];
+            const SparseContainer &c1 = sb.containers[j];
+            if (c0.key < c1.key) {
+                i++;
+            } else if (c1.key < c0.key) {
+                j++;
+            } else {
+                if (c0.type == ARRAY_CONTAINER || c1.type == ARRAY_CONTAINER) {
+                    const SparseContainer &a =
+                        c0.type == ARRAY_CONTAINER ? c0 : c1;
+                    const SparseContainer &b =
+                        c0.type == ARRAY_CONTAINER ? c1 : c0;
+                    for (size_t k = 0; k < a.values.size(); k++)
+                        cnt += contains(b, a.values[k]);
+                } else {
+                    toWords(c0, w0);
+                    toWords(c1, w1);
+                    for (uint64_t k = 0; k < chunk_blocks; k++)
+                        cnt += popcount(w0[k] & w1[k]);
+                }
+                i++;
+                j++;
+            }
+        }
+        return cnt;
+    }
+
+    //-----------------------------------//
+    // Mixed Sparse and Dense Operations //
+    //-----------------------------------//
+
+    // These modify this bitset, which can only lose bits
+    inline void setIntersection(const FastBitset &fb) { filter<true>(fb); }
+
+    inline void setDifference(const FastBitset &fb) { filter<false>(fb); }
+
+    // Size of the intersection, without modifying either bitset
+    inline uint64_t vecprod(const FastBitset &fb) const {
+        uint64_t cnt = 0;
+        for (size_t i = 0; i < containers.size(); i++) {
+            const SparseContainer &c = containers[i];
+            uint64_t first = c.key * chunk_blocks;
+            if (first >= fb.nb)
+                break;
+            const BlockType *b = fb.bits + first;
+            uint64_t len = chunkLength(fb, first);
+
+            if (c.type == ARRAY_CONTAINER) {
+                for (size_t k = 0; k < c.values.size(); k++)
+                    cnt += readWord(b, len, c.values[k]);
+            } else if (c.type == BITMAP_CONTAINER) {
+                for (uint64_t k = 0; k < len; k++)
+                    cnt += popcount(c.words[k] & b[k]);
+            } else {
+                for (size_t k = 0; k < c.values.size(); k += 2) {
+                    uint64_t begin = (first << BLOCK_SHIFT) + c.values[k];
+                    uint64_t end = std::min(begin + c.values[k + 1] + 1,
+                                            fb.nb << BLOCK_SHIFT);
+                    if (begin < end)
+                        cnt += fb.partial_count(begin, end - begin);
+                }
+            }
+        }
+        return cnt;
+    }
+
+    // These modify 'fb', touching only the blocks of the stored chunks
+    // (except for intersectInto, which clears everything else)
+
+    // fb |= this
+    inline void unionInto(FastBitset &fb) const {
+        for (size_t i = 0; i < containers.size(); i++) {
+            const SparseContainer &c = containers[i];
+            uint64_t first = c.key * chunk_blocks;
+            if (first >= fb.nb)
+                break;
+            BlockType *b = fb.bits + first;
+            uint64_t len = chunkLength(fb, first);
+
+            if (c.type == ARRAY_CONTAINER) {
+                for (size_t k = 0; k < c.values.size(); k++)
+                    if ((uint64_t)(c.values[k] >> 6) < len)
+                        b[c.values[k] >> 6] |= (BlockType)1
+                                               << (c.values[k] & 63);
+            } else if (c.type == BITMAP_CONTAINER) {
+                for (uint64_t k = 0; k < len; k++)
+                    b[k] |= c.words[k];
+            } else {
+                for (size_t k = 0; k < c.values.size(); k += 2)
+                    setRange(b, len, c.values[k],
+                             c.values[k] + c.values[k + 1] + 1);
+            }
+        }
+    }
+
+    // fb &= this
+    inline void intersectInto(FastBitset &fb) const {
+        BlockType w[chunk_blocks];
+        uint64_t done = 0;
+        for (size_t i = 0; i < containers.size(); i++) {
+            const SparseContainer &c = containers[i];
+            uint64_t first = c.key * chunk_blocks;
+            if (first >= fb.nb)
+                break;
+            uint64_t len = chunkLength(fb, first);
+
+            memset(fb.bits + done, 0, sizeof(BlockType) * (first - done));
+            toWords(c, w);
+            for (uint64_t k = 0; k < len; k++)
+                fb.bits[first + k] &= w[k];
+            done = first + len;
+        }
+        memset(fb.bits + done, 0, sizeof(BlockType) * (fb.nb - done));
+    }
+
+    // fb ^= this
+    inline void disjointUnionInto(FastBitset &fb) const {
+        combineInto<0x3c>(fb);
+    }
+
+    // fb &= ~this
+    inline void differenceFrom(FastBitset &fb) const {
+        combineInto<0x30>(fb);
+    }
+
+  private:
+    uint64_t n;                              // Number of bits
+    std::vector<SparseContainer> containers; // Non-empty chunks, by key
+
+    static const unsigned int chunk_shift = 16;
+    static const uint64_t chunk_mask = (1 << chunk_shift) - 1;
+    static const uint64_t chunk_blocks = (1 << chunk_shift) >> BLOCK_SHIFT;
+
+    // Largest array container; above this a bitmap is smaller
+    static const uint32_t array_max = 4096;
+
+    // Index of the first container whose key is not less than 'key'
+    inline size_t lowerBound(uint64_t key) const {
+        size_t lo = 0, hi = containers.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) >> 1;
+            if (containers[mid].key < key)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+    // Number of blocks of 'fb' in the chunk starting at block 'first',
+    // which is less than chunk_blocks at the end of the bitset
+    static inline uint64_t chunkLength(const FastBitset &fb, uint64_t first) {
+        return first < fb.nb ? std::min(fb.nb - first, (uint64_t)chunk_blocks)
+                             : 0;
+    }
+
+    //----------------------//
+    // Container Operations //
+    //----------------------//
+
+    // Read bit 'pos' from the 'len' words at 'b', which may be fewer
+    // than a whole chunk at the end of a FastBitset
+    static inline BlockType readWord(const BlockType *b, uint64_t len,
+                                     uint32_t pos) {
+        return (pos >> 6) < len ? (b[pos >> 6] >> (pos & 63)) & 1 : 0;
+    }
+
+    // Set bits [begin, end) of the 'len' words at 'b'
+    static inline void setRange(BlockType *b, uint64_t len, uint64_t begin,
+                                uint64_t end) {
+        end = std::min(end, len << BLOCK_SHIFT);
+        if (begin >= end)
+            return;
+        uint64_t b0 = begin >> BLOCK_SHIFT;
+        uint64_t b1 = (end - 1) >> BLOCK_SHIFT;
+        BlockType lower_mask = mask_table2[begin & 63];
+        BlockType upper_mask = mask_table[end & 63];
+        if (b0 == b1) {
+            b[b0] |= lower_mask & upper_mask;
+        } else {
+            b[b0] |= lower_mask;
+            for (uint64_t k = b0 + 1; k < b1; k++)
+                b[k] = ~(BlockType)0;
+            b[b1] |= upper_mask;
+        }
+    }
+
+    // Returns true if bit 'low' of the chunk is set
+    static inline bool contains(const SparseContainer &c, uint32_t low) {
+        if (c.type == ARRAY_CONTAINER)
+            return std::binary_search(c.values.begin(), c.values.end(),
+                                      (uint16_t)low);
+        if (c.type == BITMAP_CONTAINER)
+            return (c.words[low >> 6] >> (low & 63)) & 1;
+
+        // The last run starting at or before 'low'
+        size_t lo = 0, hi = c.values.size() >> 1;
+        while (lo < hi) {
+            size_t mid = (lo + hi) >> 1;
+            if (c.values[mid << 1] <= low)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo && low <= (uint32_t)c.values[(lo - 1) << 1] +
+                                c.values[((lo - 1) << 1) + 1];
+    }
+
+    // Returns the first bit set at or after 'low', or -1 if there is none
+    static inline int32_t nextValue(const SparseContainer &c, uint32_t low) {
+        if (c.type == ARRAY_CONTAINER) {
+            std::vector<uint16_t>::const_iterator it =
+                std::lower_bound(c.values.begin(), c.values.end(), low);
+            return it == c.values.end() ? -1 : *it;
+        }
+        if (c.type == BITMAP_CONTAINER)
+            return nextSet(&c.words[0], low);
+
+        for (size_t k = 0; k < c.values.size(); k += 2) {
+            uint32_t last = (uint32_t)c.values[k] + c.values[k + 1];
+            if (low <= last)
+                return std::max(low, (uint32_t)c.values[k]);
+        }
+        return -1;
+    }
+
+    // First set (or unset) bit at or after 'pos' in a whole chunk of
+    // words, or -1 (or 2^16) if there is none
+    static inline int32_t nextSet(const BlockType *w, uint32_t pos) {
+        uint64_t k = pos >> 6;
+        BlockType v = w[k] & mask_table2[pos & 63];
+        while (!v) {
+            if (++k == chunk_blocks)
+                return -1;
+            v = w[k];
+        }
+        return (k << BLOCK_SHIFT) + __builtin_ctzl(v);
+    }
+
+    static inline int32_t nextUnset(const BlockType *w, uint32_t pos) {
+        uint64_t k = pos >> 6;
+        BlockType v = ~w[k] & mask_table2[pos & 63];
+        while (!v) {
+            if (++k == chunk_blocks)
+                return 1 << chunk_shift;
+            v = ~w[k];
+        }
+        return (k << BLOCK_SHIFT) + __builtin_ctzl(v);
+    }
+
+    // Write all bits of the chunk into 'w'
+    static inline void toWords(const SparseContainer &c, BlockType *w) {
+        if (c.type == BITMAP_CONTAINER) {
+            memcpy(w, &c.words[0], sizeof(BlockType) * chunk_blocks);
+            return;
+        }
+
+        memset(w, 0, sizeof(BlockType) * chunk_blocks);
+        if (c.type == ARRAY_CONTAINER) {
+            for (size_t k = 0; k < c.values.size(); k++)
+                w[c.values[k] >> 6] |= (BlockType)1 << (c.values[k] & 63);
+        } else {
+            for (size_t k = 0; k < c.values.size(); k += 2)
+                setRange(w, chunk_blocks, c.values[k],
+                         c.values[k] + c.values[k + 1] + 1);
+        }
+    }
+
+    // Make 'c' an array or bitmap container holding the bits in 'w',
+    // whichever is smaller
+    static inline void fromWords(SparseContainer &c, const BlockType *w) {
+        c.card = 0;
+        for (uint64_t k = 0; k < chunk_blocks; k++)
+            c.card += popcount(w[k]);
+
+        if (c.card <= array_max) {
+            c.type = ARRAY_CONTAINER;
+            c.values.clear();
+            c.values.reserve(c.card);
+            for (uint64_t k = 0; k < chunk_blocks; k++)
+                for (BlockType v = w[k]; v; v &= v - 1)
+                    c.values.push_back((k << BLOCK_SHIFT) +
+                                       __builtin_ctzl(v));
+            std::vector<BlockType>().swap(c.words);
+        } else {
+            c.type = BITMAP_CONTAINER;
+            c.words.assign(w, w + chunk_blocks);
+            std::vector<uint16_t>().swap(c.values);
+        }
+    }
+
+    // Find the runs of the bits in 'w', as (start, length - 1) pairs
+    static inline void wordsToRuns(const BlockType *w,
+                                   std::vector<uint16_t> &runs) {
+        runs.clear();
+        int32_t start = nextSet(w, 0);
+        while (start >= 0) {
+            int32_t end = nextUnset(w, start);
+            runs.push_back(start);
+            runs.push_back(end - start - 1);
+            if (end == 1 << chunk_shift)
+                break;
+            start = nextSet(w, end);
+        }
+    }
+
+    // Convert a run container to an array or bitmap container
+    static inline void expand(SparseContainer &c) {
+        BlockType w[chunk_blocks];
+        toWords(c, w);
+        fromWords(c, w);
+    }
+
+    static inline void toBitmap(SparseContainer &c) {
+        c.words.assign(chunk_blocks, 0);
+        for (size_t k = 0; k < c.values.size(); k++)
+            c.words[c.values[k] >> 6] |= (BlockType)1 << (c.values[k] & 63);
+        c.type = BITMAP_CONTAINER;
+        std::vector<uint16_t>().swap(c.values);
+    }
+
+    static inline void toArray(SparseContainer &c) {
+        BlockType w[chunk_blocks];
+        toWords(c, w);
+        fromWords(c, w);
+    }
+
+    // Combine two containers with the same key, using the truth tables of
+    // FastBitset::combine(), and store the result in 'c'
+    template <int op>
+    static inline void combine(const SparseContainer &a,
+                               const SparseContainer &b, SparseContainer &c) {
+        c.key = a.key;
+
+        // Two arrays are merged directly
+        if (a.type == ARRAY_CONTAINER && b.type == ARRAY_CONTAINER &&
+            (op == 0xc0 || op == 0xfc || op == 0x3c || op == 0x30)) {
+            std::back_insert_iterator<std::vector<uint16_t> > out(c.values);
+            c.type = ARRAY_CONTAINER;
+            c.values.clear();
+            if (op == 0xc0)
+                std::set_intersection(a.values.begin(), a.values.end(),
+                                      b.values.begin(), b.values.end(), out);
+            else if (op == 0xfc)
+                std::set_union(a.values.begin(), a.values.end(),
+                               b.values.begin(), b.values.end(), out);
+            else if (op == 0x3c)
+                std::set_symmetric_difference(a.values.begin(),
+                                              a.values.end(), b.values.begin(),
+                                              b.values.end(), out);
+            else
+                std::set_difference(a.values.begin(), a.values.end(),
+                                    b.values.begin(), b.values.end(), out);
+            c.card = c.values.size();
+            if (c.card > array_max)
+                toBitmap(c);
+            return;
+        }
+
+        // An array is filtered by the other container
+        if ((op == 0xc0 || op == 0x30) && a.type == ARRAY_CONTAINER) {
+            c.type = ARRAY_CONTAINER;
+            c.values.clear();
+            for (size_t k = 0; k < a.values.size(); k++)
+                if (contains(b, a.values[k]) == (op == 0xc0))
+                    c.values.push_back(a.values[k]);
+            c.card = c.values.size();
+            return;
+        }
+        if (op == 0xc0 && b.type == ARRAY_CONTAINER) {
+            combine<op>(b, a, c);
+            return;
+        }
+
+        // Otherwise both are expanded to words
+        BlockType w0[chunk_blocks], w1[chunk_blocks];
+        toWords(a, w0);
+        toWords(b, w1);
+        for (uint64_t k = 0; k < chunk_blocks; k++)
+            w0[k] = FastBitset::combine<op>(w0[k], w1[k]);
+        fromWords(c, w0);
+    }
+
+    // Replace this bitset with 'this op sb'
+    template <int op> inline void apply(const SparseBitset &sb) {
+        // Chunks stored in only one of the bitsets are kept if the result
+        // is set where only that operand is set
+        const bool keep_this = op & 0x10;
+        const bool keep_other = op & 0x08;
+
+        std::vector<SparseContainer> result;
+        result.reserve(containers.size() + (keep_other ? sb.containers.size()
+                                                       : 0));
+        size_t i = 0, j = 0;
+        while (i < containers.size() || j < sb.containers.size()) {
+            if (j == sb.containers.size() ||
+                (i < containers.size() &&
+                 containers[i].key < sb.containers[j].key)) {
+                if (keep_this) {
+                    result.push_back(SparseContainer());
+                    result.back().swap(containers[i]);
+                }
+                i++;
+            } else if (i == containers.size() ||
+                       sb.containers[j].key < containers[i].key) {
+                if (keep_other)
+                    result.push_back(sb.containers[j]);
+                j++;
+            } else {
+                result.push_back(SparseContainer());
+                combine<op>(containers[i], sb.containers[j], result.back());
+                if (!result.back().card)
+                    result.pop_back();
+                i++;
+                j++;
+            }
+        }
+        containers.swap(result);
+    }
+
+    // Intersection with (or difference from) a FastBitset
+    template <bool keep>
+    inline void filter(const FastBitset &fb) {
+        std::vector<SparseContainer> result;
+        result.reserve(containers.size());
+        BlockType w[chunk_blocks];
+
+        for (size_t i = 0; i < containers.size(); i++) {
+            SparseContainer &c = containers[i];
+            uint64_t first = c.key * chunk_blocks;
+            uint64_t len = chunkLength(fb, first);
+            const BlockType *b = fb.bits + first;
+
+            if (c.type == ARRAY_CONTAINER) {
+                size_t m = 0;
+                for (size_t k = 0; k < c.values.size(); k++)
+                    if (!!readWord(b, len, c.values[k]) == keep)
+                        c.values[m++] = c.values[k];
+                c.values.resize(m);
+                c.card = m;
+            } else {
+                toWords(c, w);
+                for (uint64_t k = 0; k < chunk_blocks; k++) {
+                    BlockType v = k < len ? b[k] : 0;
+                    w[k] &= keep ? v : ~v;
+                }
+                fromWords(c, w);
+            }
+
+            if (c.card) {
+                result.push_back(SparseContainer());
+                result.back().swap(c);
+            }
+        }
+        containers.swap(result);
+    }
+
+    // fb = fb op this, for operations which leave fb unchanged where
+    // this bitset is empty
+    template <int op> inline void combineInto(FastBitset &fb) const {
+        BlockType w[chunk_blocks];
+        for (size_t i = 0; i < containers.size(); i++) {
+            const SparseContainer &c = containers[i];
+            uint64_t first = c.key * chunk_blocks;
+            if (first >= fb.nb)
+                break;
+            BlockType *b = fb.bits + first;
+            uint64_t len = chunkLength(fb, first);
+
+            if (c.type == ARRAY_CONTAINER) {
+                for (size_t k = 0; k < c.values.size(); k++) {
+                    uint64_t blk = c.values[k] >> 6;
+                    if (blk < len)
+                        b[blk] = FastBitset::combine<op>(
+                            b[blk], (BlockType)1 << (c.values[k] & 63));
+                }
+            } else {
+                toWords(c, w);
+                for (uint64_t k = 0; k < len; k++)
+                    b[k] = FastBitset::combine<op>(b[k], w[k]);
+            }
+        }
+    }
+};
+
+} // namespace fastmath
+
+#endif
@@ -38,6 +38,9 @@ autoreconf -vfi
 
 %files
 %defattr(-,root,root,-)
+/usr/include/fastmath/bitalgebra.h
+/usr/include/fastmath/bitexpr.h
+/usr/include/fastmath/bitmatrix.h
 /usr/include/fastmath/config.h
 /usr/include/fastmath/fastapprox.h
 /usr/include/fastmath/fastbitset.h
@@ -47,7 +50,9 @@ autoreconf -vfi
 /usr/include/fastmath/nint.h
 /usr/include/fastmath/printcolor.h
 /usr/include/fastmath/progressbar.h
+/usr/include/fastmath/rankselect.h
 /usr/include/fastmath/resources.h
+/usr/include/fastmath/sparsebitset.h
 /usr/include/fastmath/stopwatch.h
 
 %changelog
@@ -0,0 +1,223 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+
+#include "BenchBitAlgebra.h"
+
+using namespace fastmath;
+
+/* This benchmarks the Boolean matrix product and the transitive
+ * closure on random DAGs, comparing the row-OR loops (version 1) with
+ * the Method of Four Russians (version 2), as well as the bitwise
+ * (version 1) and tiled (version 2) transpose, and the interval abundance
+ * counted one pair at a time (version 1) or in tiles (version 2). The
+ * matrix sizes may be given on the command line. The first versions grow
+ * too slowly to finish at the largest default size, so above
+ * 'max_v1_size' only the second versions are timed. */
+
+static const uint64_t max_v1_size = 30000;
+
+int main(int argc, char **argv) {
+    std::vector<uint64_t> sizes;
+    for (int i = 1; i < argc; i++)
+        sizes.push_back(strtoull(argv[i], NULL, 10));
+    if (sizes.empty()) {
+        sizes.push_back(10000);
+        sizes.push_back(30000);
+        sizes.push_back(100000);
+    }
+
+    std::ofstream os("dat/bitalgebra_times.dat");
+    for (size_t i = 0; i < sizes.size(); i++) {
+        int first = sizes[i] <= max_v1_size ? 1 : 2;
+
+        // The product uses a denser DAG than the closure, since the
+        // closure of a sparse DAG is already dense
+        BitMatrix a(sizes[i], sizes[i]);
+        randomDAG(a, 100.0);
+        for (int version = first; version <= 2; version++)
+            os << "PRODUCT\t" << sizes[i] << "\t" << version << "\t"
+               << measureProduct(a, version) << std::endl;
+
+        randomDAG(a, 10.0);
+        for (int version = first; version <= 2; version++)
+            os << "CLOSURE\t" << sizes[i] << "\t" << version << "\t"
+               << measureClosure(a, version) << std::endl;
+
+        for (int version = first; version <= 2; version++)
+            os << "TRANSPOSE\t" << sizes[i] << "\t" << version << "\t"
+               << measureTranspose(a, version) << std::endl;
+
+        // The interval abundance uses a quarter of each size, since the
+        // closure is nearly complete and each related pair is counted
+        uint64_t m = sizes[i] / 4;
+        BitMatrix f(m, m), p(m, m);
+        randomDAG(f, 10.0);
+        transitiveClosure(f);
+        transpose(f, p);
+        for (int version = m <= max_v1_size ? 1 : 2; version <= 2; version++)
+            os << "ABUNDANCE\t" << m << "\t" << version << "\t"
+               << measureAbundance(f, p, version) << std::endl;
+    }
+
+    os.flush();
+    os.close();
+}
+
+// Fill 'm' with a random DAG whose vertices are in topological order,
+// with an expected out-degree 'degree' for the first vertex
+// The gap to the next edge in each row is drawn from the geometric
+// distribution, so the time is proportional to the number of edges
+void randomDAG(BitMatrix &m, const double degree) {
+    uint64_t n = m.getNumRows();
+    double p = std::min(degree / n, 1.0);
+    m.reset();
+    if (p <= 0.0)
+        return;
+    double logq = log1p(-p);
+    for (uint64_t i = 0; i < n; i++) {
+        for (uint64_t j = i + 1; j < n; j++) {
+            if (p < 1.0) {
+                double u = (rand() + 1.0) / ((double)RAND_MAX + 2.0);
+                double gap = floor(log(u) / logq);
+                if (gap >= (double)(n - j))
+                    break;
+                j += (uint64_t)gap;
+            }
+            m.set(i, j);
+        }
+    }
+}
+
+// Time the product A * A
+double measureProduct(const BitMatrix &a, const int version) {
+    Stopwatch watch = Stopwatch();
+    uint64_t n = a.getNumRows();
+    BitMatrix c(n, n);
+
+    printf("Measuring Boolean Product v%d (%" PRIu64 " x %" PRIu64 ").....\n",
+           version, n, n);
+    fflush(stdout);
+
+    stopwatchStart(&watch);
+    if (version == 1)
+        booleanProduct_v1(a, a, c);
+    else
+        booleanProduct_v2(a, a, c);
+    stopwatchStop(&watch);
+
+    uint64_t cnt = 0;
+    for (uint64_t i = 0; i < n; i++)
+        cnt += c[i].count_bits();
+
+    printf("\tTime:  %.6f sec\n", watch.elapsedTime);
+    printf("\tCount: %" PRIu64 "\n", cnt);
+    printf("\tCompleted.\n\n");
+    fflush(stdout);
+
+    return watch.elapsedTime;
+}
+
+// Time the transitive closure of a copy of A
+double measureClosure(const BitMatrix &a, const int version) {
+    Stopwatch watch = Stopwatch();
+    uint64_t n = a.getNumRows();
+    BitMatrix c = a;
+
+    printf("Measuring Transitive Closure v%d (%" PRIu64 " x %" PRIu64
+           ").....\n",
+           version, n, n);
+    fflush(stdout);
+
+    stopwatchStart(&watch);
+    if (version == 1)
+        transitiveClosure_v1(c);
+    else
+        transitiveClosure_v2(c);
+    stopwatchStop(&watch);
+
+    uint64_t cnt = 0;
+    for (uint64_t i = 0; i < n; i++)
+        cnt += c[i].count_bits();
+
+    printf("\tTime:  %.6f sec\n", watch.elapsedTime);
+    printf("\tCount: %" PRIu64 "\n", cnt);
+    printf("\tCompleted.\n\n");
+    fflush(stdout);
+
+    return watch.elapsedTime;
+}
+
+// Time the transpose of A
+double measureTranspose(const BitMatrix &a, const int version) {
+    Stopwatch watch = Stopwatch();
+    uint64_t n = a.getNumRows();
+    BitMatrix c(n, n);
+
+    printf("Measuring Transpose v%d (%" PRIu64 " x %" PRIu64 ").....\n",
+           version, n, n);
+    fflush(stdout);
+
+    stopwatchStart(&watch);
+    if (version == 1)
+        transpose_v1(a, c);
+    else
+        transpose_v2(a, c);
+    stopwatchStop(&watch);
+
+    uint64_t cnt = 0;
+    for (uint64_t i = 0; i < n; i++)
+        cnt += c[i].count_bits();
+
+    printf("\tTime:  %.6f sec\n", watch.elapsedTime);
+    printf("\tCount: %" PRIu64 "\n", cnt);
+    printf("\tCompleted.\n\n");
+    fflush(stdout);
+
+    return watch.elapsedTime;
+}
+
+// Time the interval abundance of the causal set with future F and past P
+double measureAbundance(const BitMatrix &f, const BitMatrix &p,
+                        const int version) {
+    Stopwatch watch = Stopwatch();
+    uint64_t n = f.getNumRows();
+    std::vector<uint64_t> abundance(n + 1);
+
+    printf("Measuring Interval Abundance v%d (%" PRIu64 " x %" PRIu64
+           ").....\n",
+           version, n, n);
+    fflush(stdout);
+
+    stopwatchStart(&watch);
+    if (version == 1)
+        intervalAbundance_v1(f, p, 0, n, &abundance[0], n + 1);
+    else
+        intervalAbundance_v2(f, p, 0, n, &abundance[0], n + 1);
+    stopwatchStop(&watch);
+
+    uint64_t cnt = 0;
+    for (uint64_t k = 0; k <= n; k++)
+        cnt += k * abundance[k];
+
+    printf("\tTime:  %.6f sec\n", watch.elapsedTime);
+    printf("\tCount: %" PRIu64 "\n", cnt);
+    printf("\tCompleted.\n\n");
+    fflush(stdout);
+
+    return watch.elapsedTime;
+}
@@ -0,0 +1,40 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#ifndef BENCH_BIT_ALGEBRA_H
+#define BENCH_BIT_ALGEBRA_H
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdio.h>
+
+#include <fastmath/bitalgebra.h>
+#include <fastmath/stopwatch.h>
+
+void randomDAG(fastmath::BitMatrix &m, const double degree);
+
+double measureProduct(const fastmath::BitMatrix &a, const int version);
+
+double measureClosure(const fastmath::BitMatrix &a, const int version);
+
+double measureTranspose(const fastmath::BitMatrix &a, const int version);
+
+double measureAbundance(const fastmath::BitMatrix &f,
+                        const fastmath::BitMatrix &p, const int version);
+
+#endif
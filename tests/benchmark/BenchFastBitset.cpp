@@ -0,0 +1,829 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+
+
+#include "BenchFastBitset.h"
+
+using namespace fastmath;
+
+/* This benchmarks the FastBitset data structure and prints
+ * to file data on memory usage and timings. The kernels are timed on
+ * bitsets of each size given on the command line, in bits, or by default
+ * on bitsets which fit in L1, L2, L3, and DRAM. Each kernel time is also
+ * written to CSV and JSON files, along with the instruction set used,
+ * so runs on different platforms may be compared. */
+
+struct SetKernel {
+    const char *name;
+    SetOperation op;
+    SimdLevel level; // Instruction set used
+};
+
+struct CountKernel {
+    const char *name;
+    CountOperation op;
+    SimdLevel level; // Instruction set used
+};
+
+struct CombinedKernel {
+    const char *name;
+    CombinedOperation op;
+};
+
+struct ExtractKernel {
+    const char *name;
+    ExtractOperation op;
+    SimdLevel level; // Instruction set used
+};
+
+struct HashKernel {
+    const char *name;
+    bool cached;
+    SimdLevel level; // Instruction set used
+};
+
+// The time of one kernel on one size
+struct KernelTime {
+    const char *name;
+    SimdLevel level; // Instruction set used
+    uint64_t nbits;
+    double bytes; // Bytes read per call, or zero if it does not stream
+    double time;  // Seconds per call
+};
+
+static std::vector<KernelTime> kernel_times;
+
+// The indices take 64 times the space of the bits, so larger sizes are
+// left out of the extraction benchmarks
+static const uint64_t max_extract_size = 1ULL << 28;
+
+int main(int argc, char **argv) {
+    uint64_t nrows = 1000000;
+    uint64_t ncols[] = {64, 512, 4096};
+    int nsizes = sizeof(ncols) / sizeof(uint64_t);
+
+    std::vector<uint64_t> kernel_sizes;
+    for (int i = 1; i < argc; i++)
+        kernel_sizes.push_back(strtoull(argv[i], NULL, 10));
+    if (kernel_sizes.empty()) {
+        kernel_sizes.push_back(1ULL << 14);
+        kernel_sizes.push_back(1ULL << 20);
+        kernel_sizes.push_back(1ULL << 24);
+        kernel_sizes.push_back(1ULL << 29);
+    }
+    int nkernel_sizes = kernel_sizes.size();
+
+    // Object size (not including the bits themselves)
+    printf("Size of FastBitset object: %zu bytes\n", sizeof(FastBitset));
+    printf("Object overhead for %" PRIu64 " rows: %.3f MB\n\n", nrows,
+           (double)(nrows * sizeof(FastBitset)) / 1048576);
+
+    // Method times
+    double construct_t[nsizes];
+
+    // Perform Operations
+    for (int i = 0; i < nsizes; i++)
+        construct_t[i] = measureConstruction(nrows, ncols[i], "Bitvector");
+
+    // Print Method Times
+    std::ofstream os("dat/fastbitset_method_times.dat");
+
+    os << "OBJECT\tsizeof\t" << sizeof(FastBitset) << std::endl;
+    for (int i = 0; i < nsizes; i++)
+        os << "CONSTRUCT\t" << ncols[i] << "\t" << (construct_t[i] / nrows)
+           << std::endl;
+
+    // Kernel times, for each version of each operation
+    // The instruction set is selected before each kernel is timed, so the
+    // parallel kernels use the fastest one
+    SimdLevel level = getSimdLevel();
+    SetKernel set_kernels[] = {
+        {"setIntersection_v1", &FastBitset::setIntersection_v1, SIMD_SCALAR},
+        {"setUnion_v1", &FastBitset::setUnion_v1, SIMD_SCALAR},
+        {"setDisjointUnion_v1", &FastBitset::setDisjointUnion_v1, SIMD_SCALAR},
+        {"setDifference_v1", &FastBitset::setDifference_v1, SIMD_SCALAR},
+#if FBALIGN >= 256
+        {"setIntersection_v2", &FastBitset::setIntersection_v2, SIMD_AVX2},
+        {"setUnion_v2", &FastBitset::setUnion_v2, SIMD_AVX2},
+        {"setDisjointUnion_v2", &FastBitset::setDisjointUnion_v2, SIMD_AVX2},
+        {"setDifference_v2", &FastBitset::setDifference_v2, SIMD_AVX2},
+#endif
+#if FBALIGN == 512
+        {"setIntersection_avx512", &FastBitset::setIntersection_avx512,
+         SIMD_AVX512},
+        {"setUnion_avx512", &FastBitset::setUnion_avx512, SIMD_AVX512},
+        {"setDisjointUnion_avx512", &FastBitset::setDisjointUnion_avx512,
+         SIMD_AVX512},
+        {"setDifference_avx512", &FastBitset::setDifference_avx512,
+         SIMD_AVX512},
+#endif
+        {"setIntersection_parallel", &FastBitset::setIntersection_parallel,
+         level},
+        {"setUnion_parallel", &FastBitset::setUnion_parallel, level},
+        {"setDisjointUnion_parallel", &FastBitset::setDisjointUnion_parallel,
+         level},
+        {"setDifference_parallel", &FastBitset::setDifference_parallel,
+         level},
+    };
+    int nset_kernels = sizeof(set_kernels) / sizeof(SetKernel);
+
+    CountKernel count_kernels[] = {
+        {"count_v1", &FastBitset::count_v1, SIMD_SCALAR},
+        {"count_v2", &FastBitset::count_v2, SIMD_SCALAR},
+        {"count_v3", &FastBitset::count_v3, SIMD_SCALAR},
+#if FBALIGN >= 256
+        {"count_v4", &FastBitset::count_v4, SIMD_AVX2},
+#endif
+#if FBALIGN == 512
+        {"count_v4", &FastBitset::count_v4, SIMD_AVX512},
+        // With and without the vpopcntq instruction
+        {"count_avx512", &FastBitset::count_avx512, SIMD_AVX512},
+        {"count_avx512", &FastBitset::count_avx512, SIMD_AVX512_VPOPCNT},
+#endif
+        {"count_parallel", &FastBitset::count_parallel, level},
+    };
+    int ncount_kernels = sizeof(count_kernels) / sizeof(CountKernel);
+
+    ExtractKernel extract_kernels[] = {
+        {"extract_indices_scalar", &FastBitset::extract_indices, SIMD_SCALAR},
+#if FBALIGN == 512
+        {"extract_indices_avx512", &FastBitset::extract_indices, SIMD_AVX512},
+#endif
+        {"extract_indices_parallel", &FastBitset::extract_indices_parallel,
+         level},
+    };
+    int nextract_kernels = sizeof(extract_kernels) / sizeof(ExtractKernel);
+
+    printf("Kernels use up to: %s\n", getSimdName(level));
+#ifdef _OPENMP
+    printf("Parallel kernels use %d threads\n", omp_get_max_threads());
+#endif
+    printf("\n");
+    for (int i = 0; i < nset_kernels; i++) {
+        if (set_kernels[i].level > level)
+            continue;
+        setSimdLevel(set_kernels[i].level);
+        for (int j = 0; j < nkernel_sizes; j++)
+            measureSetOperation(set_kernels[i].op, kernel_sizes[j],
+                                set_kernels[i].name);
+    }
+
+    for (int i = 0; i < ncount_kernels; i++) {
+        if (count_kernels[i].level > level)
+            continue;
+        setSimdLevel(count_kernels[i].level);
+        for (int j = 0; j < nkernel_sizes; j++)
+            measureCount(count_kernels[i].op, kernel_sizes[j],
+                         count_kernels[i].name);
+    }
+
+    for (int i = 0; i < nextract_kernels; i++) {
+        if (extract_kernels[i].level > level)
+            continue;
+        setSimdLevel(extract_kernels[i].level);
+        for (int j = 0; j < nkernel_sizes; j++)
+            if (kernel_sizes[j] <= max_extract_size)
+                measureExtraction(extract_kernels[i].op, kernel_sizes[j],
+                                  extract_kernels[i].name);
+    }
+    setSimdLevel(level);
+
+    // Prefix counts with partial_count() and the RankSelect index
+    const char *rank_queries[] = {"partial_count_prefix", "rank", "select"};
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < nkernel_sizes; j++)
+            if (kernel_sizes[j] <= max_extract_size)
+                measureRankSelect(i, kernel_sizes[j], rank_queries[i]);
+
+    // The expression (a & b) | (c - d), in one pass or one operation at
+    // a time
+    const char *expressions[] = {"expression_stepwise", "expression_fused"};
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < nkernel_sizes; j++)
+            measureExpression(i, kernel_sizes[j], expressions[i]);
+
+    // The hash in each instruction set, and the cached hash of a
+    // HashedBitset, which does not depend on the size
+    HashKernel hash_kernels[] = {
+        {"hash_v1", false, SIMD_SCALAR},
+#if FBALIGN >= 256
+        {"hash_v2", false, SIMD_AVX2},
+#endif
+#if FBALIGN == 512
+        {"hash_avx512", false, SIMD_AVX512},
+#endif
+        {"hash_cached", true, level},
+    };
+    int nhash_kernels = sizeof(hash_kernels) / sizeof(HashKernel);
+    for (int i = 0; i < nhash_kernels; i++) {
+        if (hash_kernels[i].level > level)
+            continue;
+        setSimdLevel(hash_kernels[i].level);
+        for (int j = 0; j < nkernel_sizes; j++)
+            measureHash(hash_kernels[i].cached, kernel_sizes[j],
+                        hash_kernels[i].name);
+    }
+
+    // The kernels which are selected at runtime are timed with each
+    // instruction set, up to the fastest
+    CombinedKernel combined_kernels[] = {
+        {"vecprod", &FastBitset::vecprod},
+        {"vecprod_v2", &FastBitset::vecprod_v2},
+        {"count_union", &FastBitset::count_union},
+        {"count_disjoint_union", &FastBitset::count_disjoint_union},
+        {"count_difference", &FastBitset::count_difference},
+    };
+    int ncombined_kernels = sizeof(combined_kernels) / sizeof(CombinedKernel);
+
+    // Range operations and partial counts over most of the bitset, with
+    // unaligned ends
+    const char *ranges[] = {"set_range",          "flip_range",
+                            "partial_union",      "partial_disjoint_union",
+                            "partial_difference", "any_in_range",
+                            "partial_count",      "partial_vecprod",
+                            "partial_intersection"};
+    int nranges = sizeof(ranges) / sizeof(const char *);
+
+    for (int l = SIMD_SCALAR; l <= level; l++) {
+        setSimdLevel((SimdLevel)l);
+        for (int j = 0; j < nkernel_sizes; j++)
+            measureCount(&FastBitset::count_bits, kernel_sizes[j],
+                         "count_bits");
+        for (int i = 0; i < ncombined_kernels; i++)
+            for (int j = 0; j < nkernel_sizes; j++)
+                measureCombinedCount(combined_kernels[i].op, kernel_sizes[j],
+                                     combined_kernels[i].name);
+        for (int i = 0; i < nranges; i++)
+            for (int j = 0; j < nkernel_sizes; j++)
+                measureRangeOperation(i, kernel_sizes[j], ranges[i]);
+    }
+    setSimdLevel(level);
+
+    // A bitset shared by every thread, filled using a private bitset
+    // per thread, atomic operations, or a builder per thread
+    const char *concurrent[] = {"concurrent_private", "concurrent_atomic",
+                                "concurrent_builder"};
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < nkernel_sizes; j++)
+            if (kernel_sizes[j] <= max_extract_size)
+                measureConcurrentSet(i, kernel_sizes[j], concurrent[i]);
+
+    for (size_t i = 0; i < kernel_times.size(); i++)
+        os << "KERNEL\t" << kernel_times[i].name << "\t"
+           << getSimdName(kernel_times[i].level) << "\t"
+           << kernel_times[i].nbits << "\t" << kernel_times[i].time
+           << std::endl;
+
+    os.flush();
+    os.close();
+
+    writeKernelTimesCsv("dat/fastbitset_kernels.csv");
+    writeKernelTimesJson("dat/fastbitset_kernels.json");
+}
+
+// Name of the platform the benchmarks were run on (see README.md)
+static const char *getPlatform() {
+    const char *platform = getenv("PLATFORM");
+    return platform != NULL ? platform : "unknown";
+}
+
+// Write one line per kernel time, with the platform and alignment on
+// each, so the files from several platforms may be concatenated
+void writeKernelTimesCsv(const char *filename) {
+    assert(filename != NULL);
+
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Could not open %s\n", filename);
+        return;
+    }
+
+    fprintf(f, "platform,fbalign,kernel,simd,bits,bytes,ns_per_op,"
+               "gb_per_s\n");
+    for (size_t i = 0; i < kernel_times.size(); i++) {
+        const KernelTime &k = kernel_times[i];
+        fprintf(f, "%s,%d,%s,%s,%" PRIu64 ",%.0f,%.3f,", getPlatform(),
+                FBALIGN, k.name, getSimdName(k.level), k.nbits, k.bytes,
+                k.time * 1e9);
+        // The throughput is left empty for kernels which do not stream
+        if (k.bytes > 0.0)
+            fprintf(f, "%.3f", k.bytes / k.time / 1e9);
+        fprintf(f, "\n");
+    }
+    fclose(f);
+}
+
+// Write the kernel times along with a description of the machine
+void writeKernelTimesJson(const char *filename) {
+    assert(filename != NULL);
+
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Could not open %s\n", filename);
+        return;
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"platform\": \"%s\",\n", getPlatform());
+    fprintf(f, "  \"fbalign\": %d,\n", FBALIGN);
+    fprintf(f, "  \"simd_support\": \"%s\",\n",
+            getSimdName(getSimdSupport()));
+    fprintf(f, "  \"simd_level\": \"%s\",\n", getSimdName(getSimdLevel()));
+#ifdef _OPENMP
+    fprintf(f, "  \"threads\": %d,\n", omp_get_max_threads());
+#else
+    fprintf(f, "  \"threads\": 1,\n");
+#endif
+    fprintf(f, "  \"kernels\": [");
+    for (size_t i = 0; i < kernel_times.size(); i++) {
+        const KernelTime &k = kernel_times[i];
+        fprintf(f, "%s\n    {\"kernel\": \"%s\", \"simd\": \"%s\", ",
+                i ? "," : "", k.name, getSimdName(k.level));
+        fprintf(f, "\"bits\": %" PRIu64 ", \"bytes\": %.0f, ", k.nbits,
+                k.bytes);
+        fprintf(f, "\"ns_per_op\": %.3f, \"gb_per_s\": ", k.time * 1e9);
+        if (k.bytes > 0.0)
+            fprintf(f, "%.3f}", k.bytes / k.time / 1e9);
+        else
+            fprintf(f, "null}");
+    }
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
+}
+
+// Save the time of a kernel run with the current instruction set
+// The bytes are those read by each call, used for the throughput
+static void recordKernelTime(const char *funcname, const uint64_t nbits,
+                             const double bytes, const double time) {
+    KernelTime k = {funcname, getSimdLevel(), nbits, bytes, time};
+    kernel_times.push_back(k);
+}
+
+// Number of times a kernel is repeated on bitsets of 'nbits' bits
+// Each measurement streams about 1 GB through the kernel
+static uint64_t getIterations(const uint64_t nbits) {
+    return std::max(((uint64_t)1 << 33) / nbits, (uint64_t)4);
+}
+
+// Time a set operation on two bitsets of 'nbits' bits
+// Returns the time per call in seconds
+double measureSetOperation(SetOperation op, const uint64_t nbits,
+                           const char *funcname) {
+    assert(op != NULL);
+    assert(funcname != NULL);
+
+    Stopwatch watch = Stopwatch();
+    uint64_t iterations = getIterations(nbits);
+
+    printf("Measuring %s [%s] (%" PRIu64 " bits).....\n", funcname,
+           getSimdName(getSimdLevel()), nbits);
+    fflush(stdout);
+
+    FastBitset f(nbits), g(nbits);
+    for (uint64_t i = 0; i < nbits; i += 3)
+        f.set(i);
+    for (uint64_t i = 0; i < nbits; i += 5)
+        g.set(i);
+
+    stopwatchStart(&watch);
+    for (uint64_t i = 0; i < iterations; i++)
+        (f.*op)(g);
+    stopwatchStop(&watch);
+
+    double time = watch.elapsedTime / iterations;
+    printf("\tTime:       %.3f ns/op\n", time * 1e9);
+    printf("\tThroughput: %.3f GB/s\n", 2.0 * nbits / CHAR_BIT / time / 1e9);
+    printf("\tCompleted.\n\n");
+    fflush(stdout);
+
+    recordKernelTime(funcname, nbits, 2.0 * nbits / CHAR_BIT, time);
+    return time;
+}
+
+// Time a bit count of a bitset with 'nbits' bits
+// Returns the time per call in seconds
+double measureCount(CountOperation op, const uint64_t nbits,
+                    const char *funcname) {
+    assert(op != NULL);
+    assert(funcname != NULL);
+
+    Stopwatch watch = Stopwatch();
+    uint64_t iterations = getIterations(nbits);
+    uint64_t total = 0;
+
+    printf("Measuring %s [%s] (%" PRIu64 " bits).....\n", funcname,
+           getSimdName(getSimdLevel()), nbits);
+    fflush(stdout);
+
+    FastBitset f(nbits);
+    for (uint64_t i = 0; i < nbits; i += 3)
+        f.set(i);
+
+    stopwatchStart(&watch);
+    for (uint64_t i = 0; i < iterations; i++)
+        total += (f.*op)();
+    stopwatchStop(&watch);
+
+    double time = watch.elapsedTime / iterations;
+    printf("\tTime:       %.3f ns/op\n", time * 1e9);
+    printf("\tThroughput: %.3f GB/s\n", (double)nbits / CHAR_BIT / time / 1e9);
+    printf("\tCount:      %" PRIu64 "\n", total / iterations);
+    printf("\tCompleted.\n\n");
+    fflush(stdout);
+
+    recordKernelTime(funcname, nbits, (double)nbits / CHAR_BIT, time);
+    return time;
+}
+
+// Time the creation of a Bitvector with 'nrows' rows of 'ncols' bits
+// This is dominated by the allocation and initialization of each row
+double measureConstruction(const uint64_t nrows, const uint64_t ncols,
+                           const char *funcname) {
+    assert(nrows > 0);
+    assert(funcname != NULL);
+
+    Stopwatch watch = Stopwatch();
+    double time = 0.0;
+
+    printf("Measuring %s Construction (%" PRIu64 " x %" PRIu64 ").....\n",
+           funcname, nrows, ncols);
+    fflush(stdout);
+
+    Bitvector adj;
+    adj.reserve(nrows);
+
+    stopwatchStart(&watch);
+    for (uint64_t i = 0; i < nrows; i++)
+        adj.push_back(FastBitset(ncols));
+    stopwatchStop(&watch);
+
+    time = watch.elapsedTime;
+    stopwatchReset(&watch);
+
+    uint64_t payload = nrows * adj[0].getNumBlocks() * sizeof(BlockType);
+    uint64_t overhead = nrows * sizeof(FastBitset);
+    printf("\tPayload: %.3f MB\n", (double)payload / 1048576);
+    printf("\tObjects: %.3f MB\n", (double)overhead / 1048576);
+    printf("\tTime:    %.6f sec\n", time);
+    printf("\tCompleted.\n\n");
+    fflush(stdout);
+
+    return time;
+}
+
+// Time a combined count of two bitsets of 'nbits' bits
+// Returns the time per call in seconds
+double measureCombinedCount(CombinedOperation op, const uint64_t nbits,
+                            const char *funcname) {
+    assert(op != NULL);
+    assert(funcname != NULL);
+
+    Stopwatch watch = Stopwatch();
+    uint64_t iterations = getIterations(nbits);
+    uint64_t total = 0;
+
+    printf("Measuring %s [%s] (%" PRIu64 " bits).....\n", funcname,
+           getSimdName(getSimdLevel()), nbits);
+    fflush(stdout);
+
+    FastBitset f(nbits), g(nbits);
+    for (uint64_t i = 0; i < nbits; i += 3)
+        f.set(i);
+    for (uint64_t i = 0; i < nbits; i += 5)
+        g.set(i);
+
+    stopwatchStart(&watch);
+    for (uint64_t i = 0; i < iterations; i++)
+        total += (f.*op)(g);
+    stopwatchStop(&watch);
+
+    double time = watch.elapsedTime / iterations;
+    printf("\tTime:       %.3f ns/op\n", time * 1e9);
+    printf("\tThroughput: %.3f GB/s\n", 2.0 * nbits / CHAR_BIT / time / 1e9);
+    printf("\tCount:      %" PRIu64 "\n", total / iterations);
+    printf("\tCompleted.\n\n");
+    fflush(stdout);
+
+    recordKernelTime(funcname, nbits, 2.0 * nbits / CHAR_BIT, time);
+    return time;
+}
+
+// Time the extraction of the indices of the bits set in a bitset of
+// 'nbits' bits, with every third bit set
+// Returns the time per call in seconds
+double measureExtraction(ExtractOperation op, const uint64_t nbits,
+                         const char *funcname) {
+    assert(op != NULL);
+    assert(funcname != NULL);
+
+    Stopwatch watch = Stopwatch();
+    uint64_t iterations = getIterations(nbits);
+    uint64_t total = 0;
+
+    printf("Measuring %s [%s] (%" PRIu64 " bits).....\n", funcname,
+           getSimdName(getSimdLevel()), nbits);
+    fflush(stdout);
+
+    FastBitset f(nbits);
+    for (uint64_t i = 0; i < nbits; i += 3)
+        f.set(i);
+    std::vector<uint64_t> indices(f.count_bits());
+
+    stopwatchStart(&watch);
+    for (uint64_t i = 0; i < iterations; i++)
+        total += (f.*op)(&indices[0]);
+    stopwatchStop(&watch);
+
+    double time = watch.elapsedTime / iterations;
+    printf("\tTime:       %.3f ns/op\n", time * 1e9);
+    printf("\tRate:       %.3f ns/index\n", time * 1e9 / indices.size());
+    printf("\tCount:      %" PRIu64 "\n", total / iterations);
+    printf("\tCompleted.\n\n");
+    fflush(stdout);
+
+    recordKernelTime(funcname, nbits, (double)nbits / CHAR_BIT, time);
+    return time;
+}
+
+// Time random queries on a bitset of 'nbits' bits with every third bit
+// set: prefix counts with partial_count() (0), or rank() (1) and
+// select() (2) with a RankSelect index
+// Returns the time per query in seconds
+double measureRankSelect(const int query, const uint64_t nbits,
+                         const char *funcname) {
+    assert(query >= 0 && query <= 2);
+    assert(funcname != NULL);
+
+    Stopwatch watch = Stopwatch();
+    uint64_t iterations = query ? 1 << 22 : getIterations(nbits) * 8;
+    uint64_t total = 0;
+
+    printf("Measuring %s [%s] (%" PRIu64 " bits).....\n", funcname,
+           getSimdName(getSimdLevel()), nbits);
+    fflush(stdout);
+
+    FastBitset f(nbits);
+    for (uint64_t i = 0; i < nbits; i += 3)
+        f.set(i);
+    RankSelect rs(f);
+
+    // Queries are drawn with a linear congruential generator, so the
+    // generator costs the same for each kind of query
+    uint64_t x = 1, range = query == 2 ? rs.count_bits() : nbits;
+    stopwatchStart(&watch);
+    for (uint64_t i = 0; i < iterations; i++) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint64_t idx = (x >> 11) % range;
+        if (query == 0)
+            total += f.partial_count(0, idx + 1);
+        else if (query == 1)
+            total += rs.rank(idx);
+        else
+            total += rs.select(idx);
+    }
+    stopwatchStop(&watch);
+
+    double time = watch.elapsedTime / iterations;
+    printf("\tTime:       %.3f ns/query\n", time * 1e9);
+    printf("\tChecksum:   %" PRIu64 "\n", total);
+    printf("\tCompleted.\n\n");
+    fflush(stdout);
+
+    recordKernelTime(funcname, nbits, 0.0, time);
+    return time;
+}
+
+// Time the evaluation of (a & b) | (c - d) on bitsets of 'nbits' bits,
+// either fused into one pass with an expression template or one set
+// operation at a time with a workspace
+// Returns the time per evaluation in seconds
+double measureExpression(const bool fused, const uint64_t nbits,
+                         const char *funcname) {
+    assert(funcname != NULL);
+
+    Stopwatch watch = Stopwatch();
+    uint64_t iterations = getIterations(nbits);
+
+    printf("Measuring %s [%s] (%" PRIu64 " bits).....\n", funcname,
+           getSimdName(getSimdLevel()), nbits);
+    fflush(stdout);
+
+    FastBitset a(nbits), b(nbits), c(nbits), d(nbits), r(nbits), w(nbits);
+    for (uint64_t i = 0; i < nbits; i += 3)
+        a.set(i);
+    for (uint64_t i = 0; i < nbits; i += 5)
+        b.set(i);
+    for (uint64_t i = 0; i < nbits; i += 7)
+        c.set(i);
+    for (uint64_t i = 0; i < nbits; i += 2)
+        d.set(i);
+
+    stopwatchStart(&watch);
+    for (uint64_t i = 0; i < iterations; i++) {
+        if (fused) {
+            r = (a & b) | (c - d);
+        } else {
+            a.clone(r);
+            r.setIntersection(b);
+            c.clone(w);
+            w.setDifference(d);
+            r.setUnion(w);
+        }
+    }
+    stopwatchStop(&watch);
+
+    double time = watch.elapsedTime / iterations;
+    printf("\tTime:       %.3f ns/op\n", time * 1e9);
+    printf("\tCount:      %" PRIu64 "\n", r.count_bits());
+    printf("\tCompleted.\n\n");
+    fflush(stdout);
+
+    recordKernelTime(funcname, nbits, 4.0 * nbits / CHAR_BIT, time);
+    return time;
+}
+
+// Time the filling of a bitset of 'nbits' bits shared by every thread,
+// where each thread sets every third bit of its part of the bitset, with
+// a private bitset per thread which is merged afterward (mode 0), with
+// atomic_set() (mode 1), or with a ConcurrentBuilder (mode 2)
+// Returns the time per fill in seconds
+double measureConcurrentSet(const int mode, const uint64_t nbits,
+                            const char *funcname) {
+    assert(funcname != NULL);
+
+    Stopwatch watch = Stopwatch();
+    uint64_t iterations = std::max(((uint64_t)1 << 28) / nbits, (uint64_t)4);
+
+    printf("Measuring %s [%s] (%" PRIu64 " bits).....\n", funcname,
+           getSimdName(getSimdLevel()), nbits);
+    fflush(stdout);
+
+    FastBitset f(nbits);
+
+    stopwatchStart(&watch);
+    for (uint64_t k = 0; k < iterations; k++) {
+        f.reset();
+#pragma omp parallel
+        {
+            if (mode == 0) {
+                FastBitset local(nbits);
+#pragma omp for schedule(static)
+                for (uint64_t i = 0; i < nbits; i += 3)
+                    local.set(i);
+#pragma omp critical
+                f.setUnion(local);
+            } else if (mode == 1) {
+#pragma omp for schedule(static)
+                for (uint64_t i = 0; i < nbits; i += 3)
+                    f.atomic_set(i);
+            } else {
+                ConcurrentBuilder builder(f);
+#pragma omp for schedule(static)
+                for (uint64_t i = 0; i < nbits; i += 3)
+                    builder.set(i);
+            }
+        }
+    }
+    stopwatchStop(&watch);
+
+    double time = watch.elapsedTime / iterations;
+    printf("\tTime:       %.3f ns/op\n", time * 1e9);
+    printf("\tCount:      %" PRIu64 "\n", f.count_bits());
+    printf("\tCompleted.\n\n");
+    fflush(stdout);
+
+    recordKernelTime(funcname, nbits, (double)nbits / CHAR_BIT, time);
+    return time;
+}
+
+// Time the hash of a bitset of 'nbits' bits, or the cached hash of a
+// HashedBitset after one bit is changed
+// Returns the time per hash in seconds
+double measureHash(const bool cached, const uint64_t nbits,
+                   const char *funcname) {
+    assert(funcname != NULL);
+
+    Stopwatch watch = Stopwatch();
+    uint64_t iterations = getIterations(nbits);
+
+    printf("Measuring %s [%s] (%" PRIu64 " bits).....\n", funcname,
+           getSimdName(getSimdLevel()), nbits);
+    fflush(stdout);
+
+    FastBitset f(nbits);
+    for (uint64_t i = 0; i < nbits; i += 3)
+        f.set(i);
+    HashedBitset h(f);
+
+    size_t digest = 0;
+    stopwatchStart(&watch);
+    for (uint64_t i = 0; i < iterations; i++) {
+        if (cached) {
+            h.flip(i % nbits);
+            digest += h.hash();
+        } else {
+            f.flip(i % nbits);
+            digest += f.hash();
+        }
+    }
+    stopwatchStop(&watch);
+
+    double time = watch.elapsedTime / iterations;
+    printf("\tTime:       %.3f ns/op\n", time * 1e9);
+    printf("\tDigest:     %zx\n", digest);
+    printf("\tCompleted.\n\n");
+    fflush(stdout);
+
+    // The cached hash does not read the bits
+    recordKernelTime(funcname, nbits, cached ? 0.0 : (double)nbits / CHAR_BIT,
+                     time);
+    return time;
+}
+
+// Time a range operation on the bits [nbits / 8 + 3, 7 * nbits / 8) of a
+// bitset of 'nbits' bits: set_range() (0), flip_range() (1),
+// partial_union() (2), partial_disjoint_union() (3), partial_difference()
+// (4), any_in_range() (5) on a range with no bits set, partial_count()
+// (6), partial_vecprod() (7), or partial_intersection() (8)
+// Returns the time per call in seconds
+double measureRangeOperation(const int op, const uint64_t nbits,
+                             const char *funcname) {
+    assert(op >= 0 && op < 9);
+    assert(funcname != NULL);
+
+    Stopwatch watch = Stopwatch();
+    uint64_t iterations = getIterations(nbits);
+    uint64_t offset = nbits / 8 + 3, length = 7 * nbits / 8 - offset;
+    uint64_t total = 0;
+
+    // The bitsets read by each call, over the length of the range
+    bool single = op < 2 || op == 5 || op == 6;
+    double bytes = (single ? 1.0 : 2.0) * length / CHAR_BIT;
+
+    printf("Measuring %s [%s] (%" PRIu64 " bits).....\n", funcname,
+           getSimdName(getSimdLevel()), nbits);
+    fflush(stdout);
+
+    FastBitset f(nbits), g(nbits);
+    for (uint64_t i = 0; i < nbits; i += 5)
+        g.set(i);
+
+    stopwatchStart(&watch);
+    for (uint64_t i = 0; i < iterations; i++) {
+        switch (op) {
+        case 0:
+            f.set_range(offset, length);
+            break;
+        case 1:
+            f.flip_range(offset, length);
+            break;
+        case 2:
+            f.partial_union(g, offset, length);
+            break;
+        case 3:
+            f.partial_disjoint_union(g, offset, length);
+            break;
+        case 4:
+            f.partial_difference(g, offset, length);
+            break;
+        case 5:
+            total += f.any_in_range(offset, length);
+            break;
+        case 6:
+            total += g.partial_count(offset, length);
+            break;
+        case 7:
+            total += g.partial_vecprod(f, offset, length);
+            break;
+        default:
+            f.partial_intersection(g, offset, length);
+        }
+    }
+    stopwatchStop(&watch);
+
+    double time = watch.elapsedTime / iterations;
+    printf("\tTime:       %.3f ns/op\n", time * 1e9);
+    printf("\tThroughput: %.3f GB/s\n", bytes / time / 1e9);
+    if (op >= 5 && op <= 7)
+        printf("\tCount:      %" PRIu64 "\n", total / iterations);
+    printf("\tCompleted.\n\n");
+    fflush(stdout);
+
+    recordKernelTime(funcname, nbits, bytes, time);
+    return time;
+}
@@ -0,0 +1,75 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+
+
+#ifndef BENCH_FAST_BITSET_H
+#define BENCH_FAST_BITSET_H
+
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <fastmath/bitexpr.h>
+#include <fastmath/fastbitset.h>
+#include <fastmath/rankselect.h>
+#include <fastmath/stopwatch.h>
+
+// Pointers to the FastBitset kernels being compared
+typedef void (fastmath::FastBitset::*SetOperation)(
+    const fastmath::FastBitset &);
+typedef uint64_t (fastmath::FastBitset::*CountOperation)() const;
+typedef uint64_t (fastmath::FastBitset::*CombinedOperation)(
+    const fastmath::FastBitset &) const;
+typedef uint64_t (fastmath::FastBitset::*ExtractOperation)(uint64_t *) const;
+
+double measureConstruction(const uint64_t nrows, const uint64_t ncols,
+                           const char *funcname);
+
+double measureSetOperation(SetOperation op, const uint64_t nbits,
+                           const char *funcname);
+
+double measureCount(CountOperation op, const uint64_t nbits,
+                    const char *funcname);
+
+double measureCombinedCount(CombinedOperation op, const uint64_t nbits,
+                            const char *funcname);
+
+double measureExtraction(ExtractOperation op, const uint64_t nbits,
+                         const char *funcname);
+
+double measureRankSelect(const int query, const uint64_t nbits,
+                         const char *funcname);
+
+double measureExpression(const bool fused, const uint64_t nbits,
+                         const char *funcname);
+
+double measureHash(const bool cached, const uint64_t nbits,
+                   const char *funcname);
+
+double measureRangeOperation(const int op, const uint64_t nbits,
+                             const char *funcname);
+
+double measureConcurrentSet(const int mode, const uint64_t nbits,
+                            const char *funcname);
+
+void writeKernelTimesCsv(const char *filename);
+
+void writeKernelTimesJson(const char *filename);
+
+#endif
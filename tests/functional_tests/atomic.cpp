@@ -0,0 +1,151 @@
+/* Copyright 2014-2022 Will Cunningham
+ *
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#include "bitmatrix.h"
+#include <stdlib.h>
+
+using namespace fastmath;
+
+// Whether vertices i and j of the test graph are adjacent
+bool adjacent(uint64_t i, uint64_t j) { return (i * 7 + j * 13) % 10 < 3; }
+
+int main(int argc, char **argv) {
+    printf("Testing atomic operations.\n");
+#ifdef _OPENMP
+    // Several threads are used even on a single core
+    omp_set_num_threads(8);
+#endif
+
+    // Every thread writes bits in the same blocks, and the last block is
+    // partly used
+    uint64_t n = 100001;
+    FastBitset f(n), g(n);
+#pragma omp parallel for schedule(static, 1)
+    for (uint64_t i = 0; i < n; i += 3)
+        f.atomic_set(i);
+    for (uint64_t i = 0; i < n; i += 3)
+        g.set(i);
+    printf("Atomic sets match? %s\n", f == g ? "Yes" : "No");
+
+#pragma omp parallel for schedule(static, 1)
+    for (uint64_t i = 0; i < n; i += 3) {
+        f.atomic_unset(i);
+        f.atomic_flip(i + 1);
+    }
+    g.reset();
+    for (uint64_t i = 1; i < n; i += 3)
+        g.set(i);
+    printf("Atomic unsets and flips match? %s\n", f == g ? "Yes" : "No");
+
+    // Each bit is claimed by exactly one of the threads which set it
+    FastBitset visited(n);
+    uint64_t claimed = 0;
+#pragma omp parallel for schedule(static, 1) reduction(+ : claimed)
+    for (uint64_t i = 0; i < 4 * n; i++)
+        claimed += !visited.test_and_set(i % n);
+    printf("Each bit claimed once? %s\n",
+           claimed == n && visited.count_bits() == n ? "Yes" : "No");
+
+    uint64_t released = 0;
+#pragma omp parallel for schedule(static, 1) reduction(+ : released)
+    for (uint64_t i = 0; i < 2 * n; i++)
+        released += visited.test_and_unset(i % n);
+    printf("Each bit released once? %s\n",
+           released == n && !visited.any() ? "Yes" : "No");
+
+    // Each thread unions a different bit into every block
+    FastBitset h(64 * 128);
+    uint64_t nblocks = h.getNumBlocks();
+#pragma omp parallel for schedule(static, 1)
+    for (uint64_t t = 0; t < 64; t++)
+        for (uint64_t j = 0; j < nblocks; j++)
+            h.fetch_or_block((BlockType)1 << t, j);
+    printf("Block unions fill the bitset? %s\n",
+           h.count_bits() == h.size() ? "Yes" : "No");
+    printf("Block intersection returns old value? %s\n",
+           h.fetch_and_block(0, 0) == ~(BlockType)0 && !h.readBlock(0)
+               ? "Yes"
+               : "No");
+
+    printf("\nTesting concurrent builders.\n");
+    // Each thread adds both (i, j) and (j, i), so rows are shared
+    uint64_t v = 1000;
+    BitMatrix m(v, v), m_ref(v, v);
+    for (uint64_t i = 0; i < v; i++)
+        for (uint64_t j = i + 1; j < v; j++)
+            if (adjacent(i, j)) {
+                m_ref.set(i, j);
+                m_ref.set(j, i);
+            }
+
+#pragma omp parallel
+    {
+        ConcurrentBuilder builder(m);
+#pragma omp for schedule(dynamic, 1)
+        for (uint64_t i = 0; i < v; i++)
+            for (uint64_t j = i + 1; j < v; j++)
+                if (adjacent(i, j))
+                    builder.set(i, j);
+        builder.flush();
+
+#pragma omp for schedule(dynamic, 1)
+        for (uint64_t j = 0; j < v; j++)
+            for (uint64_t i = 0; i < j; i++)
+                if (adjacent(i, j))
+                    m.atomic_set(j, i);
+    }
+    bool match = true;
+    for (uint64_t i = 0; i < v; i++)
+        match &= m[i] == m_ref[i];
+    printf("Builder matrix matches? %s\n", match ? "Yes" : "No");
+
+    // Builders on one bitset, flushed when they are destroyed
+    FastBitset row(n), row_ref(n);
+    for (uint64_t i = 0; i < n; i++)
+        if (adjacent(i, 1))
+            row_ref.set(i);
+#pragma omp parallel
+    {
+        ConcurrentBuilder builder(row);
+#pragma omp for schedule(static, 100)
+        for (uint64_t i = 0; i < n; i++)
+            if (adjacent(i, 1))
+                builder.set(i);
+    }
+    printf("Builder bitset matches? %s\n", row == row_ref ? "Yes" : "No");
+
+    // The rows of a matrix may also be built one at a time
+    BitMatrix q(v, v);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (uint64_t i = 0; i < v; i++) {
+        FastBitsetView r = q[i];
+        ConcurrentBuilder builder(r);
+        for (uint64_t j = 0; j < v; j++)
+            if (j != i && adjacent(std::min(i, j), std::max(i, j)))
+                builder.set(j);
+    }
+    match = true;
+    for (uint64_t i = 0; i < v; i++)
+        match &= q[i] == m_ref[i];
+    printf("Builder rows match? %s\n", match ? "Yes" : "No");
+    BlockType before = q.test_and_set(0, 1);
+    printf("Matrix test and set? %s\n",
+           !before && q.test_and_set(0, 1) && q.read(0, 1) ? "Yes" : "No");
+    BlockType old = q.fetch_or_block(1, 0, 0);
+    printf("Matrix block union? %s\n",
+           q.readBlock(0, 0) == (old | 1) ? "Yes" : "No");
+}
@@ -0,0 +1,205 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#include "bitalgebra.h"
+#include <stdlib.h>
+
+using namespace fastmath;
+
+// Fill a matrix with random bits, keeping only those above the diagonal
+// if 'dag' is set
+void randomize(BitMatrix &m, double density, bool dag) {
+    m.reset();
+    for (uint64_t i = 0; i < m.getNumRows(); i++)
+        for (uint64_t j = dag ? i + 1 : 0; j < m.getNumCols(); j++)
+            if ((double)rand() / RAND_MAX < density)
+                m.set(i, j);
+}
+
+bool equal(const BitMatrix &a, const BitMatrix &b) {
+    bool same = true;
+    for (uint64_t i = 0; i < a.getNumRows(); i++)
+        same &= a[i] == b[i];
+    return same;
+}
+
+bool equal(const Bitvector &a, const BitMatrix &b) {
+    bool same = true;
+    for (uint64_t i = 0; i < a.size(); i++)
+        same &= a[i] == b[i];
+    return same;
+}
+
+int main(int argc, char **argv) {
+    srand(time(NULL));
+
+    printf("Testing Boolean matrix product.\n");
+    BitMatrix a(150, 200), b(200, 700);
+    BitMatrix c1(150, 700), c2(150, 700);
+    randomize(a, 0.01, false);
+    randomize(b, 0.01, false);
+    booleanProduct_v1(a, b, c1);
+    booleanProduct_v2(a, b, c2);
+    printf("Product is nonzero? %s\n", c1[0].any() ? "Yes" : "No");
+    printf("Versions match (BitMatrix)? %s\n", equal(c1, c2) ? "Yes" : "No");
+
+    Bitvector av = a.toBitvector(), bv = b.toBitvector();
+    Bitvector cv(150, FastBitset(700));
+    booleanProduct(av, bv, cv);
+    printf("Versions match (Bitvector)? %s\n", equal(cv, c1) ? "Yes" : "No");
+
+    // The identity leaves a matrix unchanged
+    BitMatrix id(200, 200);
+    for (uint64_t i = 0; i < 200; i++)
+        id.set(i, i);
+    BitMatrix ai(150, 200);
+    booleanProduct(a, id, ai);
+    printf("A * I == A? %s\n", equal(a, ai) ? "Yes" : "No");
+
+    printf("\nTesting transitive closure.\n");
+    BitMatrix d1(300, 300);
+    randomize(d1, 0.005, true);
+    BitMatrix d2 = d1;
+    transitiveClosure_v1(d1);
+    transitiveClosure_v2(d2);
+    printf("Versions match (DAG)? %s\n", equal(d1, d2) ? "Yes" : "No");
+
+    // A closed relation is unchanged by another closure
+    transitiveClosure(d2);
+    printf("Closure is idempotent? %s\n", equal(d1, d2) ? "Yes" : "No");
+
+    BitMatrix g1(300, 300);
+    randomize(g1, 0.003, false);
+    BitMatrix g2 = g1;
+    Bitvector gv = g1.toBitvector();
+    transitiveClosure_v1(g1);
+    transitiveClosure_v2(g2);
+    transitiveClosure(gv);
+    printf("Versions match (cyclic)? %s\n", equal(g1, g2) ? "Yes" : "No");
+    printf("Versions match (Bitvector)? %s\n", equal(gv, g1) ? "Yes" : "No");
+
+    // A directed cycle closes to the complete relation
+    BitMatrix cyc(130, 130);
+    for (uint64_t i = 0; i < 130; i++)
+        cyc.set(i, (i + 1) % 130);
+    transitiveClosure(cyc);
+    uint64_t cnt = 0;
+    for (uint64_t i = 0; i < 130; i++)
+        cnt += cyc[i].count_bits();
+    printf("Cycle closure count: %" PRIu64 "\n", cnt);
+
+    printf("\nTesting transpose.\n");
+    BitMatrix t(200, 130), t1(130, 200), t2(130, 200);
+    randomize(t, 0.1, false);
+    transpose_v1(t, t1);
+    bool match = true;
+    for (int i = SIMD_SCALAR; i <= getSimdSupport(); i++) {
+        setSimdLevel((SimdLevel)i);
+        transpose_v2(t, t2);
+        match &= equal(t1, t2);
+    }
+    printf("Versions match (BitMatrix)? %s\n", match ? "Yes" : "No");
+
+    Bitvector tv = t.toBitvector(), tv1(130, FastBitset(200));
+    transpose(tv, tv1);
+    printf("Versions match (Bitvector)? %s\n", equal(tv1, t1) ? "Yes" : "No");
+
+    // Transposing twice gives back the original
+    BitMatrix tt(200, 130);
+    transpose(t2, tt);
+    printf("Transpose is an involution? %s\n", equal(t, tt) ? "Yes" : "No");
+
+    // The transpose of an upper triangular matrix is lower triangular
+    BitMatrix u(300, 300), ut(300, 300);
+    randomize(u, 0.5, true);
+    transpose(u, ut);
+    bool lower = true;
+    for (uint64_t i = 0; i < 300; i++)
+        lower &= ut[i].partial_count(i, 300 - i) == 0;
+    printf("Transpose is lower triangular? %s\n", lower ? "Yes" : "No");
+
+    printf("\nTesting intersection counts.\n");
+    BitMatrix x(150, 300), y(200, 300);
+    randomize(x, 0.3, false);
+    randomize(y, 0.3, false);
+    std::vector<uint64_t> counts(100 * 130);
+    match = true;
+    for (int i = SIMD_SCALAR; i <= getSimdSupport(); i++) {
+        setSimdLevel((SimdLevel)i);
+        intersectionCounts(x, 20, 120, y, 70, 200, &counts[0]);
+        for (uint64_t p = 0; p < 100; p++)
+            for (uint64_t q = 0; q < 130; q++)
+                match &= counts[p * 130 + q] == x[p + 20].vecprod(y[q + 70]);
+    }
+    printf("Counts match? %s\n", match ? "Yes" : "No");
+
+    // Only the pairs related by R are added to the histogram
+    BitMatrix rel(150, 200);
+    randomize(rel, 0.1, false);
+    uint64_t hist[80] = {0}, hist_ref[80] = {0};
+    intersectionHistogram(x, 0, 150, y, 0, 200, hist, 80, &rel);
+    for (uint64_t p = 0; p < 150; p++)
+        for (uint64_t q = 0; q < 200; q++)
+            if (rel.read(p, q))
+                hist_ref[std::min(x[p].vecprod(y[q]), (uint64_t)79)]++;
+    printf("Histograms match? %s\n",
+           !memcmp(hist, hist_ref, sizeof(hist)) ? "Yes" : "No");
+
+    printf("\nTesting interval abundance.\n");
+    BitMatrix fut(500, 500), past(500, 500);
+    randomize(fut, 0.02, true);
+    transitiveClosure(fut);
+    transpose(fut, past);
+    std::vector<uint64_t> ab1(500), ab2(500);
+    intervalAbundance_v1(fut, past, 0, 500, &ab1[0], 500);
+    match = true;
+    for (int i = SIMD_SCALAR; i <= getSimdSupport(); i++) {
+        setSimdLevel((SimdLevel)i);
+        std::fill(ab2.begin(), ab2.end(), 0);
+        intervalAbundance_v2(fut, past, 0, 500, &ab2[0], 500);
+        match &= ab1 == ab2;
+    }
+    printf("Versions match (BitMatrix)? %s\n", match ? "Yes" : "No");
+
+    // Row ranges add up to the whole histogram
+    Bitvector futv = fut.toBitvector(), pastv = past.toBitvector();
+    std::fill(ab2.begin(), ab2.end(), 0);
+    intervalAbundance(futv, pastv, 0, 170, &ab2[0], 500);
+    intervalAbundance(futv, pastv, 170, 500, &ab2[0], 500);
+    printf("Versions match (Bitvector)? %s\n", ab1 == ab2 ? "Yes" : "No");
+
+    // Every related pair is counted once
+    uint64_t related = 0, total = 0;
+    for (uint64_t i = 0; i < 500; i++) {
+        related += fut[i].count_bits();
+        total += ab1[i];
+    }
+    printf("Every relation counted? %s\n", related == total ? "Yes" : "No");
+
+    // A chain has one interval of each size k with n - k - 1 pairs
+    BitMatrix chain(200, 200), chain_past(200, 200);
+    for (uint64_t i = 0; i < 200; i++)
+        for (uint64_t j = i + 1; j < 200; j++)
+            chain.set(i, j);
+    transpose(chain, chain_past);
+    std::vector<uint64_t> cab(200);
+    intervalAbundance(chain, chain_past, 0, 200, &cab[0], 200);
+    bool exact = true;
+    for (uint64_t k = 0; k < 199; k++)
+        exact &= cab[k] == 199 - k;
+    printf("Chain abundance exact? %s\n", exact ? "Yes" : "No");
+}
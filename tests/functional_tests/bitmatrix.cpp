@@ -0,0 +1,102 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+
+
+#include "bitmatrix.h"
+#include <type_traits>
+
+using namespace fastmath;
+
+// Whether set() may be called on an object of type T
+template <class T, class = void> struct has_set : std::false_type {};
+template <class T>
+struct has_set<T, decltype(std::declval<T &>().set(0), void())>
+    : std::true_type {};
+
+int main(int argc, char **argv) {
+    BitMatrix m(6, 200);
+    printf("Testing BitMatrix properties.\n");
+    printf("Rows: %" PRIu64 "\n", m.getNumRows());
+    printf("Columns: %" PRIu64 "\n", m.getNumCols());
+    printf("Blocks per row: %" PRIu64 "\n", m.getNumBlocks());
+    printf("Row stride: %" PRIu64 "\n", m.getStride());
+
+    bool aligned = true;
+    for (uint64_t i = 0; i < m.getNumRows(); i++)
+        aligned &= !((uintptr_t)m.getRowAddress(i) % FastBitset::alignment);
+    printf("Rows aligned? %s\n", aligned ? "Yes" : "No");
+
+    printf("\nTesting reading and writing.\n");
+    for (uint64_t i = 0; i < m.getNumRows(); i++)
+        for (uint64_t j = i; j < m.getNumCols(); j += i + 1)
+            m.set(i, j);
+    m.unset(0, 0);
+    m[0].printBitset();
+    m[1].printBitset();
+    printf("Read (1,3): %d\n", (int)m.read(1, 3));
+    printf("Read (1,4): %d\n", (int)m.read(1, 4));
+    printf("Count in row 2: %" PRIu64 "\n", m[2].count_bits());
+
+    printf("\nTesting row views.\n");
+    m[0].setUnion(m[1]);
+    m[0].printBitset();
+    FastBitset r = m[3];
+    r.flip();
+    printf("Copy modified, row unchanged? %s\n",
+           m[3].count_bits() != r.count_bits() ? "Yes" : "No");
+    m[4] = r;
+    printf("Assignment copied into matrix? %s\n", m[4] == r ? "Yes" : "No");
+    printf("Segment count (row 4, blocks [0,1)): %" PRIu64 "\n",
+           m.segment(4, 0, 1).count_v1());
+    printf("Partial count (row 4, bits [0,64)): %" PRIu64 "\n",
+           m[4].partial_count(0, 64));
+
+    // The rows of a const matrix, and copies of them, cannot be written
+    const BitMatrix &cm = m;
+    typedef decltype(cm.row(0)) ConstRow;
+    typedef decltype(cm[0]) ConstElement;
+    typedef decltype(cm.segment(0, 0, 1)) ConstSegment;
+    static_assert(!std::is_assignable<ConstRow &, FastBitset>::value,
+                  "const rows must not be assignable");
+    static_assert(!std::is_assignable<ConstElement &, FastBitset>::value,
+                  "const rows must not be assignable");
+    static_assert(!std::is_assignable<ConstSegment &, FastBitset>::value,
+                  "const segments must not be assignable");
+    static_assert(!has_set<ConstRow>::value && !has_set<ConstElement>::value &&
+                      !has_set<ConstSegment>::value,
+                  "const rows must not have set()");
+    static_assert(!std::is_convertible<ConstRow, FastBitsetView>::value,
+                  "const rows must not convert to writable views");
+    static_assert(
+        std::is_same<decltype(cm.getRowAddress(0)), const BlockType *>::value,
+        "const matrices must not give writable addresses");
+    printf("Const row count: %" PRIu64 "\n", cm[4].count_bits());
+
+    printf("\nTesting conversion.\n");
+    Bitvector bv = m.toBitvector();
+    BitMatrix n(bv);
+    bool same = true;
+    for (uint64_t i = 0; i < m.getNumRows(); i++)
+        same &= m[i] == bv[i] && n[i] == bv[i];
+    printf("Bitvector round trip succeeded? %s\n", same ? "Yes" : "No");
+
+    BitMatrix p = n;
+    n.reset();
+    printf("Deep copy preserved? %s\n", p[5] == m[5] ? "Yes" : "No");
+    printf("Reset succeeded? %s\n", n[5].any() ? "No" : "Yes");
+}
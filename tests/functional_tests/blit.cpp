@@ -0,0 +1,109 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#include "fastbitset.h"
+
+using namespace fastmath;
+
+void randomize(FastBitset &f) {
+    f.reset();
+    for (uint64_t i = 0; i < f.size(); i++)
+        if (rand() & 1)
+            f.set(i);
+}
+
+// Reference copy, one bit at a time through a temporary
+void copyBits(FastBitset &dst, const FastBitset &src, uint64_t a, uint64_t b,
+              uint64_t length) {
+    std::vector<BlockType> tmp(length);
+    for (uint64_t i = 0; i < length; i++)
+        tmp[i] = src.read(a + i);
+    for (uint64_t i = 0; i < length; i++) {
+        if (tmp[i])
+            dst.set(b + i);
+        else
+            dst.unset(b + i);
+    }
+}
+
+int main(int argc, char **argv) {
+    const uint64_t n = 50000;
+    FastBitset f(n), g(n);
+    srand(12);
+
+    printf("Testing bit range operations.\n");
+    for (int level = SIMD_SCALAR; level <= getSimdSupport(); level++) {
+        setSimdLevel((SimdLevel)level);
+        printf("\nLevel %s:\n", getSimdName(getSimdLevel()));
+
+        uint64_t passed[4] = {0, 0, 0, 0}, total = 200;
+        for (uint64_t t = 0; t < total; t++) {
+            // Mostly short ranges, with some longer than the swap buffer
+            uint64_t length = t % 10 ? rand() % 700 : rand() % 40000;
+            uint64_t a = rand() % (n - length + 1);
+            uint64_t b = rand() % (n - length + 1);
+            randomize(f);
+            randomize(g);
+
+            // Copy between bitsets
+            FastBitset h = g, e = g;
+            h.copy_range(f, a, b, length);
+            copyBits(e, f, a, b, length);
+            passed[0] += h == e;
+
+            // Copy within a bitset, where the ranges may overlap
+            h = f;
+            e = f;
+            h.copy_range(h, a, b, length);
+            copyBits(e, f, a, b, length);
+            passed[1] += h == e;
+
+            // Move within a bitset
+            h = f;
+            e = f;
+            h.move_range(h, a, b, length);
+            for (uint64_t i = a; i < a + length; i++)
+                e.unset(i);
+            copyBits(e, f, a, b, length);
+            passed[2] += h == e;
+
+            // Swap between bitsets
+            FastBitset h0 = f, h1 = g, e0 = f, e1 = g;
+            h0.swap_range(h1, a, b, length);
+            copyBits(e0, g, b, a, length);
+            copyBits(e1, f, a, b, length);
+            passed[3] += h0 == e0 && h1 == e1;
+        }
+
+        printf("Copy:          %" PRIu64 " of %" PRIu64 " passed\n",
+               passed[0], total);
+        printf("Copy (Self):   %" PRIu64 " of %" PRIu64 " passed\n",
+               passed[1], total);
+        printf("Move (Self):   %" PRIu64 " of %" PRIu64 " passed\n",
+               passed[2], total);
+        printf("Swap:          %" PRIu64 " of %" PRIu64 " passed\n",
+               passed[3], total);
+    }
+
+    // Non-overlapping ranges of the same bitset
+    randomize(f);
+    FastBitset h = f, e = f;
+    h.swap_range(h, 100, 20000, 9000);
+    copyBits(e, f, 100, 20000, 9000);
+    copyBits(e, f, 20000, 100, 9000);
+    printf("\nSwap (Self):   %s\n", h == e ? "passed" : "FAILED");
+}
@@ -0,0 +1,80 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#include "fastbitset.h"
+
+using namespace fastmath;
+
+void initialize(FastBitset &f, FastBitset &g) {
+    f.reset();
+    g.reset();
+    for (uint64_t i = 0; i < f.size(); i += 3)
+        f.set(i);
+    for (uint64_t i = 0; i < g.size(); i += 5)
+        g.set(i);
+}
+
+// Count the bits in the result of a set operation applied to a copy
+uint64_t materialized(const FastBitset &f, const FastBitset &g,
+                      void (FastBitset::*op)(const FastBitset &)) {
+    FastBitset h = f;
+    (h.*op)(g);
+    return h.count_bits();
+}
+
+int main(int argc, char **argv) {
+    FastBitset f(3000);
+    FastBitset g(3000);
+    FastBitset e(3000);
+    initialize(f, g);
+
+    // Long enough for the Harley-Seal kernels, with blocks left over
+    FastBitset fl(100003);
+    FastBitset gl(100003);
+    initialize(fl, gl);
+
+    printf("Testing combined counts.\n");
+    for (int i = SIMD_SCALAR; i <= getSimdSupport(); i++) {
+        setSimdLevel((SimdLevel)i);
+        printf("\nLevel %s:\n", getSimdName(getSimdLevel()));
+
+        uint64_t cnt = f.vecprod(g);
+        printf("Intersection:   %" PRIu64 " (expected %" PRIu64 ")\n", cnt,
+               materialized(f, g, &FastBitset::setIntersection));
+        cnt = f.count_union(g);
+        printf("Union:          %" PRIu64 " (expected %" PRIu64 ")\n", cnt,
+               materialized(f, g, &FastBitset::setUnion));
+        cnt = f.count_disjoint_union(g);
+        printf("Disjoint Union: %" PRIu64 " (expected %" PRIu64 ")\n", cnt,
+               materialized(f, g, &FastBitset::setDisjointUnion));
+        cnt = f.count_difference(g);
+        printf("Difference:     %" PRIu64 " (expected %" PRIu64 ")\n", cnt,
+               materialized(f, g, &FastBitset::setDifference));
+        printf("Hamming:        %" PRIu64 "\n", f.hamming(g));
+        printf("Jaccard:        %.6f (expected %.6f)\n", f.jaccard(g),
+               200.0 / 1400.0);
+        printf("Empty Jaccard:  %.6f\n", e.jaccard(e));
+
+        bool match = fl.count_v4() == fl.count_v1() &&
+                     fl.count_bits() == fl.count_v1() &&
+                     fl.vecprod_v2(gl) == fl.vecprod(gl) &&
+                     f.vecprod_v2(g) == f.vecprod(g);
+        printf("Harley-Seal:    %s (expected %" PRIu64 ")\n",
+               match ? "Yes" : "No",
+               materialized(fl, gl, &FastBitset::setIntersection));
+    }
+}
@@ -24,6 +24,7 @@ void countAll(FastBitset &f) {
     printf("Version 1: %" PRIu64 "\n", f.count_v1());
     printf("Version 2: %" PRIu64 "\n", f.count_v2());
     printf("Version 3: %" PRIu64 "\n", f.count_v3());
+    printf("Version 4: %" PRIu64 "\n", f.count_v4());
 }
 
 int main(int argc, char **argv) {
@@ -43,12 +43,14 @@ int main(int argc, char **argv) {
     f.setDifference_v1(g);
     f.printBitset();
 
-#ifdef AVX2_ENABLED
-    printf("\nVersion 2:\n");
-    initialize(f, g);
-    f.printBitset();
-    g.printBitset();
-    f.setDifference_v2(g);
-    f.printBitset();
+#if FBALIGN >= 256
+    if (getSimdSupport() >= SIMD_AVX2) {
+        printf("\nVersion 2:\n");
+        initialize(f, g);
+        f.printBitset();
+        g.printBitset();
+        f.setDifference_v2(g);
+        f.printBitset();
+    }
 #endif
 }
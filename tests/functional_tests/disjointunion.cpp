@@ -41,12 +41,14 @@ int main(int argc, char **argv) {
     f.setDisjointUnion_v1(g);
     f.printBitset();
 
-#ifdef AVX2_ENABLED
-    printf("\nVersion 2:\n");
-    initialize(f, g);
-    f.printBitset();
-    g.printBitset();
-    f.setDisjointUnion_v2(g);
-    f.printBitset();
+#if FBALIGN >= 256
+    if (getSimdSupport() >= SIMD_AVX2) {
+        printf("\nVersion 2:\n");
+        initialize(f, g);
+        f.printBitset();
+        g.printBitset();
+        f.setDisjointUnion_v2(g);
+        f.printBitset();
+    }
 #endif
 }
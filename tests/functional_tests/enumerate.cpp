@@ -0,0 +1,106 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#include "fastbitset.h"
+
+using namespace fastmath;
+
+// Appends each index it is called with
+struct Collector {
+    Collector(std::vector<uint64_t> &_indices) : indices(_indices) {}
+    void operator()(uint64_t idx) { indices.push_back(idx); }
+    std::vector<uint64_t> &indices;
+};
+
+// Fills blocks with different numbers of bits, so both the sparse and the
+// dense decoding paths are used
+void initialize(FastBitset &f) {
+    f.reset();
+    srand(7);
+    for (uint64_t i = 0; i < f.size(); i++) {
+        uint64_t density = (i >> BLOCK_SHIFT) % 5;
+        if (rand() % 8 < (int)density * 2 - 1)
+            f.set(i);
+    }
+}
+
+// Reference list of the bits set in [offset, offset + length)
+std::vector<uint64_t> expected(const FastBitset &f, uint64_t offset,
+                               uint64_t length) {
+    std::vector<uint64_t> indices;
+    for (uint64_t i = offset; i < offset + length; i++)
+        if (f.read(i))
+            indices.push_back(i);
+    return indices;
+}
+
+const char *result(bool passed) { return passed ? "passed" : "FAILED"; }
+
+int main(int argc, char **argv) {
+    FastBitset f(10000);
+    initialize(f);
+    std::vector<uint64_t> all = expected(f, 0, f.size());
+    std::vector<uint64_t> range = expected(f, 1000, 3333);
+
+    printf("Testing set bit enumeration.\n");
+    printf("Bits set: %zu of %" PRIu64 "\n\n", all.size(), f.size());
+
+    std::vector<uint64_t> indices;
+    f.for_each_set_bit(Collector(indices));
+    printf("For Each:           %s\n", result(indices == all));
+    indices.clear();
+    f.for_each_set_bit(1000, 3333, Collector(indices));
+    printf("For Each (Range):   %s\n", result(indices == range));
+
+    bool ok = true;
+    uint64_t k = 0;
+    for (uint64_t i = f.find_next(0); i < f.size(); i = f.find_next(i + 1))
+        ok &= k < all.size() && all[k++] == i;
+    printf("Find Next:          %s\n", result(ok && k == all.size()));
+
+    for (int i = SIMD_SCALAR; i <= getSimdSupport(); i++) {
+        setSimdLevel((SimdLevel)i);
+        printf("\nLevel %s:\n", getSimdName(getSimdLevel()));
+
+        indices.assign(all.size(), 0);
+        uint64_t cnt = f.extract_indices(&indices[0]);
+        printf("Extract:            %s\n",
+               result(cnt == all.size() && indices == all));
+
+        indices.assign(range.size(), 0);
+        cnt = f.extract_indices(&indices[0], 1000, 3333);
+        printf("Extract (Range):    %s\n",
+               result(cnt == range.size() && indices == range));
+        cnt = f.extract_indices(&indices[0], 1000, 0);
+        printf("Extract (Empty):    %s\n", result(cnt == 0));
+    }
+
+    // Large enough to be split across threads
+    uint64_t n = (FastBitset::parallel_threshold << BLOCK_SHIFT) + 12345;
+    FastBitset g(n);
+    initialize(g);
+    all = expected(g, 0, n);
+
+#ifdef _OPENMP
+    omp_set_num_threads(5);
+#endif
+    printf("\nParallel:\n");
+    indices.assign(all.size(), 0);
+    uint64_t cnt = g.extract_indices_parallel(&indices[0]);
+    printf("Extract:            %s\n",
+           result(cnt == all.size() && indices == all));
+}
@@ -0,0 +1,103 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#include "bitexpr.h"
+#include "bitmatrix.h"
+
+using namespace fastmath;
+
+void randomize(FastBitset &f) {
+    f.reset();
+    for (uint64_t i = 0; i < f.size(); i++)
+        if (rand() & 1)
+            f.set(i);
+}
+
+int main(int argc, char **argv) {
+    // Sizes which end inside a block, on a block, and past a vector
+    const uint64_t sizes[] = {1, 63, 64, 200, 511, 512, 1000, 50000};
+    const int nsizes = sizeof(sizes) / sizeof(uint64_t);
+    srand(18);
+
+    printf("Testing bitset expressions.\n");
+    for (int level = SIMD_SCALAR; level <= getSimdSupport(); level++) {
+        setSimdLevel((SimdLevel)level);
+        printf("\nLevel %s:\n", getSimdName(getSimdLevel()));
+
+        uint64_t passed[5] = {0, 0, 0, 0, 0};
+        for (int s = 0; s < nsizes; s++) {
+            uint64_t n = sizes[s];
+            FastBitset a(n), b(n), c(n), d(n);
+            randomize(a);
+            randomize(b);
+            randomize(c);
+            randomize(d);
+
+            // The same expression, one operation at a time
+            FastBitset e = a, f = d;
+            e.setIntersection(b);
+            f.flip();
+            f.setIntersection(c);
+            e.setUnion(f);
+
+            FastBitset r = (a & b) | (c & ~d);
+            passed[0] += r == e;
+            passed[1] += ((a & b) | (c & ~d)).count_bits() == e.count_bits();
+
+            // A complement must not set the padding
+            FastBitset g = ~(a ^ b);
+            FastBitset h = a;
+            h.setDisjointUnion(b);
+            h.flip();
+            passed[2] += g == h && (~a).count_bits() == n - a.count_bits();
+
+            // The result may also be an operand
+            h = a;
+            h.setDifference(b);
+            h.setUnion(c);
+            a = (a - b) | c;
+            passed[3] += a == h;
+            a -= a ^ b;
+            passed[4] += !(a - a).any() && (~(a - a)).any() &&
+                         (a & ~a).count_bits() == 0;
+        }
+        printf("Expressions match:        %" PRIu64 "/%d\n", passed[0],
+               nsizes);
+        printf("Counts match:             %" PRIu64 "/%d\n", passed[1],
+               nsizes);
+        printf("Complements trimmed:      %" PRIu64 "/%d\n", passed[2],
+               nsizes);
+        printf("Operands overwritten:     %" PRIu64 "/%d\n", passed[3],
+               nsizes);
+        printf("Reductions match:         %" PRIu64 "/%d\n", passed[4],
+               nsizes);
+    }
+
+    // Rows of a matrix are views, which may be assigned expressions
+    printf("\nTesting expressions on matrix rows.\n");
+    BitMatrix m(3, 700);
+    for (uint64_t j = 0; j < 700; j++) {
+        if (j % 3 == 0)
+            m.set(0, j);
+        if (j % 5 == 0)
+            m.set(1, j);
+    }
+    m[2] = m[0] & m[1];
+    printf("Row 2 count: %" PRIu64 "\n", m[2].count_bits());
+    m[2] |= m[0] - m[1];
+    printf("Row 2 count: %" PRIu64 "\n", m[2].count_bits());
+}
@@ -0,0 +1,141 @@
+/* Copyright 2014-2022 Will Cunningham
+ *
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#include "bitmatrix.h"
+#include <unordered_set>
+
+using namespace fastmath;
+
+void randomize(FastBitset &f) {
+    f.reset();
+    for (uint64_t i = 0; i < f.size(); i++)
+        if (rand() & 1)
+            f.set(i);
+}
+
+int main(int argc, char **argv) {
+    // Sizes which end inside a block, on a block, and past a vector
+    const uint64_t sizes[] = {1, 63, 64, 200, 511, 512, 1000, 50000};
+    const int nsizes = sizeof(sizes) / sizeof(uint64_t);
+    srand(21);
+
+    printf("Testing bitset hashes.\n");
+    std::vector<FastBitset> sets;
+    std::vector<size_t> scalar;
+    for (int s = 0; s < nsizes; s++) {
+        sets.push_back(FastBitset(sizes[s]));
+        randomize(sets.back());
+        setSimdLevel(SIMD_SCALAR);
+        scalar.push_back(sets.back().hash());
+    }
+
+    for (int level = SIMD_SCALAR; level <= getSimdSupport(); level++) {
+        setSimdLevel((SimdLevel)level);
+        printf("\nLevel %s:\n", getSimdName(getSimdLevel()));
+
+        uint64_t passed[3] = {0, 0, 0};
+        for (int s = 0; s < nsizes; s++) {
+            FastBitset &f = sets[s];
+            FastBitset g = f;
+            passed[0] += f.hash() == scalar[s] &&
+                         std::hash<FastBitset>()(g) == scalar[s];
+
+            // Changing any one bit changes the hash
+            bool differ = true;
+            for (uint64_t i = 0; i < f.size(); i += 1 + f.size() / 50) {
+                g.flip(i);
+                differ &= g.hash() != scalar[s];
+                g.flip(i);
+            }
+            passed[1] += differ && g.hash() == scalar[s];
+
+            // The position of a block matters, even within a lane
+            FastBitset h(f.size() + 1024);
+            for (uint64_t k = 0; k < 64; k++)
+                h.set(k);
+            size_t first = h.hash();
+            h.reset();
+            for (uint64_t k = 512; k < 576; k++)
+                h.set(k);
+            passed[2] += h.hash() != first &&
+                         FastBitset(1).hash() != FastBitset(1000).hash();
+        }
+        printf("Versions match:           %" PRIu64 "/%d\n", passed[0],
+               nsizes);
+        printf("Single bits change hash:  %" PRIu64 "/%d\n", passed[1],
+               nsizes);
+        printf("Positions change hash:    %" PRIu64 "/%d\n", passed[2],
+               nsizes);
+    }
+
+    printf("\nTesting cached hashes.\n");
+    uint64_t passed = 0;
+    for (int s = 0; s < nsizes; s++) {
+        uint64_t n = sizes[s];
+        HashedBitset hb(sets[s]);
+        bool match = hb.hash() == sets[s].hash();
+        for (int i = 0; i < 200; i++) {
+            uint64_t idx = rand() % n;
+            switch (rand() % 4) {
+            case 0:
+                hb.set(idx);
+                break;
+            case 1:
+                hb.unset(idx);
+                break;
+            case 2:
+                hb.flip(idx);
+                break;
+            default:
+                // Only blocks below the last bit, so the padding stays zero
+                if ((idx | 63) < n)
+                    hb.writeBlock((BlockType)rand() << 32 | rand(),
+                                  idx >> BLOCK_SHIFT);
+            }
+            match &= hb.hash() == hb.bitset().hash();
+        }
+        passed += match;
+    }
+    printf("Cached hashes match:      %" PRIu64 "/%d\n", passed, nsizes);
+
+    // Rows of a matrix with many repeats
+    BitMatrix m(1000, 3000);
+    std::vector<FastBitset> patterns(10, FastBitset(3000));
+    for (int p = 0; p < 10; p++)
+        randomize(patterns[p]);
+    for (uint64_t i = 0; i < 1000; i++)
+        m[i] = patterns[(i * i) % 10];
+
+    std::unordered_set<HashedBitset> unique;
+    std::unordered_set<FastBitset> unique_fb;
+    for (uint64_t i = 0; i < 1000; i++) {
+        unique.insert(HashedBitset(m[i]));
+        unique_fb.insert(FastBitset(m[i]));
+    }
+    printf("Unique rows: %zu, %zu\n", unique.size(), unique_fb.size());
+
+    // Bitsets of different sizes with the same blocks are equal, so they
+    // must have the same hash
+    FastBitset a(10), b(20);
+    a.set(3);
+    b.set(3);
+    unique_fb.clear();
+    unique_fb.insert(a);
+    printf("Equal bitsets hash equally? %s\n",
+           a == b && a.hash() == b.hash() && unique_fb.count(b) ? "Yes"
+                                                                : "No");
+}
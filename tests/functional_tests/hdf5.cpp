@@ -63,4 +63,66 @@ int main(int argc, char **argv) {
         xvec[i] = len - i - 1;
     save_h5_vector(filename, dataname_vec, samplename, xvec, (hsize_t *)&len,
                    1);
+    FREE(xvec);
+
+    // Save and load bit-packed data
+    printf("Testing bit-packed datasets.\n");
+    FastBitset fb(1000), fb2;
+    for (uint64_t i = 0; i < fb.size(); i += 3)
+        fb.set(i);
+    save_h5_bitset(filename, "bits/fb", fb);
+    bool loaded = load_h5_bitset(filename, "bits/fb", fb2);
+    printf("Bitset round trip succeeded? %s\n",
+           loaded && fb2 == fb ? "Yes" : "No");
+
+    BitMatrix m(100, 300), m2;
+    for (uint64_t i = 0; i < m.getNumRows(); i++)
+        for (uint64_t j = i % 7; j < m.getNumCols(); j += 7)
+            m.set(i, j);
+    save_h5_bitmatrix(filename, "bits/m", m, 6);
+    loaded = load_h5_bitmatrix(filename, "bits/m", m2);
+    bool same = loaded && m2.getNumRows() == m.getNumRows() &&
+                m2.getNumCols() == m.getNumCols();
+    for (uint64_t i = 0; same && i < m.getNumRows(); i++)
+        same &= m2[i] == m[i];
+    printf("Matrix round trip succeeded? %s\n", same ? "Yes" : "No");
+
+    Bitvector bv = m.toBitvector(), bv2;
+    save_h5_bitmatrix(filename, "bits/m", bv);
+    loaded = load_h5_bitmatrix(filename, "bits/m", bv2);
+    printf("Bitvector round trip succeeded? %s\n",
+           loaded && bv2 == bv ? "Yes" : "No");
+
+    // Bits past the end in a file, e.g. one written by another program,
+    // are cleared when it is loaded
+    FastBitset tail(fb), expected(fb);
+    uint64_t last = (fb.size() - 1) >> BLOCK_SHIFT;
+    tail.writeBlock(~(BlockType)0, last);
+    for (uint64_t i = last << BLOCK_SHIFT; i < fb.size(); i++)
+        expected.set(i);
+    save_h5_bitset(filename, "bits/tail", tail);
+    loaded = load_h5_bitset(filename, "bits/tail", fb2);
+    printf("Bitset tail cleared? %s\n",
+           loaded && fb2 == expected &&
+                   fb2.count_bits() == expected.count_bits()
+               ? "Yes"
+               : "No");
+
+    BitMatrix mtail(m);
+    last = (m.getNumCols() - 1) >> BLOCK_SHIFT;
+    for (uint64_t i = 0; i < m.getNumRows(); i++)
+        mtail.writeBlock(~(BlockType)0, i, last);
+    save_h5_bitmatrix(filename, "bits/mtail", mtail);
+    loaded = load_h5_bitmatrix(filename, "bits/mtail", m2);
+    same = loaded && m2.getNumRows() == m.getNumRows();
+    for (uint64_t i = 0; same && i < m.getNumRows(); i++) {
+        FastBitset row(m[i]);
+        for (uint64_t j = last << BLOCK_SHIFT; j < m.getNumCols(); j++)
+            row.set(j);
+        same &= m2[i] == row && m2[i].count_bits() == row.count_bits();
+    }
+    printf("Matrix tails cleared? %s\n", same ? "Yes" : "No");
+
+    printf("Missing dataset rejected? %s\n",
+           load_h5_bitset(filename, "bits/none", fb2) ? "No" : "Yes");
 }
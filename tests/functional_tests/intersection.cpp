@@ -44,13 +44,15 @@ int main(int argc, char **argv) {
     f.setIntersection_v1(g);
     f.printBitset();
 
-#ifdef AVX2_ENABLED
-    printf("\nVersion 2:\n");
-    initialize(f, g);
-    f.printBitset();
-    g.printBitset();
-    f.setIntersection_v2(g);
-    f.printBitset();
+#if FBALIGN >= 256
+    if (getSimdSupport() >= SIMD_AVX2) {
+        printf("\nVersion 2:\n");
+        initialize(f, g);
+        f.printBitset();
+        g.printBitset();
+        f.setIntersection_v2(g);
+        f.printBitset();
+    }
 #endif
 
     printf("\nTesting partial intersection.\n");
@@ -93,20 +95,24 @@ int main(int argc, char **argv) {
     c = m.count_bits();
     printf("Count (COR): %" PRIu64 "\n", c);
 
-#ifdef AVX512_ENABLED
-    printf("\nVector product (AVX512):\n");
-    m.reset();
-    n.reset();
-    for (unsigned int i = 0; i < N; i++) {
-        if ((float)rand() / RAND_MAX > 0.5)
-            m.set(i);
-        if ((float)rand() / RAND_MAX > 0.5)
-            n.set(i);
-    }
+#if FBALIGN == 512
+    if (getSimdSupport() >= SIMD_AVX512) {
+        printf("\nVector product (AVX512):\n");
+        m.reset();
+        n.reset();
+        for (unsigned int i = 0; i < N; i++) {
+            if ((float)rand() / RAND_MAX > 0.5)
+                m.set(i);
+            if ((float)rand() / RAND_MAX > 0.5)
+                n.set(i);
+        }
 
-    c = m.partial_vecprod_avx512(n, 0, N);
-    printf("Count (VPD512): %" PRIu64 "\n", c);
-    c = m.partial_vecprod(n, 0, N);
-    printf("Count (VPD256): %" PRIu64 "\n", c);
+        c = m.partial_vecprod_avx512(n, 0, N);
+        printf("Count (VPD512): %" PRIu64 "\n", c);
+        setSimdLevel(SIMD_AVX2);
+        c = m.partial_vecprod(n, 0, N);
+        printf("Count (VPD256): %" PRIu64 "\n", c);
+        setSimdLevel(getSimdSupport());
+    }
 #endif
 }
@@ -0,0 +1,90 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#include "bitmatrix.h"
+#include <stdlib.h>
+
+using namespace fastmath;
+
+bool equal(const BitMatrix &a, const BitMatrix &b) {
+    if (a.getNumRows() != b.getNumRows() || a.getNumCols() != b.getNumCols())
+        return false;
+    bool same = true;
+    for (uint64_t i = 0; i < a.getNumRows(); i++)
+        same &= a[i] == b[i];
+    return same;
+}
+
+int main(int argc, char **argv) {
+    const char *filename = "mapped.bin";
+    srand(16);
+
+    printf("Testing BitMatrix files.\n");
+    BitMatrix m(300, 1000);
+    for (uint64_t i = 0; i < m.getNumRows(); i++)
+        for (uint64_t j = 0; j < m.getNumCols(); j++)
+            if (rand() % 10 == 0)
+                m.set(i, j);
+    printf("Saved? %s\n", m.save(filename) ? "Yes" : "No");
+
+    BitMatrix r;
+    printf("Mapped? %s\n", r.map(filename) ? "Yes" : "No");
+    printf("Is mapped? %s\n", r.isMapped() ? "Yes" : "No");
+    printf("Rows: %" PRIu64 ", columns: %" PRIu64 "\n", r.getNumRows(),
+           r.getNumCols());
+    printf("Same bits? %s\n", equal(m, r) ? "Yes" : "No");
+    printf("Slab aligned? %s\n",
+           (uintptr_t)r.getAddress() % BitMatrix::cache_line ? "No" : "Yes");
+
+    // Rows of the mapping are views which work with every operation
+    FastBitset u = r[0];
+    u.setUnion(r[1]);
+    FastBitset e = m[0];
+    e.setUnion(m[1]);
+    printf("Row operations match? %s\n", u == e ? "Yes" : "No");
+    r.willNeed(100, 50);
+    printf("Row 120 count matches? %s\n",
+           r[120].count_bits() == m[120].count_bits() ? "Yes" : "No");
+
+    // A copy is held in memory
+    BitMatrix c = r;
+    printf("Copy is mapped? %s\n", c.isMapped() ? "Yes" : "No");
+    printf("Copy matches? %s\n", equal(c, m) ? "Yes" : "No");
+
+    // Changes to a writable mapping reach the file
+    BitMatrix w;
+    w.map(filename, BitMatrix::map_writable | BitMatrix::map_populate |
+                        BitMatrix::map_random);
+    w[5].reset();
+    w.set(5, 7);
+    printf("Synced? %s\n", w.sync() ? "Yes" : "No");
+    w = BitMatrix();
+    m[5].reset();
+    m.set(5, 7);
+    BitMatrix s;
+    s.map(filename, BitMatrix::map_sequential);
+    printf("Changes written to file? %s\n", equal(s, m) ? "Yes" : "No");
+
+    // Files which are not BitMatrix files are rejected
+    FILE *f = fopen(filename, "wb");
+    fputs("not a matrix", f);
+    fclose(f);
+    BitMatrix bad;
+    printf("Rejected bad file? %s\n", bad.map(filename) ? "No" : "Yes");
+    printf("Left empty? %s\n", bad.getNumRows() ? "No" : "Yes");
+    remove(filename);
+}
@@ -0,0 +1,131 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#include "fastbitset.h"
+
+using namespace fastmath;
+
+void randomize(FastBitset &f) {
+    f.reset();
+    for (uint64_t i = 0; i < f.size(); i++)
+        if (rand() & 1)
+            f.set(i);
+}
+
+// Order bitsets by their first block
+bool lessThan(const FastBitset &a, const FastBitset &b) {
+    return a.readBlock(0) < b.readBlock(0);
+}
+
+int main(int argc, char **argv) {
+    srand(15);
+
+    printf("Testing swap.\n");
+    FastBitset a(1000), b(3000);
+    randomize(a);
+    randomize(b);
+    FastBitset a0 = a, b0 = b;
+    void *pa = a.getAddress();
+    a.swap(b);
+    printf("Contents swapped? %s\n", a == b0 && b == a0 ? "Yes" : "No");
+    printf("Memory swapped? %s\n", b.getAddress() == pa ? "Yes" : "No");
+    swap(a, b);
+    printf("Swapped back? %s\n", a == a0 && b == b0 ? "Yes" : "No");
+
+    // Rows of a vector are sorted by exchanging their memory
+    Bitvector rows(100, FastBitset(500));
+    std::vector<void *> addresses;
+    for (uint64_t i = 0; i < rows.size(); i++) {
+        randomize(rows[i]);
+        addresses.push_back(rows[i].getAddress());
+    }
+    std::sort(rows.begin(), rows.end(), lessThan);
+    bool sorted = true, same = true;
+    for (uint64_t i = 1; i < rows.size(); i++)
+        sorted &= !lessThan(rows[i], rows[i - 1]);
+    for (uint64_t i = 0; i < rows.size(); i++)
+        same &= std::find(addresses.begin(), addresses.end(),
+                          rows[i].getAddress()) != addresses.end();
+    printf("Rows sorted? %s\n", sorted ? "Yes" : "No");
+    printf("Rows kept their memory? %s\n", same ? "Yes" : "No");
+
+    // Views exchange their bits instead
+    std::vector<BlockType> buffer(2 * FastBitsetView::bytes(500) /
+                                  sizeof(BlockType));
+    FastBitsetView v0(&buffer[0], 500);
+    FastBitsetView v1(&buffer[buffer.size() / 2], 500);
+    v0 = rows[0];
+    v1 = rows[1];
+    swap(v0, v1);
+    printf("Views swapped? %s\n",
+           v0 == rows[1] && v1 == rows[0] ? "Yes" : "No");
+    printf("Views kept their memory? %s\n",
+           v0.getAddress() == &buffer[0] ? "Yes" : "No");
+
+    printf("\nTesting move semantics.\n");
+    FastBitset c = a;
+    pa = c.getAddress();
+    FastBitset d(std::move(c));
+    printf("Moved? %s\n", d == a && d.getAddress() == pa ? "Yes" : "No");
+    printf("Source empty? %s\n", c.size() == 0 ? "Yes" : "No");
+    c = std::move(d);
+    printf("Move assigned? %s\n", c == a && c.getAddress() == pa ? "Yes"
+                                                                   : "No");
+
+    // Growing a vector moves the bitsets rather than copying them
+    Bitvector grow;
+    grow.push_back(a);
+    pa = grow[0].getAddress();
+    for (int i = 0; i < 100; i++)
+        grow.push_back(b);
+    printf("Relocated without copying? %s\n",
+           grow[0].getAddress() == pa && grow[0] == a ? "Yes" : "No");
+
+    // A view is copied into a new bitset
+    FastBitset e(std::move(v0));
+    printf("View copied? %s\n",
+           e == rows[1] && e.getAddress() != v0.getAddress() ? "Yes" : "No");
+
+    printf("\nTesting reserve and resize.\n");
+    FastBitset f(100);
+    randomize(f);
+    FastBitset f0 = f;
+    f.reserve(5000);
+    printf("Capacity reserved? %s\n", f.getCapacity() >= 5000 ? "Yes" : "No");
+    printf("Bits kept? %s\n", f == f0 ? "Yes" : "No");
+    pa = f.getAddress();
+
+    // Grow, setting the new bits, and shrink again
+    f.resize(4000);
+    bool kept = true;
+    for (uint64_t i = 0; i < 100; i++)
+        kept &= f.read(i) == f0.read(i);
+    printf("Grown size: %" PRIu64 ", bits kept? %s, new bits: %" PRIu64
+           "\n",
+           f.size(), kept ? "Yes" : "No", f.count_bits() - f0.count_bits());
+    f.set();
+    f.resize(50);
+    printf("Shrunk count: %" PRIu64 "\n", f.count_bits());
+    f.resize(4000);
+    printf("Regrown count: %" PRIu64 "\n", f.count_bits());
+    printf("Reallocated? %s\n", f.getAddress() == pa ? "No" : "Yes");
+
+    // Assignment reuses the memory when it is large enough
+    f = f0;
+    printf("Assigned without allocating? %s\n",
+           f == f0 && f.getAddress() == pa ? "Yes" : "No");
+}
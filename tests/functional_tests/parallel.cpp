@@ -0,0 +1,95 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#include "fastbitset.h"
+#include <stdlib.h>
+
+using namespace fastmath;
+
+void initialize(FastBitset &f, FastBitset &g) {
+    f.reset();
+    g.reset();
+    for (uint64_t i = 0; i < f.size(); i++) {
+        if (rand() & 1)
+            f.set(i);
+        if (rand() & 1)
+            g.set(i);
+    }
+}
+
+// Compare a parallel set operation with the serial version
+bool compare(const FastBitset &f, const FastBitset &g,
+             void (FastBitset::*serial)(const FastBitset &),
+             void (FastBitset::*parallel)(const FastBitset &)) {
+    FastBitset h0 = f, h1 = f;
+    (h0.*serial)(g);
+    (h1.*parallel)(g);
+    return h0 == h1;
+}
+
+int main(int argc, char **argv) {
+    printf("Testing parallel operations.\n");
+#ifdef _OPENMP
+    // Several chunks are used even on a single core
+    omp_set_num_threads(5);
+#endif
+
+    // Large enough to use several threads, and not a whole number of
+    // cache lines per thread
+    uint64_t n = (FastBitset::parallel_threshold << BLOCK_SHIFT) + 12345;
+    FastBitset f(n), g(n);
+    srand(time(NULL));
+    initialize(f, g);
+
+    printf("Intersection matches? %s\n",
+           compare(f, g, &FastBitset::setIntersection,
+                   &FastBitset::setIntersection_parallel)
+               ? "Yes"
+               : "No");
+    printf("Union matches? %s\n",
+           compare(f, g, &FastBitset::setUnion, &FastBitset::setUnion_parallel)
+               ? "Yes"
+               : "No");
+    printf("Disjoint union matches? %s\n",
+           compare(f, g, &FastBitset::setDisjointUnion,
+                   &FastBitset::setDisjointUnion_parallel)
+               ? "Yes"
+               : "No");
+    printf("Difference matches? %s\n",
+           compare(f, g, &FastBitset::setDifference,
+                   &FastBitset::setDifference_parallel)
+               ? "Yes"
+               : "No");
+    printf("Count matches? %s\n",
+           f.count_parallel() == f.count_bits() ? "Yes" : "No");
+
+    FastBitset h(n);
+    f.clone_parallel(h);
+    printf("Clone matches? %s\n", h == f ? "Yes" : "No");
+    h.reset_parallel();
+    printf("Reset clears all bits? %s\n", !h.any() ? "Yes" : "No");
+
+    // Small bitsets use the serial versions
+    FastBitset s(1000), t(1000);
+    initialize(s, t);
+    printf("Small union matches? %s\n",
+           compare(s, t, &FastBitset::setUnion, &FastBitset::setUnion_parallel)
+               ? "Yes"
+               : "No");
+    printf("Small count matches? %s\n",
+           s.count_parallel() == s.count_bits() ? "Yes" : "No");
+}
@@ -0,0 +1,103 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#include "fastbitset.h"
+
+using namespace fastmath;
+
+void randomize(FastBitset &f) {
+    f.reset();
+    for (uint64_t i = 0; i < f.size(); i++)
+        if (rand() & 1)
+            f.set(i);
+}
+
+// Reference range operation, one bit at a time
+// The operation is 0 (set), 1 (reset), 2 (flip), 3 (union),
+// 4 (disjoint union) or 5 (difference)
+void rangeBits(FastBitset &f, const FastBitset &g, int op, uint64_t offset,
+               uint64_t length) {
+    for (uint64_t i = offset; i < offset + length; i++) {
+        BlockType a = f.read(i), b = g.read(i);
+        BlockType r = op == 0   ? 1
+                      : op == 1 ? 0
+                      : op == 2 ? !a
+                      : op == 3 ? a | b
+                      : op == 4 ? a ^ b
+                                : a & !b;
+        if (r)
+            f.set(i);
+        else
+            f.unset(i);
+    }
+}
+
+int main(int argc, char **argv) {
+    const uint64_t n = 50000;
+    const char *names[] = {"Set:", "Reset:", "Flip:", "Union:",
+                           "Disjoint Union:", "Difference:"};
+    FastBitset f(n), g(n);
+    srand(22);
+
+    printf("Testing range set operations.\n");
+    for (int level = SIMD_SCALAR; level <= getSimdSupport(); level++) {
+        setSimdLevel((SimdLevel)level);
+        printf("\nLevel %s:\n", getSimdName(getSimdLevel()));
+
+        uint64_t passed[7] = {0, 0, 0, 0, 0, 0, 0}, total = 200;
+        for (uint64_t t = 0; t < total; t++) {
+            // Mostly short ranges, including empty ones and single blocks
+            uint64_t length = t % 10 ? rand() % 700 : rand() % 40000;
+            uint64_t offset = rand() % (n - length + 1);
+            randomize(f);
+            randomize(g);
+
+            for (int op = 0; op < 6; op++) {
+                FastBitset h = f, e = f;
+                if (op == 0)
+                    h.set_range(offset, length);
+                else if (op == 1)
+                    h.reset_range(offset, length);
+                else if (op == 2)
+                    h.flip_range(offset, length);
+                else if (op == 3)
+                    h.partial_union(g, offset, length);
+                else if (op == 4)
+                    h.partial_disjoint_union(g, offset, length);
+                else
+                    h.partial_difference(g, offset, length);
+                rangeBits(e, g, op, offset, length);
+                passed[op] += h == e;
+            }
+
+            // A single bit in a sparse range, near either end or inside
+            FastBitset h(n);
+            uint64_t idx = offset + (t % 3 ? rand() % (length + 1) : 0);
+            if (idx < n)
+                h.set(idx);
+            bool expected = length && idx < offset + length;
+            passed[6] += h.any_in_range(offset, length) == expected &&
+                         h.none_in_range(offset, length) != expected;
+        }
+
+        for (int op = 0; op < 6; op++)
+            printf("%-16s%" PRIu64 " of %" PRIu64 " passed\n", names[op],
+                   passed[op], total);
+        printf("Any In Range:   %" PRIu64 " of %" PRIu64 " passed\n",
+               passed[6], total);
+    }
+}
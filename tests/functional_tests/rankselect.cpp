@@ -0,0 +1,74 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#include "rankselect.h"
+
+using namespace fastmath;
+
+const char *result(bool passed) { return passed ? "passed" : "FAILED"; }
+
+// Check rank() and select() against a scan of the bitset, for a bitset
+// with about one bit in 'step' set
+void check(uint64_t n, uint64_t step) {
+    FastBitset f(n);
+    srand(n + step);
+    for (uint64_t i = 0; i < n; i++)
+        if (!(rand() % step))
+            f.set(i);
+    // A long run and a long gap, so some entries are full or empty
+    for (uint64_t i = n / 3; i < n / 3 + 5000 && i < n; i++)
+        f.set(i);
+    for (uint64_t i = n / 2; i < n / 2 + 9000 && i < n; i++)
+        f.unset(i);
+
+    RankSelect rs(f);
+    printf("%" PRIu64 " bits, %" PRIu64 " set, %.2f%% overhead:\n", n,
+           rs.count_bits(),
+           100.0 * (rs.bytes() - sizeof(RankSelect)) /
+               (f.getNumBlocks() * sizeof(BlockType)));
+
+    bool ok = rs.count_bits() == f.count_bits() &&
+              rs.rank(n) == rs.count_bits();
+    for (uint64_t i = 0, r = 0; i < n; r += f.read(i++))
+        ok &= rs.rank(i) == r;
+    for (uint64_t i = 1; i < n; i += n / 7)
+        ok &= rs.rank(i) == f.partial_count(0, i);
+    printf("\tRank:   %s\n", result(ok));
+
+    ok = rs.select(rs.count_bits()) == n;
+    uint64_t k = 0;
+    for (uint64_t i = f.find_next(0); i < n; i = f.find_next(i + 1), k++)
+        ok &= rs.select(k) == i && rs.rank(i) == k;
+    printf("\tSelect: %s\n", result(ok && k == rs.count_bits()));
+}
+
+int main(int argc, char **argv) {
+    printf("Testing the rank/select index.\n\n");
+    check(100, 3);
+    check(3000, 1);
+    check(100000, 2);
+    check(1000003, 40);
+    check(3000000, 1000);
+
+    FastBitset f(5000);
+    RankSelect rs(f);
+    printf("Empty:   %s\n",
+           result(rs.rank(4000) == 0 && rs.select(0) == f.size()));
+    rs.clear();
+    printf("Cleared: %s\n",
+           result(!rs.valid() && rs.bytes() == sizeof(RankSelect)));
+}
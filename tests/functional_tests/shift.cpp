@@ -0,0 +1,71 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#include "fastbitset.h"
+
+using namespace fastmath;
+
+// Shift 'f' by reading and writing one bit at a time
+// A positive shift moves bits toward index zero, as shift_left() does
+FastBitset reference(const FastBitset &f, int64_t shift) {
+    FastBitset g(f.size());
+    for (int64_t i = 0; i < (int64_t)f.size(); i++)
+        if (i + shift >= 0 && i + shift < (int64_t)f.size() &&
+            f.read(i + shift))
+            g.set(i);
+    return g;
+}
+
+int main(int argc, char **argv) {
+    uint64_t sizes[] = {1, 63, 64, 65, 1000, 4096, 10007};
+    int nsizes = sizeof(sizes) / sizeof(uint64_t);
+    uint64_t shifts[] = {0, 1, 5, 63, 64, 65, 127, 500, 2049};
+
+    printf("Testing shift operations.\n");
+    for (int i = SIMD_SCALAR; i <= getSimdSupport(); i++) {
+        setSimdLevel((SimdLevel)i);
+        printf("\nLevel %s:\n", getSimdName(getSimdLevel()));
+
+        uint64_t failed = 0, total = 0;
+        for (int j = 0; j < nsizes; j++) {
+            uint64_t n = sizes[j];
+            FastBitset f(n);
+            srand(n);
+            for (uint64_t k = 0; k < n; k++)
+                if (rand() & 1)
+                    f.set(k);
+
+            // Shifts at and beyond the size clear the bitset
+            std::vector<uint64_t> s(shifts, shifts + 9);
+            s.push_back(n - 1);
+            s.push_back(n);
+            s.push_back(n + 3);
+            for (size_t k = 0; k < s.size(); k++) {
+                FastBitset g = f;
+                g.shift_left(s[k]);
+                failed += !(g == reference(f, s[k]));
+                g = f;
+                g.shift_right(s[k]);
+                // Comparing whole blocks also checks the padding is clear
+                failed += !(g == reference(f, -(int64_t)s[k]));
+                total += 2;
+            }
+        }
+        printf("Shifts: %" PRIu64 " of %" PRIu64 " passed\n", total - failed,
+               total);
+    }
+}
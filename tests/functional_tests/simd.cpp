@@ -0,0 +1,113 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+
+
+#include "fastbitset.h"
+#include <stdlib.h>
+
+using namespace fastmath;
+
+void initialize(FastBitset &f, FastBitset &g) {
+    f.reset();
+    g.reset();
+    for (uint64_t i = 0; i < f.size(); i++) {
+        if ((float)rand() / RAND_MAX > 0.5)
+            f.set(i);
+        if ((float)rand() / RAND_MAX > 0.5)
+            g.set(i);
+    }
+}
+
+// Apply every dispatched operation and collect the results
+void evaluate(const FastBitset &f, const FastBitset &g, Bitvector &results,
+              uint64_t *counts) {
+    FastBitset h = f;
+    h.setIntersection(g);
+    results[0] = h;
+    counts[0] = h.count_bits();
+
+    h = f;
+    h.setUnion(g);
+    results[1] = h;
+    counts[1] = h.count_bits();
+
+    h = f;
+    h.setDisjointUnion(g);
+    results[2] = h;
+    counts[2] = h.count_bits();
+
+    h = f;
+    h.setDifference(g);
+    results[3] = h;
+    counts[3] = h.count_bits();
+
+    h = f;
+    h.partial_intersection(g, 100, f.size() - 300);
+    results[4] = h;
+    counts[4] = h.partial_vecprod(g, 100, f.size() - 300);
+
+    // The combined counts leave both bitsets unchanged
+    counts[5] = f.vecprod(g);
+    counts[6] = f.count_union(g);
+    counts[7] = f.count_disjoint_union(g);
+    counts[8] = f.count_difference(g);
+
+    // Ranges with every number of blocks between their ends, so the
+    // vector kernels finish with partial vectors and single blocks
+    counts[9] = counts[10] = 0;
+    for (uint64_t k = 0; k < 40; k++) {
+        uint64_t offset = 37 * k + 5, length = 64 * k + 100;
+        counts[9] += f.partial_count(offset, length);
+        counts[10] += f.partial_vecprod(g, offset, length);
+    }
+}
+
+int main(int argc, char **argv) {
+    printf("Testing runtime dispatch.\n");
+    printf("Alignment: %d\n", FBALIGN);
+    printf("Supported: %s\n", getSimdName(getSimdSupport()));
+    printf("Selected: %s\n", getSimdName(getSimdLevel()));
+
+    const int nops = 11;
+    FastBitset f(20000);
+    FastBitset g(20000);
+    srand(time(NULL));
+    initialize(f, g);
+
+    Bitvector reference(nops, FastBitset(f.size()));
+    uint64_t reference_counts[nops];
+    setSimdLevel(SIMD_SCALAR);
+    evaluate(f, g, reference, reference_counts);
+
+    for (int i = SIMD_SCALAR; i <= getSimdSupport(); i++) {
+        Bitvector results(nops, FastBitset(f.size()));
+        uint64_t counts[nops];
+        setSimdLevel((SimdLevel)i);
+        evaluate(f, g, results, counts);
+
+        bool same = true;
+        for (int j = 0; j < nops; j++)
+            same &= results[j] == reference[j] &&
+                    counts[j] == reference_counts[j];
+        printf("Level %s matches scalar? %s\n", getSimdName(getSimdLevel()),
+               same ? "Yes" : "No");
+    }
+
+    setSimdLevel(SIMD_AVX512);
+    printf("Requesting avx512 selects: %s\n", getSimdName(getSimdLevel()));
+}
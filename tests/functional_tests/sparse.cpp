@@ -0,0 +1,135 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#include "sparsebitset.h"
+
+using namespace fastmath;
+
+// Bits are drawn so each kind of container appears: a few bits per chunk
+// (array), half of each chunk (bitmap), and long stretches (run)
+void initialize(FastBitset &f, int seed) {
+    f.reset();
+    srand(seed);
+    for (uint64_t i = 0; i < 3000; i++)
+        f.set(rand() % f.size());
+    for (uint64_t i = 1 << 17; i < (3 << 16); i++)
+        if (rand() & 1)
+            f.set(i);
+    for (uint64_t i = 5 << 16; i < (5 << 16) + 40000; i++)
+        f.set(i);
+}
+
+// Compare a sparse result against the same operation on dense bitsets
+void check(const char *name, const SparseBitset &s, const FastBitset &f) {
+    printf("%-16s%s (%" PRIu64 " bits set)\n", name,
+           s.toFastBitset() == f && s.count_bits() == f.count_bits()
+               ? "passed"
+               : "FAILED",
+           s.count_bits());
+}
+
+// Reference for SparseBitset::find_next()
+uint64_t findNext(const FastBitset &f, uint64_t idx) {
+    while (idx < f.size() && !f.read(idx))
+        idx++;
+    return idx;
+}
+
+int main(int argc, char **argv) {
+    uint64_t n = (6 << 16) + 1234;
+    FastBitset f(n), g(n), h(n);
+    initialize(f, 1);
+    initialize(g, 2);
+
+    printf("Testing the SparseBitset.\n\n");
+    SparseBitset s(f), t(g);
+    check("Conversion:", s, f);
+    printf("Containers:     %" PRIu64 "\n", s.getNumContainers());
+    printf("Bytes:          %zu (dense %zu)\n", s.bytes(),
+           (size_t)(f.getNumBlocks() * sizeof(BlockType)));
+
+    s.optimize();
+    t.optimize();
+    check("Optimize:", s, f);
+    printf("Bytes:          %zu\n", s.bytes());
+    printf("Equality:       %s\n", s == SparseBitset(f) ? "passed" : "FAILED");
+
+    bool ok = true;
+    for (uint64_t i = 0; i < n; i += 7)
+        ok &= s.read(i) == f.read(i);
+    printf("Read:           %s\n", ok ? "passed" : "FAILED");
+
+    ok = s.next_bit() == f.next_bit();
+    for (uint64_t i = (5 << 16) - 100; i < n; i += 9999)
+        ok &= s.find_next(i) == findNext(f, i);
+    printf("Find Next:      %s\n", ok ? "passed" : "FAILED");
+
+    printf("\nSparse operations:\n");
+    SparseBitset r = s;
+    r.setIntersection(t);
+    h = f; h.setIntersection(g);
+    check("Intersection:", r, h);
+    printf("%-16s%s\n", "Vecprod:", s.vecprod(t) == h.count_bits()
+                                        ? "passed" : "FAILED");
+    r = s; r.setUnion(t);
+    h = f; h.setUnion(g);
+    check("Union:", r, h);
+    r = s; r.setDisjointUnion(t);
+    h = f; h.setDisjointUnion(g);
+    check("Disjoint Union:", r, h);
+    r = s; r.setDifference(t);
+    h = f; h.setDifference(g);
+    check("Difference:", r, h);
+
+    printf("\nMixed operations:\n");
+    r = s; r.setIntersection(g);
+    h = f; h.setIntersection(g);
+    check("Intersection:", r, h);
+    printf("%-16s%s\n", "Vecprod:", s.vecprod(g) == h.count_bits()
+                                        ? "passed" : "FAILED");
+    r = s; r.setDifference(g);
+    h = f; h.setDifference(g);
+    check("Difference:", r, h);
+
+    FastBitset d = g;
+    s.unionInto(d);
+    h = g; h.setUnion(f);
+    printf("%-16s%s\n", "Union Into:", d == h ? "passed" : "FAILED");
+    d = g; s.intersectInto(d);
+    h = g; h.setIntersection(f);
+    printf("%-16s%s\n", "Intersect Into:", d == h ? "passed" : "FAILED");
+    d = g; s.disjointUnionInto(d);
+    h = g; h.setDisjointUnion(f);
+    printf("%-16s%s\n", "Disjoint Into:", d == h ? "passed" : "FAILED");
+    d = g; s.differenceFrom(d);
+    h = g; h.setDifference(f);
+    printf("%-16s%s\n", "Difference Into:", d == h ? "passed" : "FAILED");
+
+    printf("\nModification:\n");
+    r = s;
+    h = f;
+    for (uint64_t i = 3; i < n; i += 4099) {
+        r.set(i); h.set(i);
+        r.unset(i + 1); h.unset(i + 1);
+    }
+    for (uint64_t i = (5 << 16) + 100; i < (5 << 16) + 200; i++) {
+        r.unset(i); h.unset(i);
+    }
+    check("Set/Unset:", r, h);
+    r.reset();
+    printf("Reset:          %s\n", !r.any() ? "passed" : "FAILED");
+}
@@ -34,4 +34,38 @@ echo -e '\n'
 echo -e '\n'
 ./difference
 echo -e '\n'
+./bitmatrix
+echo -e '\n'
+./simd
+echo -e '\n'
+./combined
+echo -e '\n'
+./bitalgebra
+echo -e '\n'
+./parallel
+echo -e '\n'
+./sparse
+echo -e '\n'
+./enumerate
+echo -e '\n'
+./rankselect
+echo -e '\n'
+./shift
+echo -e '\n'
+./blit
+echo -e '\n'
+./view
+echo -e '\n'
+./move
+echo -e '\n'
+./mapped
+echo -e '\n'
+./expression
+echo -e '\n'
+./atomic
+echo -e '\n'
+./hash
+echo -e '\n'
+./range
+echo -e '\n'
 echo 'Completed all tests on FastBitset.'
@@ -0,0 +1,100 @@
+/* Copyright 2014-2022 Will Cunningham
+ * 
+ * This file is part of FastMath.
+ *
+ * Licensed under the GNU General Public License 3.0 (the "License").
+ * A copy of the License may be obtained with this software package or at
+ *
+ *      https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Use of this file is prohibited except in compliance with the License. Any
+ * modifications or derivative works of this file must retain this copyright
+ * notice, and modified files must contain a notice indicating that they have
+ * been altered from the originals.
+ *
+ * FastMath is distributed in the hope that it will be useful, but WITHOUT 
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+ * FITNESS FOR A PARTICULAR PURPOSE. See the License for more details. */
+#include "fastbitset.h"
+#include <sys/mman.h>
+
+using namespace fastmath;
+
+void randomize(FastBitset &f) {
+    f.reset();
+    for (uint64_t i = 0; i < f.size(); i++)
+        if (rand() & 1)
+            f.set(i);
+}
+
+int main(int argc, char **argv) {
+    const uint64_t n = 10000;
+    srand(14);
+
+    printf("Testing views over external memory.\n");
+    printf("Buffer size for %" PRIu64 " bits: %zu bytes\n", n,
+           FastBitsetView::bytes(n));
+
+    // A buffer received from elsewhere, e.g. with MPI_Recv
+    FastBitset f(n), g(n);
+    randomize(f);
+    randomize(g);
+    void *buffer = NULL;
+    if (posix_memalign(&buffer, FastBitset::alignment,
+                       FastBitsetView::bytes(n)))
+        return 1;
+    memcpy(buffer, f.getAddress(), FastBitsetView::bytes(n));
+
+    FastBitsetView v(buffer, n);
+    printf("Same bits? %s\n", v == f ? "Yes" : "No");
+    printf("Same count? %s\n", v.count_bits() == f.count_bits() ? "Yes" : "No");
+    printf("Same partial count? %s\n",
+           v.partial_count(123, 5000) == f.partial_count(123, 5000) ? "Yes"
+                                                                     : "No");
+    printf("Same next bit? %s\n",
+           v.next_bit() == f.next_bit() ? "Yes" : "No");
+    printf("Same product? %s\n",
+           v.vecprod(g) == f.vecprod(g) ? "Yes" : "No");
+
+    // Operations on the view write through to the buffer
+    FastBitset h = f;
+    h.setIntersection(g);
+    v.setIntersection(g);
+    FastBitsetView w(buffer, n);
+    printf("Intersection written to buffer? %s\n", w == h ? "Yes" : "No");
+    v.partial_intersection(g, 100, 3000);
+    h.partial_intersection(g, 100, 3000);
+    printf("Partial intersection written to buffer? %s\n",
+           w == h ? "Yes" : "No");
+
+    // A copy of a view owns its bits
+    FastBitset copy = v;
+    v.reset();
+    printf("Copy is independent? %s\n", copy == h ? "Yes" : "No");
+
+    // Assigning to a view copies into the buffer
+    v = f;
+    printf("Assignment copies into buffer? %s\n",
+           memcmp(buffer, f.getAddress(), FastBitsetView::bytes(n)) ? "No"
+                                                                    : "Yes");
+
+    // Garbage past the last bit is cleared by trim()
+    memset(buffer, 0xff, FastBitsetView::bytes(n));
+    v.trim();
+    printf("Trimmed count: %" PRIu64 "\n", v.count_bits());
+    free(buffer);
+
+    // A region mapped with mmap(), as when loading a file
+    size_t len = FastBitsetView::bytes(n);
+    void *region = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+        return 1;
+    FastBitsetView m(region, n);
+    m = f;
+    m.setUnion(g);
+    h = f;
+    h.setUnion(g);
+    printf("Union over mapped memory? %s\n", m == h ? "Yes" : "No");
+    munmap(region, len);
+}